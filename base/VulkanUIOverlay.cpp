@@ -327,30 +327,35 @@ namespace vks
 			return false;
 		}
 
+		if (geometry.size() <= currentFrame) {
+			geometry.resize(currentFrame + 1);
+		}
+		Geometry& frame = geometry[currentFrame];
+
 		// Vertex buffer
-		if ((vertexBuffer.buffer == VK_NULL_HANDLE) || (vertexCount != imDrawData->TotalVtxCount)) {
-			vertexBuffer.unmap();
-			vertexBuffer.destroy();
-			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &vertexBuffer, vertexBufferSize));
-			vertexCount = imDrawData->TotalVtxCount;
-			vertexBuffer.unmap();
-			vertexBuffer.map();
+		if ((frame.vertexBuffer.buffer == VK_NULL_HANDLE) || (frame.vertexCount != imDrawData->TotalVtxCount)) {
+			frame.vertexBuffer.unmap();
+			frame.vertexBuffer.destroy();
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &frame.vertexBuffer, vertexBufferSize));
+			frame.vertexCount = imDrawData->TotalVtxCount;
+			frame.vertexBuffer.unmap();
+			frame.vertexBuffer.map();
 			updateCmdBuffers = true;
 		}
 
 		// Index buffer
-		if ((indexBuffer.buffer == VK_NULL_HANDLE) || (indexCount < imDrawData->TotalIdxCount)) {
-			indexBuffer.unmap();
-			indexBuffer.destroy();
-			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &indexBuffer, indexBufferSize));
-			indexCount = imDrawData->TotalIdxCount;
-			indexBuffer.map();
+		if ((frame.indexBuffer.buffer == VK_NULL_HANDLE) || (frame.indexCount < imDrawData->TotalIdxCount)) {
+			frame.indexBuffer.unmap();
+			frame.indexBuffer.destroy();
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &frame.indexBuffer, indexBufferSize));
+			frame.indexCount = imDrawData->TotalIdxCount;
+			frame.indexBuffer.map();
 			updateCmdBuffers = true;
 		}
 
 		// Upload data
-		ImDrawVert* vtxDst = (ImDrawVert*)vertexBuffer.mapped;
-		ImDrawIdx* idxDst = (ImDrawIdx*)indexBuffer.mapped;
+		ImDrawVert* vtxDst = (ImDrawVert*)frame.vertexBuffer.mapped;
+		ImDrawIdx* idxDst = (ImDrawIdx*)frame.indexBuffer.mapped;
 
 		for (int n = 0; n < imDrawData->CmdListsCount; n++) {
 			const ImDrawList* cmd_list = imDrawData->CmdLists[n];
@@ -361,8 +366,8 @@ namespace vks
 		}
 
 		// Flush to make writes visible to GPU
-		vertexBuffer.flush();
-		indexBuffer.flush();
+		frame.vertexBuffer.flush();
+		frame.indexBuffer.flush();
 
 		return updateCmdBuffers;
 	}
@@ -373,7 +378,7 @@ namespace vks
 		int32_t vertexOffset = 0;
 		int32_t indexOffset = 0;
 
-		if ((!imDrawData) || (imDrawData->CmdListsCount == 0)) {
+		if ((!imDrawData) || (imDrawData->CmdListsCount == 0) || (geometry.size() <= currentFrame)) {
 			return;
 		}
 
@@ -387,8 +392,8 @@ namespace vks
 		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstBlock), &pushConstBlock);
 
 		VkDeviceSize offsets[1] = { 0 };
-		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer.buffer, offsets);
-		vkCmdBindIndexBuffer(commandBuffer, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &geometry[currentFrame].vertexBuffer.buffer, offsets);
+		vkCmdBindIndexBuffer(commandBuffer, geometry[currentFrame].indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT16);
 
 		for (int32_t i = 0; i < imDrawData->CmdListsCount; i++)
 		{
@@ -417,8 +422,10 @@ namespace vks
 
 	void UIOverlay::freeResources()
 	{
-		vertexBuffer.destroy();
-		indexBuffer.destroy();
+		for (Geometry& frame : geometry) {
+			frame.vertexBuffer.destroy();
+			frame.indexBuffer.destroy();
+		}
 		vkDestroyImageView(device->logicalDevice, fontView, nullptr);
 		vkDestroyImage(device->logicalDevice, fontImage, nullptr);
 		vkFreeMemory(device->logicalDevice, fontMemory, nullptr);
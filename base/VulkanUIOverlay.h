@@ -39,10 +39,16 @@ namespace vks
 		VkSampleCountFlagBits rasterizationSamples{ VK_SAMPLE_COUNT_1_BIT };
 		uint32_t subpass{ 0 };
 
-		vks::Buffer vertexBuffer;
-		vks::Buffer indexBuffer;
-		int32_t vertexCount{ 0 };
-		int32_t indexCount{ 0 };
+		// Geometry buffers, there is one set per frame in flight so the overlay can be updated while previous frames are still being rendered
+		struct Geometry {
+			vks::Buffer vertexBuffer;
+			vks::Buffer indexBuffer;
+			int32_t vertexCount{ 0 };
+			int32_t indexCount{ 0 };
+		};
+		std::vector<Geometry> geometry;
+		// Selects the geometry buffers written by update and bound by draw
+		uint32_t currentFrame{ 0 };
 
 		std::vector<VkPipelineShaderStageCreateInfo> shaders;
 
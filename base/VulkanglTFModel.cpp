@@ -18,17 +18,35 @@
 #define TINYGLTF_NO_STB_IMAGE_WRITE
 
 #include "VulkanglTFModel.h"
+#include "threadpool.hpp"
+#include "mappedfile.hpp"
+#include "vertexcache.hpp"
+#include "meshsimplify.hpp"
+#include "lightmapcharts.hpp"
+#include "rectpacker.hpp"
+#include "frustum.hpp"
 #include <cmath>
 #include <algorithm>
+#include <atomic>
+#include <unordered_map>
+#include <chrono>
 
 VkDescriptorSetLayout vkglTF::descriptorSetLayoutImage = VK_NULL_HANDLE;
 VkDescriptorSetLayout vkglTF::descriptorSetLayoutUbo = VK_NULL_HANDLE;
+VkDescriptorSetLayout vkglTF::descriptorSetLayoutInstances = VK_NULL_HANDLE;
 VkMemoryPropertyFlags vkglTF::memoryPropertyFlags = 0;
 uint32_t vkglTF::descriptorBindingFlags = vkglTF::DescriptorBindingFlags::ImageBaseColor;
 bool vkglTF::isCalcLMUV = false;
 
-#define LIGHTMAP_SCALE (1.0/32.0)
-#define LIGHTMAP_PADDING 0.002
+
+/*
+	Encoded images that are stored in the binary chunk of a memory mapped glb file
+	These are passed to the image loading function via its user data, as tinygltf only sees a placeholder for them (see loadBinaryMapped)
+*/
+struct MappedImages {
+	std::vector<const unsigned char*> data;
+	std::vector<size_t> size;
+};
 
 /*
 	We use a custom image loading function with tinyglTF, so we can do custom stuff loading ktx textures
@@ -42,7 +60,16 @@ bool loadImageDataFunc(tinygltf::Image* image, const int imageIndex, std::string
 		}
 	}
 
-	return tinygltf::LoadImageData(image, imageIndex, error, warning, req_width, req_height, bytes, size, userData);
+	const MappedImages* mappedImages = static_cast<const MappedImages*>(userData);
+	if (mappedImages && (static_cast<size_t>(imageIndex) < mappedImages->data.size()) && mappedImages->data[imageIndex]) {
+		bytes = mappedImages->data[imageIndex];
+		size = static_cast<int>(mappedImages->size[imageIndex]);
+	}
+
+	// Only keep the encoded image data, decoding is deferred so that it can be done in parallel (see Model::loadImages)
+	image->image.assign(bytes, bytes + size);
+	image->as_is = true;
+	return true;
 }
 
 bool loadImageDataFuncEmpty(tinygltf::Image* image, const int imageIndex, std::string* error, std::string* warning, int req_width, int req_height, const unsigned char* bytes, int size, void* userData) 
@@ -51,6 +78,336 @@ bool loadImageDataFuncEmpty(tinygltf::Image* image, const int imageIndex, std::s
 	return true;
 }
 
+/*
+	Loads a binary glTF (.glb) file without copying its binary chunk
+	The file is memory mapped and the JSON chunk is rewritten before it's passed to tinygltf, so that the embedded buffer and the images stored in it are replaced by small placeholders
+	Accessors are then read in place from the mapping, which needs to stay open while the model is loaded
+*/
+bool loadBinaryMapped(tinygltf::TinyGLTF& gltfContext, tinygltf::Model& gltfModel, std::string& error, std::string& warning, const std::string& filename, const std::string& baseDir, bool loadImages, vks::MappedFile& file, int& binBuffer, const unsigned char*& binData)
+{
+	const uint32_t glbMagic = 0x46546C67;
+	const uint32_t chunkTypeJSON = 0x4E4F534A;
+	const uint32_t chunkTypeBIN = 0x004E4942;
+	const std::string placeholder = "base64,AAAA";
+
+	binBuffer = -1;
+	binData = nullptr;
+
+	if (!file.open(filename)) {
+		error = "Could not open file";
+		return false;
+	}
+
+	// 12 byte header (magic, version, length) followed by the JSON chunk and an optional binary chunk, each with their length and type
+	uint32_t header[5];
+	if (file.size() < sizeof(header)) {
+		error = "Too short data size for glTF Binary";
+		return false;
+	}
+	memcpy(header, file.data(), sizeof(header));
+	const size_t length = header[2];
+	const size_t jsonLength = header[3];
+	if ((header[0] != glbMagic) || (header[1] != 2) || (length > file.size()) || (header[4] != chunkTypeJSON) || (20 + jsonLength > length)) {
+		error = "Invalid glTF binary";
+		return false;
+	}
+	const char* jsonChunk = reinterpret_cast<const char*>(file.data()) + 20;
+
+	// Chunks are padded to four bytes, so the binary chunk directly follows the JSON chunk
+	size_t binSize = 0;
+	const size_t binOffset = 20 + jsonLength;
+	if (binOffset + 8 <= length) {
+		uint32_t chunkHeader[2];
+		memcpy(chunkHeader, file.data() + binOffset, sizeof(chunkHeader));
+		if ((chunkHeader[1] == chunkTypeBIN) && (binOffset + 8 + chunkHeader[0] <= length)) {
+			binData = file.data() + binOffset + 8;
+			binSize = chunkHeader[0];
+		}
+	}
+
+	nlohmann::json json = nlohmann::json::parse(jsonChunk, jsonChunk + jsonLength, nullptr, false);
+	if (json.is_discarded() || !json.is_object()) {
+		error = "Invalid JSON chunk";
+		return false;
+	}
+
+	// The embedded buffer is the only one without an uri
+	auto buffers = json.find("buffers");
+	if (buffers != json.end() && buffers->is_array()) {
+		for (size_t i = 0; i < buffers->size(); i++) {
+			nlohmann::json& buffer = (*buffers)[i];
+			if (buffer.find("uri") != buffer.end()) {
+				continue;
+			}
+			auto byteLength = buffer.find("byteLength");
+			if (!binData || byteLength == buffer.end() || !byteLength->is_number_unsigned() || (byteLength->get<size_t>() > binSize)) {
+				error = "Invalid binary data in buffer";
+				return false;
+			}
+			buffer["uri"] = "data:application/octet-stream;" + placeholder;
+			buffer["byteLength"] = 3;
+			binBuffer = static_cast<int>(i);
+			break;
+		}
+	}
+
+	// Images stored in the embedded buffer are read from the mapping by the image loading function
+	MappedImages mappedImages;
+	std::vector<std::pair<int, std::string>> imageViews;
+	auto images = json.find("images");
+	auto bufferViews = json.find("bufferViews");
+	if ((binBuffer > -1) && images != json.end() && images->is_array() && bufferViews != json.end() && bufferViews->is_array()) {
+		mappedImages.data.resize(images->size(), nullptr);
+		mappedImages.size.resize(images->size(), 0);
+		imageViews.resize(images->size(), { -1, "" });
+		for (size_t i = 0; i < images->size(); i++) {
+			nlohmann::json& image = (*images)[i];
+			auto bufferViewIndex = image.find("bufferView");
+			if (bufferViewIndex == image.end() || !bufferViewIndex->is_number_integer() || bufferViewIndex->get<size_t>() >= bufferViews->size()) {
+				continue;
+			}
+			const nlohmann::json& bufferView = (*bufferViews)[bufferViewIndex->get<size_t>()];
+			if (bufferView.value("buffer", -1) != binBuffer) {
+				continue;
+			}
+			const size_t byteOffset = bufferView.value("byteOffset", static_cast<size_t>(0));
+			const size_t byteLength = bufferView.value("byteLength", static_cast<size_t>(0));
+			if (byteOffset + byteLength > binSize) {
+				error = "Invalid buffer view for image " + std::to_string(i);
+				return false;
+			}
+			mappedImages.data[i] = binData + byteOffset;
+			mappedImages.size[i] = byteLength;
+			imageViews[i] = { bufferViewIndex->get<int>(), image.value("mimeType", "") };
+			image.erase("bufferView");
+			image.erase("mimeType");
+			image["uri"] = "data:image/png;" + placeholder;
+		}
+	}
+
+	if (loadImages) {
+		gltfContext.SetImageLoader(loadImageDataFunc, &mappedImages);
+	}
+	const std::string jsonString = json.dump();
+	bool loaded = gltfContext.LoadASCIIFromString(&gltfModel, &error, &warning, jsonString.c_str(), static_cast<unsigned int>(jsonString.size()), baseDir);
+	gltfContext.SetImageLoader(loadImageDataFunc, nullptr);
+	if (!loaded) {
+		return false;
+	}
+
+	// Restore what has been replaced by the placeholders
+	if (binBuffer > -1) {
+		gltfModel.buffers[binBuffer].uri.clear();
+		gltfModel.buffers[binBuffer].data.clear();
+	}
+	for (size_t i = 0; i < imageViews.size() && i < gltfModel.images.size(); i++) {
+		if (imageViews[i].first > -1) {
+			gltfModel.images[i].bufferView = imageViews[i].first;
+			gltfModel.images[i].mimeType = imageViews[i].second;
+		}
+	}
+	return true;
+}
+
+// Calls func(index) for every index in [0, count) on a thread pool, threads pick the next index from a shared counter so expensive items don't stall a single thread's queue
+template<typename Func>
+void parallelFor(size_t count, Func func)
+{
+	if (count == 0) {
+		return;
+	}
+	const uint32_t threadCount = static_cast<uint32_t>(std::min(static_cast<size_t>(std::max(std::thread::hardware_concurrency(), 1u)), count));
+	vks::ThreadPool threadPool;
+	threadPool.setThreadCount(threadCount);
+	std::atomic<size_t> next{ 0 };
+	for (uint32_t i = 0; i < threadCount; i++) {
+		threadPool.threads[i]->addJob([&next, count, &func] {
+			size_t index;
+			while ((index = next++) < count) {
+				func(index);
+			}
+		});
+	}
+	threadPool.wait();
+}
+
+// Decodes an image that has been stored in its encoded form (e.g. png or jpg) to RGBA8
+bool decodeImageData(tinygltf::Image& image)
+{
+	int width, height, components;
+	stbi_uc* data = stbi_load_from_memory(image.image.data(), static_cast<int>(image.image.size()), &width, &height, &components, STBI_rgb_alpha);
+	if (!data) {
+		return false;
+	}
+	image.width = width;
+	image.height = height;
+	// Most devices don't support RGB only on Vulkan, so we always request four components from stb
+	image.component = 4;
+	image.bits = 8;
+	image.pixel_type = TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE;
+	image.image.assign(data, data + static_cast<size_t>(width) * height * 4);
+	image.as_is = false;
+	stbi_image_free(data);
+	return true;
+}
+
+/*
+	Texture streaming
+*/
+
+bool isKtxImage(const tinygltf::Image& image)
+{
+	const size_t extension = image.uri.find_last_of(".");
+	return (extension != std::string::npos) && (image.uri.substr(extension + 1) == "ktx");
+}
+
+// Builds the RGBA8 mip chain of an image on the CPU with a 2x2 box filter, odd sizes reuse their last row or column
+std::vector<std::vector<unsigned char>> buildMipChain(const unsigned char* pixels, uint32_t width, uint32_t height)
+{
+	std::vector<std::vector<unsigned char>> levels;
+	levels.emplace_back(pixels, pixels + static_cast<size_t>(width) * height * 4);
+	while ((width > 1) || (height > 1)) {
+		const uint32_t levelWidth = std::max(width / 2, 1u);
+		const uint32_t levelHeight = std::max(height / 2, 1u);
+		const std::vector<unsigned char>& src = levels.back();
+		std::vector<unsigned char> dst(static_cast<size_t>(levelWidth) * levelHeight * 4);
+		for (uint32_t y = 0; y < levelHeight; y++) {
+			const size_t row0 = static_cast<size_t>(std::min(y * 2, height - 1)) * width;
+			const size_t row1 = static_cast<size_t>(std::min(y * 2 + 1, height - 1)) * width;
+			for (uint32_t x = 0; x < levelWidth; x++) {
+				const size_t x0 = std::min(x * 2, width - 1);
+				const size_t x1 = std::min(x * 2 + 1, width - 1);
+				for (size_t c = 0; c < 4; c++) {
+					const uint32_t sum = src[(row0 + x0) * 4 + c] + src[(row0 + x1) * 4 + c] + src[(row1 + x0) * 4 + c] + src[(row1 + x1) * 4 + c];
+					dst[(static_cast<size_t>(y) * levelWidth + x) * 4 + c] = static_cast<unsigned char>((sum + 2) / 4);
+				}
+			}
+		}
+		levels.push_back(std::move(dst));
+		width = levelWidth;
+		height = levelHeight;
+	}
+	return levels;
+}
+
+/*
+	Streaming state of a model's textures
+	Images are decoded and their mip chains are built on a background thread, uploads are done by Model::updateTextureStreaming
+	Only the top levels of a mip chain that are actually needed are resident, so the resident part of a texture is always a complete mip chain of a smaller image
+*/
+struct vkglTF::TextureStreamer {
+	struct Entry {
+		// Encoded image data, or RGBA8 pixels if encoded is false. Released by the background thread once the mip chain has been built
+		std::vector<unsigned char> source;
+		bool encoded = true;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		// Number of levels of the full mip chain, zero for textures that aren't streamed (e.g. ktx files)
+		uint32_t levelCount = 0;
+		// Mip chain built by the background thread, may only be accessed once decoded is set
+		std::vector<std::vector<unsigned char>> levels;
+		bool decodeQueued = false;
+		bool decoded = false;
+		// First resident level, equal to levelCount while only the placeholder is bound
+		uint32_t residentLevel = 0;
+		uint32_t desiredLevel = 0;
+		// Largest screen space diameter in pixels of all visible primitives using the texture
+		float coverage = 0.0f;
+		uint64_t lastVisible = 0;
+		VkDeviceSize memorySize = 0;
+	};
+	// One entry per texture of the model, the list may not be resized once decoding has started
+	std::vector<Entry> entries;
+	uint64_t frame = 0;
+	uint32_t pendingDecodes = 0;
+	VkDeviceSize memoryUsed = 0;
+	uint32_t evictions = 0;
+
+	// Entries whose mip chains have been built since the last update
+	std::mutex decodedMutex;
+	std::vector<uint32_t> decodedEntries;
+
+	// Declared last, so the thread has finished all jobs before the entries are destroyed
+	vks::Thread thread;
+
+	void queueDecode(uint32_t index)
+	{
+		entries[index].decodeQueued = true;
+		pendingDecodes++;
+		thread.addJob([this, index] {
+			Entry& entry = entries[index];
+			std::vector<std::vector<unsigned char>> levels;
+			if (entry.encoded) {
+				int width, height, components;
+				stbi_uc* pixels = stbi_load_from_memory(entry.source.data(), static_cast<int>(entry.source.size()), &width, &height, &components, STBI_rgb_alpha);
+				if (pixels && (static_cast<uint32_t>(width) == entry.width) && (static_cast<uint32_t>(height) == entry.height)) {
+					levels = buildMipChain(pixels, entry.width, entry.height);
+				}
+				stbi_image_free(pixels);
+			} else {
+				levels = buildMipChain(entry.source.data(), entry.width, entry.height);
+			}
+			entry.levels = std::move(levels);
+			std::vector<unsigned char>().swap(entry.source);
+			std::lock_guard<std::mutex> lock(decodedMutex);
+			decodedEntries.push_back(index);
+		});
+	}
+
+	// Size of the mip chain starting at the given level, the actual allocation may be slightly larger
+	VkDeviceSize chainSize(const Entry& entry, uint32_t firstLevel) const
+	{
+		VkDeviceSize size = 0;
+		for (uint32_t level = firstLevel; level < entry.levelCount; level++) {
+			size += static_cast<VkDeviceSize>(std::max(1u, entry.width >> level)) * std::max(1u, entry.height >> level) * 4;
+		}
+		return size;
+	}
+};
+
+/*
+	Staging arena
+*/
+
+vkglTF::StagingArena::~StagingArena()
+{
+	destroy();
+}
+
+vkglTF::StagingArena::Allocation vkglTF::StagingArena::allocate(VkDeviceSize size)
+{
+	// Buffer to image copies require offsets to be a multiple of the texel size (and four), this also covers the optimal alignment
+	const VkDeviceSize alignment = std::max(device->properties.limits.optimalBufferCopyOffsetAlignment, VkDeviceSize(16));
+	for (Block& block : blocks) {
+		const VkDeviceSize offset = (block.offset + alignment - 1) & ~(alignment - 1);
+		if (offset + size <= block.size) {
+			block.offset = offset + size;
+			return { block.buffer, offset, block.mapped + offset };
+		}
+	}
+	Block block{};
+	block.size = std::max(blockSize, size);
+	VK_CHECK_RESULT(device->createBuffer(
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		block.size,
+		&block.buffer,
+		&block.memory));
+	VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, block.memory, 0, VK_WHOLE_SIZE, 0, (void**)&block.mapped));
+	block.offset = size;
+	blocks.push_back(block);
+	return { block.buffer, 0, block.mapped };
+}
+
+void vkglTF::StagingArena::destroy()
+{
+	for (Block& block : blocks) {
+		vkUnmapMemory(device->logicalDevice, block.memory);
+		vkDestroyBuffer(device->logicalDevice, block.buffer, nullptr);
+		vkFreeMemory(device->logicalDevice, block.memory, nullptr);
+	}
+	blocks.clear();
+}
 
 /*
 	glTF texture loading class
@@ -65,7 +422,7 @@ void vkglTF::Texture::updateDescriptor()
 
 void vkglTF::Texture::destroy()
 {
-	if (device)
+	if (device && (image != VK_NULL_HANDLE))
 	{
 		vkDestroyImageView(device->logicalDevice, view, nullptr);
 		vkDestroyImage(device->logicalDevice, image, nullptr);
@@ -75,6 +432,16 @@ void vkglTF::Texture::destroy()
 }
 
 void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path, vks::VulkanDevice *device, VkQueue copyQueue)
+{
+	StagingArena staging(device);
+	// The arena only serves this one image, so don't reserve a full sized block for it
+	staging.blockSize = 0;
+	VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+	fromglTfImage(gltfimage, path, device, copyCmd, staging);
+	device->flushCommandBuffer(copyCmd, copyQueue, true);
+}
+
+void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path, vks::VulkanDevice *device, VkCommandBuffer copyCmd, StagingArena& staging)
 {
 	this->device = device;
 
@@ -90,15 +457,16 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 
 	if (!isKtx) {
 		// Texture was loaded using STB_Image
+		if (gltfimage.as_is && !decodeImageData(gltfimage)) {
+			vks::tools::exitFatal("Could not decode image \"" + gltfimage.uri + "\": " + stbi_failure_reason(), -1);
+		}
 
 		unsigned char* buffer = nullptr;
-		VkDeviceSize bufferSize = 0;
 		bool deleteBuffer = false;
 		if (gltfimage.component == 3) {
 			// Most devices don't support RGB only on Vulkan so convert if necessary
 			// TODO: Check actual format support and transform only if required
-			bufferSize = gltfimage.width * gltfimage.height * 4;
-			buffer = new unsigned char[bufferSize];
+			buffer = new unsigned char[gltfimage.width * gltfimage.height * 4];
 			unsigned char* rgba = buffer;
 			unsigned char* rgb = &gltfimage.image[0];
 			for (size_t i = 0; i < gltfimage.width * gltfimage.height; ++i) {
@@ -112,177 +480,14 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 		}
 		else {
 			buffer = &gltfimage.image[0];
-			bufferSize = gltfimage.image.size();
 		}
 
-		format = VK_FORMAT_R8G8B8A8_UNORM;
-
-		VkFormatProperties formatProperties;
-
-		width = gltfimage.width;
-		height = gltfimage.height;
-		mipLevels = static_cast<uint32_t>(floor(log2(std::max(width, height))) + 1.0);
-
-		vkGetPhysicalDeviceFormatProperties(device->physicalDevice, format, &formatProperties);
-		assert(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_SRC_BIT);
-		assert(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT);
-
-		VkMemoryAllocateInfo memAllocInfo{};
-		memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		VkMemoryRequirements memReqs{};
-
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingMemory;
-
-		VkBufferCreateInfo bufferCreateInfo{};
-		bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-		bufferCreateInfo.size = bufferSize;
-		bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
-		vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
-		memAllocInfo.allocationSize = memReqs.size;
-		memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-		VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
-
-		uint8_t* data;
-		VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void**)&data));
-		memcpy(data, buffer, bufferSize);
-		vkUnmapMemory(device->logicalDevice, stagingMemory);
-
-		VkImageCreateInfo imageCreateInfo{};
-		imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-		imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
-		imageCreateInfo.format = format;
-		imageCreateInfo.mipLevels = mipLevels;
-		imageCreateInfo.arrayLayers = 1;
-		imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-		imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-		imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
-		imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		imageCreateInfo.extent = { width, height, 1 };
-		imageCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-		VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
-		vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
-		memAllocInfo.allocationSize = memReqs.size;
-		memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
-		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
-
-		VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-		VkImageSubresourceRange subresourceRange = {};
-		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		subresourceRange.levelCount = 1;
-		subresourceRange.layerCount = 1;
-
-		VkImageMemoryBarrier imageMemoryBarrier{};
-
-		imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-		imageMemoryBarrier.srcAccessMask = 0;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		imageMemoryBarrier.image = image;
-		imageMemoryBarrier.subresourceRange = subresourceRange;
-		vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-
-		VkBufferImageCopy bufferCopyRegion = {};
-		bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		bufferCopyRegion.imageSubresource.mipLevel = 0;
-		bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
-		bufferCopyRegion.imageSubresource.layerCount = 1;
-		bufferCopyRegion.imageExtent.width = width;
-		bufferCopyRegion.imageExtent.height = height;
-		bufferCopyRegion.imageExtent.depth = 1;
-
-		vkCmdCopyBufferToImage(copyCmd, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion);
-
-		imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-		imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-		imageMemoryBarrier.image = image;
-		imageMemoryBarrier.subresourceRange = subresourceRange;
-  		vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-
-		device->flushCommandBuffer(copyCmd, copyQueue, true);
-
-		vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
-		vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
-
-		// Generate the mip chain (glTF uses jpg and png, so we need to create this manually)
-		VkCommandBuffer blitCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-		for (uint32_t i = 1; i < mipLevels; i++) {
-			VkImageBlit imageBlit{};
-
-			imageBlit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			imageBlit.srcSubresource.layerCount = 1;
-			imageBlit.srcSubresource.mipLevel = i - 1;
-			imageBlit.srcOffsets[1].x = int32_t(width >> (i - 1));
-			imageBlit.srcOffsets[1].y = int32_t(height >> (i - 1));
-			imageBlit.srcOffsets[1].z = 1;
-
-			imageBlit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			imageBlit.dstSubresource.layerCount = 1;
-			imageBlit.dstSubresource.mipLevel = i;
-			imageBlit.dstOffsets[1].x = int32_t(width >> i);
-			imageBlit.dstOffsets[1].y = int32_t(height >> i);
-			imageBlit.dstOffsets[1].z = 1;
-
-			VkImageSubresourceRange mipSubRange = {};
-			mipSubRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			mipSubRange.baseMipLevel = i;
-			mipSubRange.levelCount = 1;
-			mipSubRange.layerCount = 1;
+		fromRGBA8(buffer, static_cast<uint32_t>(gltfimage.width), static_cast<uint32_t>(gltfimage.height), device, copyCmd, staging);
 
-			{
-				VkImageMemoryBarrier imageMemoryBarrier{};
-				imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-				imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-				imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-				imageMemoryBarrier.srcAccessMask = 0;
-				imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-				imageMemoryBarrier.image = image;
-				imageMemoryBarrier.subresourceRange = mipSubRange;
-				vkCmdPipelineBarrier(blitCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-			}
-
-			vkCmdBlitImage(blitCmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageBlit, VK_FILTER_LINEAR);
-
-			{
-				VkImageMemoryBarrier imageMemoryBarrier{};
-				imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-				imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-				imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-				imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-				imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-				imageMemoryBarrier.image = image;
-				imageMemoryBarrier.subresourceRange = mipSubRange;
-				vkCmdPipelineBarrier(blitCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-			}
+		if (deleteBuffer) {
+			delete[] buffer;
 		}
-
-		subresourceRange.levelCount = mipLevels;
-		imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-		imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-		imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-		imageMemoryBarrier.image = image;
-		imageMemoryBarrier.subresourceRange = subresourceRange;
-		vkCmdPipelineBarrier(blitCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-
-        if (deleteBuffer) {
-            delete[] buffer;
-        }
-
-		device->flushCommandBuffer(blitCmd, copyQueue, true);
+		return;
 	}
 	else {
 		// Texture is stored in an external ktx file
@@ -325,29 +530,11 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 		VkFormatProperties formatProperties;
 		vkGetPhysicalDeviceFormatProperties(device->physicalDevice, format, &formatProperties);
 
-		VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingMemory;
-
-		VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo();
-		bufferCreateInfo.size = ktxTextureSize;
-		// This buffer is used as a transfer source for the buffer copy
-		bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
+		StagingArena::Allocation stagingRegion = staging.allocate(ktxTextureSize);
+		memcpy(stagingRegion.mapped, ktxTextureData, ktxTextureSize);
 
 		VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
 		VkMemoryRequirements memReqs;
-		vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
-		memAllocInfo.allocationSize = memReqs.size;
-		memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-		VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
-
-		uint8_t* data;
-		VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void**)&data));
-		memcpy(data, ktxTextureData, ktxTextureSize);
-		vkUnmapMemory(device->logicalDevice, stagingMemory);
 
 		std::vector<VkBufferImageCopy> bufferCopyRegions;
 		for (uint32_t i = 0; i < mipLevels; i++)
@@ -363,7 +550,7 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 			bufferCopyRegion.imageExtent.width = std::max(1u, ktxTexture->baseWidth >> i);
 			bufferCopyRegion.imageExtent.height = std::max(1u, ktxTexture->baseHeight >> i);
 			bufferCopyRegion.imageExtent.depth = 1;
-			bufferCopyRegion.bufferOffset = offset;
+			bufferCopyRegion.bufferOffset = stagingRegion.offset + offset;
 			bufferCopyRegions.push_back(bufferCopyRegion);
 		}
 
@@ -394,17 +581,229 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 		subresourceRange.layerCount = 1;
 
 		vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
-		vkCmdCopyBufferToImage(copyCmd, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(bufferCopyRegions.size()), bufferCopyRegions.data());
+		vkCmdCopyBufferToImage(copyCmd, stagingRegion.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(bufferCopyRegions.size()), bufferCopyRegions.data());
 		vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange);
-		device->flushCommandBuffer(copyCmd, copyQueue);
 		this->imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-		vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
-		vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
-
 		ktxTexture_Destroy(ktxTexture);
 	}
 
+	createSamplerAndView(format);
+}
+
+void vkglTF::Texture::fromRGBA8(const unsigned char* buffer, uint32_t width, uint32_t height, vks::VulkanDevice* device, VkCommandBuffer copyCmd, StagingArena& staging)
+{
+	this->device = device;
+	this->width = width;
+	this->height = height;
+	const VkDeviceSize bufferSize = static_cast<VkDeviceSize>(width) * height * 4;
+	const VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+
+	VkFormatProperties formatProperties;
+
+	mipLevels = static_cast<uint32_t>(floor(log2(std::max(width, height))) + 1.0);
+
+	vkGetPhysicalDeviceFormatProperties(device->physicalDevice, format, &formatProperties);
+	assert(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_SRC_BIT);
+	assert(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT);
+
+	VkMemoryAllocateInfo memAllocInfo{};
+	memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	VkMemoryRequirements memReqs{};
+
+	StagingArena::Allocation stagingRegion = staging.allocate(bufferSize);
+	memcpy(stagingRegion.mapped, buffer, bufferSize);
+
+	VkImageCreateInfo imageCreateInfo{};
+	imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageCreateInfo.format = format;
+	imageCreateInfo.mipLevels = mipLevels;
+	imageCreateInfo.arrayLayers = 1;
+	imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageCreateInfo.extent = { width, height, 1 };
+	imageCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
+	vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
+	memAllocInfo.allocationSize = memReqs.size;
+	memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
+	VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
+
+	VkImageSubresourceRange subresourceRange = {};
+	subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	subresourceRange.levelCount = 1;
+	subresourceRange.layerCount = 1;
+
+	VkImageMemoryBarrier imageMemoryBarrier{};
+
+	imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	imageMemoryBarrier.srcAccessMask = 0;
+	imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	imageMemoryBarrier.image = image;
+	imageMemoryBarrier.subresourceRange = subresourceRange;
+	vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+
+	VkBufferImageCopy bufferCopyRegion = {};
+	bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	bufferCopyRegion.imageSubresource.mipLevel = 0;
+	bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
+	bufferCopyRegion.imageSubresource.layerCount = 1;
+	bufferCopyRegion.imageExtent.width = width;
+	bufferCopyRegion.imageExtent.height = height;
+	bufferCopyRegion.imageExtent.depth = 1;
+	bufferCopyRegion.bufferOffset = stagingRegion.offset;
+
+	vkCmdCopyBufferToImage(copyCmd, stagingRegion.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion);
+
+	imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	imageMemoryBarrier.image = image;
+	imageMemoryBarrier.subresourceRange = subresourceRange;
+  		vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+
+	// Generate the mip chain (glTF uses jpg and png, so we need to create this manually)
+	for (uint32_t i = 1; i < mipLevels; i++) {
+		VkImageBlit imageBlit{};
+
+		imageBlit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		imageBlit.srcSubresource.layerCount = 1;
+		imageBlit.srcSubresource.mipLevel = i - 1;
+		imageBlit.srcOffsets[1].x = int32_t(width >> (i - 1));
+		imageBlit.srcOffsets[1].y = int32_t(height >> (i - 1));
+		imageBlit.srcOffsets[1].z = 1;
+
+		imageBlit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		imageBlit.dstSubresource.layerCount = 1;
+		imageBlit.dstSubresource.mipLevel = i;
+		imageBlit.dstOffsets[1].x = int32_t(width >> i);
+		imageBlit.dstOffsets[1].y = int32_t(height >> i);
+		imageBlit.dstOffsets[1].z = 1;
+
+		VkImageSubresourceRange mipSubRange = {};
+		mipSubRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		mipSubRange.baseMipLevel = i;
+		mipSubRange.levelCount = 1;
+		mipSubRange.layerCount = 1;
+
+		{
+			VkImageMemoryBarrier imageMemoryBarrier{};
+			imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			imageMemoryBarrier.srcAccessMask = 0;
+			imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			imageMemoryBarrier.image = image;
+			imageMemoryBarrier.subresourceRange = mipSubRange;
+			vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+		}
+
+		vkCmdBlitImage(copyCmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageBlit, VK_FILTER_LINEAR);
+
+		{
+			VkImageMemoryBarrier imageMemoryBarrier{};
+			imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			imageMemoryBarrier.image = image;
+			imageMemoryBarrier.subresourceRange = mipSubRange;
+			vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+		}
+	}
+
+	subresourceRange.levelCount = mipLevels;
+	imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	imageMemoryBarrier.image = image;
+	imageMemoryBarrier.subresourceRange = subresourceRange;
+	vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+
+	createSamplerAndView(format);
+}
+
+void vkglTF::Texture::fromRGBA8Levels(const std::vector<const unsigned char*>& levels, uint32_t width, uint32_t height, vks::VulkanDevice* device, VkCommandBuffer copyCmd, StagingArena& staging)
+{
+	this->device = device;
+	this->width = width;
+	this->height = height;
+	mipLevels = static_cast<uint32_t>(levels.size());
+	const VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+
+	// All levels are staged in a single allocation
+	VkDeviceSize bufferSize = 0;
+	for (uint32_t i = 0; i < mipLevels; i++) {
+		bufferSize += static_cast<VkDeviceSize>(std::max(1u, width >> i)) * std::max(1u, height >> i) * 4;
+	}
+	StagingArena::Allocation stagingRegion = staging.allocate(bufferSize);
+	std::vector<VkBufferImageCopy> bufferCopyRegions;
+	VkDeviceSize offset = 0;
+	for (uint32_t i = 0; i < mipLevels; i++) {
+		const uint32_t levelWidth = std::max(1u, width >> i);
+		const uint32_t levelHeight = std::max(1u, height >> i);
+		const VkDeviceSize levelSize = static_cast<VkDeviceSize>(levelWidth) * levelHeight * 4;
+		memcpy(static_cast<unsigned char*>(stagingRegion.mapped) + offset, levels[i], static_cast<size_t>(levelSize));
+		VkBufferImageCopy bufferCopyRegion = {};
+		bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		bufferCopyRegion.imageSubresource.mipLevel = i;
+		bufferCopyRegion.imageSubresource.layerCount = 1;
+		bufferCopyRegion.imageExtent = { levelWidth, levelHeight, 1 };
+		bufferCopyRegion.bufferOffset = stagingRegion.offset + offset;
+		bufferCopyRegions.push_back(bufferCopyRegion);
+		offset += levelSize;
+	}
+
+	VkImageCreateInfo imageCreateInfo = vks::initializers::imageCreateInfo();
+	imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageCreateInfo.format = format;
+	imageCreateInfo.mipLevels = mipLevels;
+	imageCreateInfo.arrayLayers = 1;
+	imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageCreateInfo.extent = { width, height, 1 };
+	imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
+
+	VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
+	VkMemoryRequirements memReqs;
+	vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
+	memAllocInfo.allocationSize = memReqs.size;
+	memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
+	VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
+
+	VkImageSubresourceRange subresourceRange = {};
+	subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	subresourceRange.levelCount = mipLevels;
+	subresourceRange.layerCount = 1;
+
+	vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
+	vkCmdCopyBufferToImage(copyCmd, stagingRegion.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(bufferCopyRegions.size()), bufferCopyRegions.data());
+	vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange);
+	imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	createSamplerAndView(format);
+}
+
+void vkglTF::Texture::createSamplerAndView(VkFormat format)
+{
 	VkSamplerCreateInfo samplerInfo{};
 	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
 	samplerInfo.magFilter = VK_FILTER_LINEAR;
@@ -448,10 +847,13 @@ void vkglTF::Material::createDescriptorSet(VkDescriptorPool descriptorPool, VkDe
 	descriptorSetAllocInfo.pSetLayouts = &descriptorSetLayout;
 	descriptorSetAllocInfo.descriptorSetCount = 1;
 	VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &descriptorSetAllocInfo, &descriptorSet));
-	std::vector<VkDescriptorImageInfo> imageDescriptors{};
+	updateDescriptorSet(descriptorBindingFlags);
+}
+
+void vkglTF::Material::updateDescriptorSet(uint32_t descriptorBindingFlags)
+{
 	std::vector<VkWriteDescriptorSet> writeDescriptorSets{};
 	if (descriptorBindingFlags & DescriptorBindingFlags::ImageBaseColor) {
-		imageDescriptors.push_back(baseColorTexture->descriptor);
 		VkWriteDescriptorSet writeDescriptorSet{};
 		writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 		writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
@@ -462,7 +864,6 @@ void vkglTF::Material::createDescriptorSet(VkDescriptorPool descriptorPool, VkDe
 		writeDescriptorSets.push_back(writeDescriptorSet);
 	}
 	if (normalTexture && descriptorBindingFlags & DescriptorBindingFlags::ImageNormalMap) {
-		imageDescriptors.push_back(normalTexture->descriptor);
 		VkWriteDescriptorSet writeDescriptorSet{};
 		writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 		writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
@@ -490,23 +891,11 @@ void vkglTF::Primitive::setDimensions(glm::vec3 min, glm::vec3 max) {
 /*
 	glTF mesh
 */
-vkglTF::Mesh::Mesh(vks::VulkanDevice *device, glm::mat4 matrix) {
+vkglTF::Mesh::Mesh(vks::VulkanDevice *device) {
 	this->device = device;
-	this->uniformBlock.matrix = matrix;
-	VK_CHECK_RESULT(device->createBuffer(
-		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		sizeof(uniformBlock),
-		&uniformBuffer.buffer,
-		&uniformBuffer.memory,
-		&uniformBlock));
-	VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, uniformBuffer.memory, 0, sizeof(uniformBlock), 0, &uniformBuffer.mapped));
-	uniformBuffer.descriptor = { uniformBuffer.buffer, 0, sizeof(uniformBlock) };
 };
 
 vkglTF::Mesh::~Mesh() {
-	vkDestroyBuffer(device->logicalDevice, uniformBuffer.buffer, nullptr);
-	vkFreeMemory(device->logicalDevice, uniformBuffer.memory, nullptr);
     for(auto primitive : primitives)
     {
         delete primitive;
@@ -530,23 +919,19 @@ glm::mat4 vkglTF::Node::getMatrix() {
 	return m;
 }
 
+// Uses the cached world matrices, so Model::updateNodeMatrices needs to be called before this
 void vkglTF::Node::update() {
 	if (mesh) {
-		glm::mat4 m = getMatrix();
+		const glm::mat4& m = worldMatrix;
+		memcpy(mesh->uniformBuffer.mapped, &m, sizeof(glm::mat4));
 		if (skin) {
-			mesh->uniformBlock.matrix = m;
-			// Update join matrices
+			// Update joint matrices, these are stored directly after the mesh's NodeUniformBlock
+			glm::mat4* jointMatrices = reinterpret_cast<glm::mat4*>(static_cast<char*>(mesh->uniformBuffer.mapped) + sizeof(NodeUniformBlock));
 			glm::mat4 inverseTransform = glm::inverse(m);
-			for (size_t i = 0; i < skin->joints.size(); i++) {
+			for (size_t i = 0; i < mesh->jointCount; i++) {
 				vkglTF::Node *jointNode = skin->joints[i];
-				glm::mat4 jointMat = jointNode->getMatrix() * skin->inverseBindMatrices[i];
-				jointMat = inverseTransform * jointMat;
-				mesh->uniformBlock.jointMatrix[i] = jointMat;
+				jointMatrices[i] = inverseTransform * jointNode->worldMatrix * skin->inverseBindMatrices[i];
 			}
-			mesh->uniformBlock.jointcount = (float)skin->joints.size();
-			memcpy(mesh->uniformBuffer.mapped, &mesh->uniformBlock, sizeof(mesh->uniformBlock));
-		} else {
-			memcpy(mesh->uniformBuffer.mapped, &m, sizeof(glm::mat4));
 		}
 	}
 
@@ -565,14 +950,39 @@ vkglTF::Node::~Node() {
 }
 
 /*
-	glTF default vertex layout with easy Vulkan mapping functions
+	glTF animation sampler
 */
-
-VkVertexInputBindingDescription vkglTF::Vertex::vertexInputBindingDescription;
-std::vector<VkVertexInputAttributeDescription> vkglTF::Vertex::vertexInputAttributeDescriptions;
-VkPipelineVertexInputStateCreateInfo vkglTF::Vertex::pipelineVertexInputStateCreateInfo;
-
-VkVertexInputBindingDescription vkglTF::Vertex::inputBindingDescription(uint32_t binding) {
+bool vkglTF::AnimationSampler::findInterval(float time, uint32_t& keyframe) const
+{
+	const size_t count = inputs.size();
+	if ((count < 2) || (time < inputs.front()) || (time > inputs.back())) {
+		return false;
+	}
+	// Regular playback stays in the current interval or advances to the next one
+	if ((keyframe + 1 < count) && (time >= inputs[keyframe])) {
+		if (time <= inputs[keyframe + 1]) {
+			return true;
+		}
+		if ((keyframe + 2 < count) && (time <= inputs[keyframe + 2])) {
+			keyframe++;
+			return true;
+		}
+	}
+	// Seeking (or looping back to the start) does a binary search for the interval instead
+	const size_t upper = std::upper_bound(inputs.begin(), inputs.end(), time) - inputs.begin();
+	keyframe = static_cast<uint32_t>(std::min(std::max(upper, size_t(1)), count - 1) - 1);
+	return true;
+}
+
+/*
+	glTF default vertex layout with easy Vulkan mapping functions
+*/
+
+VkVertexInputBindingDescription vkglTF::Vertex::vertexInputBindingDescription;
+std::vector<VkVertexInputAttributeDescription> vkglTF::Vertex::vertexInputAttributeDescriptions;
+VkPipelineVertexInputStateCreateInfo vkglTF::Vertex::pipelineVertexInputStateCreateInfo;
+
+VkVertexInputBindingDescription vkglTF::Vertex::inputBindingDescription(uint32_t binding) {
 	return VkVertexInputBindingDescription({ binding, sizeof(Vertex), VK_VERTEX_INPUT_RATE_VERTEX });
 }
 
@@ -609,10 +1019,135 @@ std::vector<VkVertexInputAttributeDescription> vkglTF::Vertex::inputAttributeDes
 	return result;
 }
 
+/*
+	Packed vertex layout
+	Only the requested components are stored, tightly packed in the order they're requested:
+	Position: R32G32B32_SFLOAT
+	Normal: R16G16_SNORM, octahedral encoding
+	UV, UV2: R16G16_SFLOAT
+	Color: R8G8B8A8_UNORM
+	Tangent: R16G16B16A16_SNORM
+	Joint0: R8G8B8A8_UINT
+	Weight0: R16G16B16A16_UNORM
+	Shaders using this layout need to decode the normal and read the joint indices as unsigned integers
+*/
+
+VkFormat packedFormat(vkglTF::VertexComponent component)
+{
+	switch (component) {
+		case vkglTF::VertexComponent::Position:
+			return VK_FORMAT_R32G32B32_SFLOAT;
+		case vkglTF::VertexComponent::Normal:
+			return VK_FORMAT_R16G16_SNORM;
+		case vkglTF::VertexComponent::UV:
+		case vkglTF::VertexComponent::UV2:
+			return VK_FORMAT_R16G16_SFLOAT;
+		case vkglTF::VertexComponent::Color:
+			return VK_FORMAT_R8G8B8A8_UNORM;
+		case vkglTF::VertexComponent::Tangent:
+			return VK_FORMAT_R16G16B16A16_SNORM;
+		case vkglTF::VertexComponent::Joint0:
+			return VK_FORMAT_R8G8B8A8_UINT;
+		case vkglTF::VertexComponent::Weight0:
+			return VK_FORMAT_R16G16B16A16_UNORM;
+		default:
+			return VK_FORMAT_UNDEFINED;
+	}
+}
+
+uint32_t packedSize(vkglTF::VertexComponent component)
+{
+	switch (component) {
+		case vkglTF::VertexComponent::Position:
+			return 12;
+		case vkglTF::VertexComponent::Tangent:
+		case vkglTF::VertexComponent::Weight0:
+			return 8;
+		default:
+			return 4;
+	}
+}
+
+// Maps a unit vector onto the octahedron and unfolds its lower half, so that it can be stored as two components
+glm::vec2 octahedralEncode(glm::vec3 n)
+{
+	float sum = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+	if (sum == 0.0f) {
+		return glm::vec2(0.0f);
+	}
+	n /= sum;
+	glm::vec2 p(n.x, n.y);
+	if (n.z < 0.0f) {
+		p.x = (1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+		p.y = (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+	}
+	return p;
+}
+
+uint32_t vkglTF::Vertex::packedStride(const std::vector<VertexComponent>& components)
+{
+	uint32_t stride = 0;
+	for (VertexComponent component : components) {
+		stride += packedSize(component);
+	}
+	return stride;
+}
+
+void vkglTF::Vertex::pack(const Vertex& vertex, const std::vector<VertexComponent>& components, uint8_t* dst)
+{
+	for (VertexComponent component : components) {
+		uint32_t packed[3];
+		switch (component) {
+			case VertexComponent::Position:
+				memcpy(packed, &vertex.pos, sizeof(glm::vec3));
+				break;
+			case VertexComponent::Normal:
+				packed[0] = glm::packSnorm2x16(octahedralEncode(vertex.normal));
+				break;
+			case VertexComponent::UV:
+				packed[0] = glm::packHalf2x16(vertex.uv);
+				break;
+			case VertexComponent::UV2:
+				packed[0] = glm::packHalf2x16(glm::vec2(vertex.uv2));
+				break;
+			case VertexComponent::Color:
+				packed[0] = glm::packUnorm4x8(vertex.color);
+				break;
+			case VertexComponent::Tangent:
+				packed[0] = glm::packSnorm2x16(glm::vec2(vertex.tangent.x, vertex.tangent.y));
+				packed[1] = glm::packSnorm2x16(glm::vec2(vertex.tangent.z, vertex.tangent.w));
+				break;
+			case VertexComponent::Joint0:
+				if (glm::any(glm::greaterThan(vertex.joint0, glm::vec4(255.0f)))) {
+					vks::tools::exitFatal("Joint indices above 255 can't be stored in a packed vertex", -1);
+				}
+				packed[0] = uint32_t(vertex.joint0.x) | (uint32_t(vertex.joint0.y) << 8) | (uint32_t(vertex.joint0.z) << 16) | (uint32_t(vertex.joint0.w) << 24);
+				break;
+			case VertexComponent::Weight0:
+				packed[0] = glm::packUnorm2x16(glm::vec2(vertex.weight0.x, vertex.weight0.y));
+				packed[1] = glm::packUnorm2x16(glm::vec2(vertex.weight0.z, vertex.weight0.w));
+				break;
+		}
+		const uint32_t size = packedSize(component);
+		memcpy(dst, packed, size);
+		dst += size;
+	}
+}
+
 /** @brief Returns the default pipeline vertex input state create info structure for the requested vertex components */
-VkPipelineVertexInputStateCreateInfo* vkglTF::Vertex::getPipelineVertexInputState(const std::vector<VertexComponent> components) {
-	vertexInputBindingDescription = Vertex::inputBindingDescription(0);
-	Vertex::vertexInputAttributeDescriptions = Vertex::inputAttributeDescriptions(0, components);
+VkPipelineVertexInputStateCreateInfo* vkglTF::Vertex::getPipelineVertexInputState(const std::vector<VertexComponent> components, bool packed) {
+	if (packed) {
+		vertexInputBindingDescription = VkVertexInputBindingDescription({ 0, Vertex::packedStride(components), VK_VERTEX_INPUT_RATE_VERTEX });
+		Vertex::vertexInputAttributeDescriptions.clear();
+		uint32_t offset = 0;
+		for (uint32_t location = 0; location < static_cast<uint32_t>(components.size()); location++) {
+			Vertex::vertexInputAttributeDescriptions.push_back({ location, 0, packedFormat(components[location]), offset });
+			offset += packedSize(components[location]);
+		}
+	} else {
+		vertexInputBindingDescription = Vertex::inputBindingDescription(0);
+		Vertex::vertexInputAttributeDescriptions = Vertex::inputAttributeDescriptions(0, components);
+	}
 	pipelineVertexInputStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 	pipelineVertexInputStateCreateInfo.vertexBindingDescriptionCount = 1;
 	pipelineVertexInputStateCreateInfo.pVertexBindingDescriptions = &Vertex::vertexInputBindingDescription;
@@ -630,7 +1165,7 @@ vkglTF::Texture* vkglTF::Model::getTexture(uint32_t index)
 	return nullptr;
 }
 
-void vkglTF::Model::createEmptyTexture(VkQueue transferQueue)
+void vkglTF::Model::createEmptyTexture(VkCommandBuffer copyCmd, StagingArena& staging)
 {
 	emptyTexture.device = device;
 	emptyTexture.width = 1;
@@ -638,32 +1173,13 @@ void vkglTF::Model::createEmptyTexture(VkQueue transferQueue)
 	emptyTexture.layerCount = 1;
 	emptyTexture.mipLevels = 1;
 
+	// Copy texture data into staging buffer
 	size_t bufferSize = emptyTexture.width * emptyTexture.height * 4;
-	unsigned char* buffer = new unsigned char[bufferSize];
-	memset(buffer, 0, bufferSize);
-
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingMemory;
-	VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo();
-	bufferCreateInfo.size = bufferSize;
-	// This buffer is used as a transfer source for the buffer copy
-	bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-	bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-	VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
+	StagingArena::Allocation stagingRegion = staging.allocate(bufferSize);
+	memset(stagingRegion.mapped, 0, bufferSize);
 
 	VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
 	VkMemoryRequirements memReqs;
-	vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
-	memAllocInfo.allocationSize = memReqs.size;
-	memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-	VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-	VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
-
-	// Copy texture data into staging buffer
-	uint8_t* data;
-	VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void**)&data));
-	memcpy(data, buffer, bufferSize);
-	vkUnmapMemory(device->logicalDevice, stagingMemory);
 
 	VkBufferImageCopy bufferCopyRegion = {};
 	bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -671,6 +1187,7 @@ void vkglTF::Model::createEmptyTexture(VkQueue transferQueue)
 	bufferCopyRegion.imageExtent.width = emptyTexture.width;
 	bufferCopyRegion.imageExtent.height = emptyTexture.height;
 	bufferCopyRegion.imageExtent.depth = 1;
+	bufferCopyRegion.bufferOffset = stagingRegion.offset;
 
 	// Create optimal tiled target image
 	VkImageCreateInfo imageCreateInfo = vks::initializers::imageCreateInfo();
@@ -698,17 +1215,11 @@ void vkglTF::Model::createEmptyTexture(VkQueue transferQueue)
 	subresourceRange.levelCount = 1;
 	subresourceRange.layerCount = 1;
 
-	VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
 	vks::tools::setImageLayout(copyCmd, emptyTexture.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
-	vkCmdCopyBufferToImage(copyCmd, stagingBuffer, emptyTexture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion);
+	vkCmdCopyBufferToImage(copyCmd, stagingRegion.buffer, emptyTexture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion);
 	vks::tools::setImageLayout(copyCmd, emptyTexture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange);
-	device->flushCommandBuffer(copyCmd, transferQueue);
 	emptyTexture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-	// Clean up staging resources
-	vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
-	vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
-
 	VkSamplerCreateInfo samplerCreateInfo = vks::initializers::samplerCreateInfo();
 	samplerCreateInfo.magFilter = VK_FILTER_LINEAR;
 	samplerCreateInfo.minFilter = VK_FILTER_LINEAR;
@@ -738,10 +1249,40 @@ void vkglTF::Model::createEmptyTexture(VkQueue transferQueue)
 */
 vkglTF::Model::~Model()
 {
+	// Waits for pending decodes
+	delete textureStreamer;
+	if (!device) {
+		// Models used for offline lightmap baking only own CPU side data
+		for (auto node : nodes) {
+			delete node;
+		}
+		for (auto skin : skins) {
+			delete skin;
+		}
+		return;
+	}
+	if (computeSkinning.pipeline != VK_NULL_HANDLE) {
+		vkDestroyPipeline(device->logicalDevice, computeSkinning.pipeline, nullptr);
+		vkDestroyPipelineLayout(device->logicalDevice, computeSkinning.pipelineLayout, nullptr);
+		vkDestroyDescriptorPool(device->logicalDevice, computeSkinning.descriptorPool, nullptr);
+		vkDestroyDescriptorSetLayout(device->logicalDevice, computeSkinning.descriptorSetLayout, nullptr);
+		for (auto& frame : computeSkinning.frames) {
+			vkDestroyBuffer(device->logicalDevice, frame.buffer, nullptr);
+			vkFreeMemory(device->logicalDevice, frame.memory, nullptr);
+			frame.joints.destroy();
+		}
+	}
 	vkDestroyBuffer(device->logicalDevice, vertices.buffer, nullptr);
 	vkFreeMemory(device->logicalDevice, vertices.memory, nullptr);
 	vkDestroyBuffer(device->logicalDevice, indices.buffer, nullptr);
 	vkFreeMemory(device->logicalDevice, indices.memory, nullptr);
+	nodeBuffer.destroy();
+	for (StorageBuffer* storageBuffer : { &meshletBuffers.meshlets, &meshletBuffers.bounds, &meshletBuffers.vertices, &meshletBuffers.triangles }) {
+		if (storageBuffer->buffer != VK_NULL_HANDLE) {
+			vkDestroyBuffer(device->logicalDevice, storageBuffer->buffer, nullptr);
+			vkFreeMemory(device->logicalDevice, storageBuffer->memory, nullptr);
+		}
+	}
 	for (auto texture : textures) {
 		texture.destroy();
 	}
@@ -759,6 +1300,10 @@ vkglTF::Model::~Model()
 		vkDestroyDescriptorSetLayout(device->logicalDevice, descriptorSetLayoutImage, nullptr);
 		descriptorSetLayoutImage = VK_NULL_HANDLE;
 	}
+	if (descriptorSetLayoutInstances != VK_NULL_HANDLE) {
+		vkDestroyDescriptorSetLayout(device->logicalDevice, descriptorSetLayoutInstances, nullptr);
+		descriptorSetLayoutInstances = VK_NULL_HANDLE;
+	}
 	vkDestroyDescriptorPool(device->logicalDevice, descriptorPool, nullptr);
 	emptyTexture.destroy();
 }
@@ -805,8 +1350,9 @@ void vkglTF::Model::loadNode(vkglTF::Node *parent, const tinygltf::Node &node, u
 	// Node contains mesh data
 	if (node.mesh > -1) {
 		const tinygltf::Mesh mesh = model.meshes[node.mesh];
-		Mesh *newMesh = new Mesh(device, newNode->matrix);
+		Mesh *newMesh = new Mesh(device);
 		newMesh->name = mesh.name;
+		newMesh->index = static_cast<uint32_t>(node.mesh);
 		for (size_t j = 0; j < mesh.primitives.size(); j++) {
 			const tinygltf::Primitive &primitive = mesh.primitives[j];
 			if (primitive.indices < 0) {
@@ -836,26 +1382,26 @@ void vkglTF::Model::loadNode(vkglTF::Node *parent, const tinygltf::Node &node, u
 
 				const tinygltf::Accessor &posAccessor = model.accessors[primitive.attributes.find("POSITION")->second];
 				const tinygltf::BufferView &posView = model.bufferViews[posAccessor.bufferView];
-				bufferPos = reinterpret_cast<const float *>(&(model.buffers[posView.buffer].data[posAccessor.byteOffset + posView.byteOffset]));
+				bufferPos = reinterpret_cast<const float *>(&bufferData[posView.buffer][posAccessor.byteOffset + posView.byteOffset]);
 				posMin = glm::vec3(posAccessor.minValues[0], posAccessor.minValues[1], posAccessor.minValues[2]);
 				posMax = glm::vec3(posAccessor.maxValues[0], posAccessor.maxValues[1], posAccessor.maxValues[2]);
 
 				if (primitive.attributes.find("NORMAL") != primitive.attributes.end()) {
 					const tinygltf::Accessor &normAccessor = model.accessors[primitive.attributes.find("NORMAL")->second];
 					const tinygltf::BufferView &normView = model.bufferViews[normAccessor.bufferView];
-					bufferNormals = reinterpret_cast<const float *>(&(model.buffers[normView.buffer].data[normAccessor.byteOffset + normView.byteOffset]));
+					bufferNormals = reinterpret_cast<const float *>(&bufferData[normView.buffer][normAccessor.byteOffset + normView.byteOffset]);
 				}
 
 				if (primitive.attributes.find("TEXCOORD_0") != primitive.attributes.end()) {
 					const tinygltf::Accessor &uvAccessor = model.accessors[primitive.attributes.find("TEXCOORD_0")->second];
 					const tinygltf::BufferView &uvView = model.bufferViews[uvAccessor.bufferView];
-					bufferTexCoords = reinterpret_cast<const float *>(&(model.buffers[uvView.buffer].data[uvAccessor.byteOffset + uvView.byteOffset]));
+					bufferTexCoords = reinterpret_cast<const float *>(&bufferData[uvView.buffer][uvAccessor.byteOffset + uvView.byteOffset]);
 				}
 
 				if (primitive.attributes.find("TEXCOORD_1") != primitive.attributes.end()) {
 					const tinygltf::Accessor& uvAccessor = model.accessors[primitive.attributes.find("TEXCOORD_1")->second];
 					const tinygltf::BufferView& uvView = model.bufferViews[uvAccessor.bufferView];
-					bufferTexCoords2 = reinterpret_cast<const float*>(&(model.buffers[uvView.buffer].data[uvAccessor.byteOffset + uvView.byteOffset]));
+					bufferTexCoords2 = reinterpret_cast<const float*>(&bufferData[uvView.buffer][uvAccessor.byteOffset + uvView.byteOffset]);
 				}
 
 				if (primitive.attributes.find("COLOR_0") != primitive.attributes.end())
@@ -864,14 +1410,14 @@ void vkglTF::Model::loadNode(vkglTF::Node *parent, const tinygltf::Node &node, u
 					const tinygltf::BufferView& colorView = model.bufferViews[colorAccessor.bufferView];
 					// Color buffer are either of type vec3 or vec4
 					numColorComponents = colorAccessor.type == TINYGLTF_PARAMETER_TYPE_FLOAT_VEC3 ? 3 : 4;
-					bufferColors = reinterpret_cast<const float*>(&(model.buffers[colorView.buffer].data[colorAccessor.byteOffset + colorView.byteOffset]));
+					bufferColors = reinterpret_cast<const float*>(&bufferData[colorView.buffer][colorAccessor.byteOffset + colorView.byteOffset]);
 				}
 
 				if (primitive.attributes.find("TANGENT") != primitive.attributes.end())
 				{
 					const tinygltf::Accessor &tangentAccessor = model.accessors[primitive.attributes.find("TANGENT")->second];
 					const tinygltf::BufferView &tangentView = model.bufferViews[tangentAccessor.bufferView];
-					bufferTangents = reinterpret_cast<const float *>(&(model.buffers[tangentView.buffer].data[tangentAccessor.byteOffset + tangentView.byteOffset]));
+					bufferTangents = reinterpret_cast<const float *>(&bufferData[tangentView.buffer][tangentAccessor.byteOffset + tangentView.byteOffset]);
 				}
 
 				// Skinning
@@ -879,13 +1425,13 @@ void vkglTF::Model::loadNode(vkglTF::Node *parent, const tinygltf::Node &node, u
 				if (primitive.attributes.find("JOINTS_0") != primitive.attributes.end()) {
 					const tinygltf::Accessor &jointAccessor = model.accessors[primitive.attributes.find("JOINTS_0")->second];
 					const tinygltf::BufferView &jointView = model.bufferViews[jointAccessor.bufferView];
-					bufferJoints = reinterpret_cast<const uint16_t *>(&(model.buffers[jointView.buffer].data[jointAccessor.byteOffset + jointView.byteOffset]));
+					bufferJoints = reinterpret_cast<const uint16_t *>(&bufferData[jointView.buffer][jointAccessor.byteOffset + jointView.byteOffset]);
 				}
 
 				if (primitive.attributes.find("WEIGHTS_0") != primitive.attributes.end()) {
 					const tinygltf::Accessor &uvAccessor = model.accessors[primitive.attributes.find("WEIGHTS_0")->second];
 					const tinygltf::BufferView &uvView = model.bufferViews[uvAccessor.bufferView];
-					bufferWeights = reinterpret_cast<const float *>(&(model.buffers[uvView.buffer].data[uvAccessor.byteOffset + uvView.byteOffset]));
+					bufferWeights = reinterpret_cast<const float *>(&bufferData[uvView.buffer][uvAccessor.byteOffset + uvView.byteOffset]);
 				}
 
 				hasSkin = (bufferJoints && bufferWeights);
@@ -919,14 +1465,14 @@ void vkglTF::Model::loadNode(vkglTF::Node *parent, const tinygltf::Node &node, u
 			{
 				const tinygltf::Accessor &accessor = model.accessors[primitive.indices];
 				const tinygltf::BufferView &bufferView = model.bufferViews[accessor.bufferView];
-				const tinygltf::Buffer &buffer = model.buffers[bufferView.buffer];
+				const unsigned char* buffer = bufferData[bufferView.buffer];
 
 				indexCount = static_cast<uint32_t>(accessor.count);
 
 				switch (accessor.componentType) {
 				case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT: {
 					uint32_t *buf = new uint32_t[accessor.count];
-					memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(uint32_t));
+					memcpy(buf, &buffer[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(uint32_t));
 					for (size_t index = 0; index < accessor.count; index++) {
 						indexBuffer.push_back(buf[index] + vertexStart);
 					}
@@ -935,7 +1481,7 @@ void vkglTF::Model::loadNode(vkglTF::Node *parent, const tinygltf::Node &node, u
 				}
 				case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT: {
 					uint16_t *buf = new uint16_t[accessor.count];
-					memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(uint16_t));
+					memcpy(buf, &buffer[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(uint16_t));
 					for (size_t index = 0; index < accessor.count; index++) {
 						indexBuffer.push_back(buf[index] + vertexStart);
 					}
@@ -944,7 +1490,7 @@ void vkglTF::Model::loadNode(vkglTF::Node *parent, const tinygltf::Node &node, u
 				}
 				case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE: {
 					uint8_t *buf = new uint8_t[accessor.count];
-					memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(uint8_t));
+					memcpy(buf, &buffer[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(uint8_t));
 					for (size_t index = 0; index < accessor.count; index++) {
 						indexBuffer.push_back(buf[index] + vertexStart);
 					}
@@ -995,25 +1541,290 @@ void vkglTF::Model::loadSkins(tinygltf::Model &gltfModel)
 		if (source.inverseBindMatrices > -1) {
 			const tinygltf::Accessor &accessor = gltfModel.accessors[source.inverseBindMatrices];
 			const tinygltf::BufferView &bufferView = gltfModel.bufferViews[accessor.bufferView];
-			const tinygltf::Buffer &buffer = gltfModel.buffers[bufferView.buffer];
+			const unsigned char* buffer = bufferData[bufferView.buffer];
 			newSkin->inverseBindMatrices.resize(accessor.count);
-			memcpy(newSkin->inverseBindMatrices.data(), &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(glm::mat4));
+			memcpy(newSkin->inverseBindMatrices.data(), &buffer[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(glm::mat4));
 		}
 
 		skins.push_back(newSkin);
 	}
 }
 
-void vkglTF::Model::loadImages(tinygltf::Model &gltfModel, vks::VulkanDevice *device, VkQueue transferQueue)
+void vkglTF::Model::loadImages(tinygltf::Model &gltfModel, vks::VulkanDevice *device, VkCommandBuffer copyCmd, StagingArena& staging)
 {
+	// Images are stored in their encoded form by the image loader, so we decode them in parallel first
+	std::vector<tinygltf::Image*> encodedImages;
+	for (tinygltf::Image &image : gltfModel.images) {
+		if (image.as_is) {
+			encodedImages.push_back(&image);
+		}
+	}
+	parallelFor(encodedImages.size(), [&encodedImages](size_t index) {
+		// Images that fail to decode are reported when being uploaded
+		decodeImageData(*encodedImages[index]);
+	});
+
+	// Uploads are only recorded here, the command buffer is submitted once all of the model's data has been staged
 	for (tinygltf::Image &image : gltfModel.images) {
 		vkglTF::Texture texture;
-		texture.fromglTfImage(image, path, device, transferQueue);
+		texture.fromglTfImage(image, path, device, copyCmd, staging);
 		texture.index = static_cast<uint32_t>(textures.size());
 		textures.push_back(texture);
 	}
 	// Create an empty texture to be used for empty material images
-	createEmptyTexture(transferQueue);
+	createEmptyTexture(copyCmd, staging);
+}
+
+/*
+	Sets up the textures of a model loaded with FileLoadingFlags::StreamTextures
+	Images are not decoded here, all streamed textures are bound to the empty texture until their first levels have been uploaded by updateTextureStreaming
+*/
+void vkglTF::Model::loadStreamedImages(tinygltf::Model& gltfModel, VkCommandBuffer copyCmd, StagingArena& staging)
+{
+	createEmptyTexture(copyCmd, staging);
+	textureStreamer = new TextureStreamer();
+	textureStreamer->entries.resize(gltfModel.images.size());
+	for (size_t i = 0; i < gltfModel.images.size(); i++) {
+		tinygltf::Image& image = gltfModel.images[i];
+		TextureStreamer::Entry& entry = textureStreamer->entries[i];
+		vkglTF::Texture texture;
+		if (isKtxImage(image)) {
+			// Ktx files already contain their mip chain and are loaded as a whole
+			texture.fromglTfImage(image, path, device, copyCmd, staging);
+		} else {
+			if (image.as_is) {
+				// Only the image header is read here, so the size of the mip chain is known before the image is decoded
+				int width, height, components;
+				if (!stbi_info_from_memory(image.image.data(), static_cast<int>(image.image.size()), &width, &height, &components)) {
+					vks::tools::exitFatal("Could not decode image \"" + image.uri + "\": " + stbi_failure_reason(), -1);
+				}
+				entry.width = static_cast<uint32_t>(width);
+				entry.height = static_cast<uint32_t>(height);
+				entry.source.swap(image.image);
+			} else {
+				entry.width = static_cast<uint32_t>(image.width);
+				entry.height = static_cast<uint32_t>(image.height);
+				entry.encoded = false;
+				entry.source.resize(static_cast<size_t>(entry.width) * entry.height * 4, 255);
+				const size_t components = static_cast<size_t>(image.component);
+				for (size_t p = 0; p < static_cast<size_t>(entry.width) * entry.height; p++) {
+					memcpy(&entry.source[p * 4], &image.image[p * components], std::min<size_t>(components, 4));
+				}
+			}
+			entry.levelCount = static_cast<uint32_t>(floor(log2(std::max(entry.width, entry.height))) + 1.0);
+			entry.residentLevel = entry.levelCount;
+			texture.device = device;
+			texture.width = entry.width;
+			texture.height = entry.height;
+			texture.mipLevels = 0;
+			texture.layerCount = 1;
+			texture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			texture.descriptor = emptyTexture.descriptor;
+		}
+		texture.index = static_cast<uint32_t>(textures.size());
+		textures.push_back(texture);
+	}
+}
+
+/*
+	Streams texture levels based on the screen coverage of the visible primitives using them
+	Each texture requests the mip level that matches the number of pixels its largest visible primitive covers, missing levels are decoded in the background and uploaded in order of coverage
+	If an upload would exceed the memory budget, textures that haven't been visible for the longest time are evicted back to the placeholder. If that's not enough, a coarser level is uploaded instead
+	Swapping textures requires the queue to be idle, which is only waited for if textures have actually changed
+	Updated descriptor sets invalidate command buffers they are bound in, so callers need to re-record these if this returns true
+*/
+bool vkglTF::Model::updateTextureStreaming(const glm::mat4& projection, const glm::mat4& view, uint32_t viewportHeight, VkQueue queue)
+{
+	if (!textureStreamer) {
+		return false;
+	}
+	TextureStreamer& streamer = *textureStreamer;
+	std::vector<TextureStreamer::Entry>& entries = streamer.entries;
+	streamer.frame++;
+
+	// Pick up mip chains built since the last update
+	{
+		std::lock_guard<std::mutex> lock(streamer.decodedMutex);
+		for (uint32_t index : streamer.decodedEntries) {
+			TextureStreamer::Entry& entry = entries[index];
+			entry.decoded = true;
+			streamer.pendingDecodes--;
+			if (entry.levels.empty()) {
+				std::cerr << "Could not decode image " << index << ", texture won't be streamed" << std::endl;
+				entry.levelCount = 0;
+				entry.residentLevel = 0;
+			}
+		}
+		streamer.decodedEntries.clear();
+	}
+
+	// Screen coverage of all visible primitives, the bounding spheres are projected with the vertical scale of the projection matrix
+	const glm::vec3 cameraPosition = glm::vec3(glm::inverse(view)[3]);
+	const float projectionScale = std::abs(projection[1][1]) * 0.5f * static_cast<float>(viewportHeight);
+	vks::Frustum frustum;
+	frustum.update(projection * view);
+	for (TextureStreamer::Entry& entry : entries) {
+		entry.coverage = 0.0f;
+	}
+	for (Node* node : linearNodes) {
+		if (!node->mesh) {
+			continue;
+		}
+		const glm::mat4& matrix = node->worldMatrix;
+		const float scale = std::max(glm::length(glm::vec3(matrix[0])), std::max(glm::length(glm::vec3(matrix[1])), glm::length(glm::vec3(matrix[2]))));
+		for (Primitive* primitive : node->mesh->primitives) {
+			const glm::vec3 center = glm::vec3(matrix * glm::vec4(primitive->dimensions.center, 1.0f));
+			const float radius = primitive->dimensions.radius * scale;
+			if (!frustum.checkSphere(center, radius)) {
+				continue;
+			}
+			// Primitives containing the camera may cover the whole viewport
+			const float distance = glm::length(center - cameraPosition) - radius;
+			const float coverage = (distance > 0.0f) ? std::min(2.0f * radius * projectionScale / distance, static_cast<float>(viewportHeight)) : static_cast<float>(viewportHeight);
+			const Material& material = primitive->material;
+			for (const Texture* texture : { material.baseColorTexture, material.metallicRoughnessTexture, material.normalTexture, material.occlusionTexture, material.emissiveTexture }) {
+				if ((texture == nullptr) || (texture == &emptyTexture)) {
+					continue;
+				}
+				TextureStreamer::Entry& entry = entries[texture->index];
+				entry.coverage = std::max(entry.coverage, coverage);
+				entry.lastVisible = streamer.frame;
+			}
+		}
+	}
+
+	// Visible textures that need more levels than are resident, in order of their coverage
+	std::vector<uint32_t> candidates;
+	for (uint32_t i = 0; i < static_cast<uint32_t>(entries.size()); i++) {
+		TextureStreamer::Entry& entry = entries[i];
+		if ((entry.levelCount == 0) || (entry.lastVisible != streamer.frame)) {
+			continue;
+		}
+		const float texels = std::max(entry.coverage * textureStreamingSettings.texelsPerPixel, 1.0f);
+		const float level = std::floor(std::log2(static_cast<float>(std::max(entry.width, entry.height)) / texels));
+		entry.desiredLevel = static_cast<uint32_t>(std::min(std::max(level, 0.0f), static_cast<float>(entry.levelCount - 1)));
+		if (entry.desiredLevel < entry.residentLevel) {
+			candidates.push_back(i);
+		}
+	}
+	std::stable_sort(candidates.begin(), candidates.end(), [&entries](uint32_t a, uint32_t b) { return entries[a].coverage > entries[b].coverage; });
+
+	std::vector<bool> changed(textures.size(), false);
+	std::vector<vkglTF::Texture> retired;
+	auto releaseTexture = [&](uint32_t index) {
+		TextureStreamer::Entry& entry = entries[index];
+		Texture& texture = textures[index];
+		if (texture.image != VK_NULL_HANDLE) {
+			retired.push_back(texture);
+		}
+		streamer.memoryUsed -= entry.memorySize;
+		entry.memorySize = 0;
+		changed[index] = true;
+	};
+	// Evicts the resident texture that hasn't been visible for the longest time, textures visible in this update are never evicted
+	auto evictLeastRecentlyVisible = [&]() {
+		uint32_t evict = UINT32_MAX;
+		for (uint32_t i = 0; i < static_cast<uint32_t>(entries.size()); i++) {
+			const TextureStreamer::Entry& entry = entries[i];
+			if ((entry.residentLevel < entry.levelCount) && (entry.lastVisible != streamer.frame) && ((evict == UINT32_MAX) || (entry.lastVisible < entries[evict].lastVisible))) {
+				evict = i;
+			}
+		}
+		if (evict == UINT32_MAX) {
+			return false;
+		}
+		releaseTexture(evict);
+		Texture& texture = textures[evict];
+		texture.image = VK_NULL_HANDLE;
+		texture.view = VK_NULL_HANDLE;
+		texture.sampler = VK_NULL_HANDLE;
+		texture.deviceMemory = VK_NULL_HANDLE;
+		texture.mipLevels = 0;
+		texture.descriptor = emptyTexture.descriptor;
+		entries[evict].residentLevel = entries[evict].levelCount;
+		streamer.evictions++;
+		return true;
+	};
+
+	StagingArena staging(device);
+	VkCommandBuffer copyCmd = VK_NULL_HANDLE;
+	uint32_t uploads = 0;
+	for (uint32_t index : candidates) {
+		TextureStreamer::Entry& entry = entries[index];
+		if (!entry.decoded) {
+			if (!entry.decodeQueued && (streamer.pendingDecodes < textureStreamingSettings.maxPendingDecodes)) {
+				streamer.queueDecode(index);
+			}
+			continue;
+		}
+		if (uploads >= textureStreamingSettings.maxUploadsPerUpdate) {
+			continue;
+		}
+		uint32_t level = entry.desiredLevel;
+		while ((level < entry.residentLevel) && (streamer.memoryUsed - entry.memorySize + streamer.chainSize(entry, level) > textureStreamingSettings.memoryBudget)) {
+			if (!evictLeastRecentlyVisible()) {
+				level++;
+			}
+		}
+		if (level >= entry.residentLevel) {
+			continue;
+		}
+		if (copyCmd == VK_NULL_HANDLE) {
+			copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		}
+		releaseTexture(index);
+		std::vector<const unsigned char*> levels;
+		for (uint32_t l = level; l < entry.levelCount; l++) {
+			levels.push_back(entry.levels[l].data());
+		}
+		Texture& texture = textures[index];
+		texture.fromRGBA8Levels(levels, std::max(1u, entry.width >> level), std::max(1u, entry.height >> level), device, copyCmd, staging);
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(device->logicalDevice, texture.image, &memReqs);
+		entry.memorySize = memReqs.size;
+		entry.residentLevel = level;
+		streamer.memoryUsed += entry.memorySize;
+		uploads++;
+	}
+
+	bool descriptorsChanged = false;
+	if (std::find(changed.begin(), changed.end(), true) != changed.end()) {
+		if (copyCmd != VK_NULL_HANDLE) {
+			device->flushCommandBuffer(copyCmd, queue, true);
+		}
+		// Frames still in flight may use the descriptor sets and the images that are replaced
+		VK_CHECK_RESULT(vkQueueWaitIdle(queue));
+		for (Material& material : materials) {
+			if (material.descriptorSet == VK_NULL_HANDLE) {
+				continue;
+			}
+			for (const Texture* texture : { material.baseColorTexture, material.normalTexture }) {
+				if (texture && (texture != &emptyTexture) && changed[texture->index]) {
+					material.updateDescriptorSet(descriptorBindingFlags);
+					descriptorsChanged = true;
+					break;
+				}
+			}
+		}
+		for (Texture& texture : retired) {
+			texture.destroy();
+		}
+	}
+	staging.destroy();
+
+	textureStreamingStatistics.memoryUsed = streamer.memoryUsed;
+	textureStreamingStatistics.residentTextures = 0;
+	textureStreamingStatistics.streamedTextures = 0;
+	for (const TextureStreamer::Entry& entry : entries) {
+		if (entry.levelCount > 0) {
+			textureStreamingStatistics.streamedTextures++;
+			if (entry.residentLevel < entry.levelCount) {
+				textureStreamingStatistics.residentTextures++;
+			}
+		}
+	}
+	textureStreamingStatistics.evictions = streamer.evictions;
+	return descriptorsChanged;
 }
 
 void vkglTF::Model::loadMaterials(tinygltf::Model &gltfModel)
@@ -1093,12 +1904,12 @@ void vkglTF::Model::loadAnimations(tinygltf::Model &gltfModel)
 			{
 				const tinygltf::Accessor &accessor = gltfModel.accessors[samp.input];
 				const tinygltf::BufferView &bufferView = gltfModel.bufferViews[accessor.bufferView];
-				const tinygltf::Buffer &buffer = gltfModel.buffers[bufferView.buffer];
+				const unsigned char* buffer = bufferData[bufferView.buffer];
 
 				assert(accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
 
 				float *buf = new float[accessor.count];
-				memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(float));
+				memcpy(buf, &buffer[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(float));
 				for (size_t index = 0; index < accessor.count; index++) {
 					sampler.inputs.push_back(buf[index]);
 				}
@@ -1117,14 +1928,14 @@ void vkglTF::Model::loadAnimations(tinygltf::Model &gltfModel)
 			{
 				const tinygltf::Accessor &accessor = gltfModel.accessors[samp.output];
 				const tinygltf::BufferView &bufferView = gltfModel.bufferViews[accessor.bufferView];
-				const tinygltf::Buffer &buffer = gltfModel.buffers[bufferView.buffer];
+				const unsigned char* buffer = bufferData[bufferView.buffer];
 
 				assert(accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
 
 				switch (accessor.type) {
 				case TINYGLTF_TYPE_VEC3: {
 					glm::vec3 *buf = new glm::vec3[accessor.count];
-					memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(glm::vec3));
+					memcpy(buf, &buffer[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(glm::vec3));
 					for (size_t index = 0; index < accessor.count; index++) {
 						sampler.outputsVec4.push_back(glm::vec4(buf[index], 0.0f));
 					}
@@ -1133,7 +1944,7 @@ void vkglTF::Model::loadAnimations(tinygltf::Model &gltfModel)
 				}
 				case TINYGLTF_TYPE_VEC4: {
 					glm::vec4 *buf = new glm::vec4[accessor.count];
-					memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(glm::vec4));
+					memcpy(buf, &buffer[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(glm::vec4));
 					for (size_t index = 0; index < accessor.count; index++) {
 						sampler.outputsVec4.push_back(buf[index]);
 					}
@@ -1180,334 +1991,755 @@ void vkglTF::Model::loadAnimations(tinygltf::Model &gltfModel)
 	}
 }
 
-void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device, VkQueue transferQueue, uint32_t fileLoadingFlags, float scale)
+/*
+	Reorders the triangles of each primitive for post-transform vertex cache locality and then its vertices in the order they are first used
+	Primitives own distinct vertex ranges, so they're optimized independently
+*/
+void vkglTF::Model::optimizeVertexCache(std::vector<uint32_t>& indexBuffer, std::vector<Vertex>& vertexBuffer)
 {
-	tinygltf::Model gltfModel;
-	tinygltf::TinyGLTF gltfContext;
-	if (fileLoadingFlags & FileLoadingFlags::DontLoadImages) {
-		gltfContext.SetImageLoader(loadImageDataFuncEmpty, nullptr);
-	} else {
-		gltfContext.SetImageLoader(loadImageDataFunc, nullptr);
+	float missesBefore = 0.0f;
+	float missesAfter = 0.0f;
+	uint32_t triangleCount = 0;
+	std::vector<uint32_t> localIndices;
+	for (auto node : linearNodes) {
+		if (!node->mesh) {
+			continue;
+		}
+		for (Primitive* primitive : node->mesh->primitives) {
+			if ((primitive->indexCount < 3) || (primitive->vertexCount == 0)) {
+				continue;
+			}
+			localIndices.assign(indexBuffer.begin() + primitive->firstIndex, indexBuffer.begin() + primitive->firstIndex + primitive->indexCount);
+			for (uint32_t& index : localIndices) {
+				index -= primitive->firstVertex;
+			}
+			const uint32_t primitiveTriangles = primitive->indexCount / 3;
+			missesBefore += vks::vertexcache::calculateACMR(localIndices.data(), localIndices.size(), primitive->vertexCount) * primitiveTriangles;
+			vks::vertexcache::optimizeTriangleOrder(localIndices.data(), localIndices.size(), primitive->vertexCount);
+			vks::vertexcache::optimizeVertexOrder(localIndices.data(), localIndices.size(), &vertexBuffer[primitive->firstVertex], primitive->vertexCount);
+			missesAfter += vks::vertexcache::calculateACMR(localIndices.data(), localIndices.size(), primitive->vertexCount) * primitiveTriangles;
+			triangleCount += primitiveTriangles;
+			for (uint32_t i = 0; i < primitive->indexCount; i++) {
+				indexBuffer[primitive->firstIndex + i] = localIndices[i] + primitive->firstVertex;
+			}
+		}
 	}
-#if defined(__ANDROID__)
-	// On Android all assets are packed with the apk in a compressed form, so we need to open them using the asset manager
-	// We let tinygltf handle this, by passing the asset manager of our app
-	tinygltf::asset_manager = androidApp->activity->assetManager;
-#endif
-	size_t pos = filename.find_last_of('/');
-	path = filename.substr(0, pos);
-
-	std::string error, warning;
-
-	this->device = device;
-
-#if defined(__ANDROID__)
-	// On Android all assets are packed with the apk in a compressed form, so we need to open them using the asset manager
-	// We let tinygltf handle this, by passing the asset manager of our app
-	tinygltf::asset_manager = androidApp->activity->assetManager;
-#endif
-	bool fileLoaded = gltfContext.LoadASCIIFromFile(&gltfModel, &error, &warning, filename);
-
-	std::vector<uint32_t> indexBuffer;
-	std::vector<Vertex> vertexBuffer;
+	if (triangleCount > 0) {
+		vertexCacheStatistics.acmrBefore = missesBefore / triangleCount;
+		vertexCacheStatistics.acmrAfter = missesAfter / triangleCount;
+	}
+	std::cout << "Vertex cache optimization: ACMR " << vertexCacheStatistics.acmrBefore << " -> " << vertexCacheStatistics.acmrAfter << " (" << triangleCount << " triangles)" << std::endl;
+}
 
-	if (fileLoaded) {
-		if (!(fileLoadingFlags & FileLoadingFlags::DontLoadImages)) {
-			loadImages(gltfModel, device, transferQueue);
+/*
+	Builds a chain of simplified index lists for each primitive, each level targets half the triangles of the previous one
+	Levels share the primitive's vertices and are appended to the index buffer in primitive order, so the output is the same for every run
+*/
+void vkglTF::Model::generateLODs(std::vector<uint32_t>& indexBuffer, const std::vector<Vertex>& vertexBuffer)
+{
+	std::vector<Primitive*> primitives;
+	for (auto node : linearNodes) {
+		if (node->mesh) {
+			for (Primitive* primitive : node->mesh->primitives) {
+				primitive->lods = { { primitive->firstIndex, primitive->indexCount, 0.0f } };
+				if ((primitive->indexCount >= 3) && (primitive->vertexCount > 0)) {
+					primitives.push_back(primitive);
+				}
+			}
 		}
-		loadMaterials(gltfModel);
-		const tinygltf::Scene &scene = gltfModel.scenes[gltfModel.defaultScene > -1 ? gltfModel.defaultScene : 0];
-		for (size_t i = 0; i < scene.nodes.size(); i++) {
-			const tinygltf::Node node = gltfModel.nodes[scene.nodes[i]];
-			loadNode(nullptr, node, scene.nodes[i], gltfModel, indexBuffer, vertexBuffer, scale);
+	}
+
+	// Simplified index lists per primitive with indices relative to the primitive's first vertex
+	struct LODLevel {
+		std::vector<uint32_t> indices;
+		float error;
+	};
+	std::vector<std::vector<LODLevel>> primitiveLODs(primitives.size());
+	parallelFor(primitives.size(), [&](size_t index) {
+		const Primitive* primitive = primitives[index];
+		std::vector<uint32_t> lodIndices(indexBuffer.begin() + primitive->firstIndex, indexBuffer.begin() + primitive->firstIndex + primitive->indexCount);
+		for (uint32_t& lodIndex : lodIndices) {
+			lodIndex -= primitive->firstVertex;
 		}
-		if (gltfModel.animations.size() > 0) {
-			loadAnimations(gltfModel);
+		float error = 0.0f;
+		for (uint32_t level = 1; level < maxLODLevels; level++) {
+			const size_t previousCount = lodIndices.size();
+			const size_t targetCount = std::max(previousCount / 6 * 3, static_cast<size_t>(3));
+			error = std::max(error, vks::meshsimplify::simplify(lodIndices, primitive->vertexCount, targetCount, [&](uint32_t vertex) { return vertexBuffer[primitive->firstVertex + vertex].pos; }));
+			// Stop once the simplifier can't make meaningful progress anymore (e.g. for meshes that are mostly borders or seams)
+			if (lodIndices.empty() || (lodIndices.size() > previousCount * 9 / 10)) {
+				break;
+			}
+			vks::vertexcache::optimizeTriangleOrder(lodIndices.data(), lodIndices.size(), primitive->vertexCount);
+			primitiveLODs[index].push_back({ lodIndices, error });
 		}
-		loadSkins(gltfModel);
+	});
 
-		for (auto node : linearNodes) {
-			// Assign skins
-			if (node->skinIndex > -1) {
-				node->skin = skins[node->skinIndex];
-			}
-			// Initial pose
-			if (node->mesh) {
-				node->update();
+	for (size_t i = 0; i < primitives.size(); i++) {
+		for (const LODLevel& lod : primitiveLODs[i]) {
+			primitives[i]->lods.push_back({ static_cast<uint32_t>(indexBuffer.size()), static_cast<uint32_t>(lod.indices.size()), lod.error });
+			for (uint32_t index : lod.indices) {
+				indexBuffer.push_back(index + primitives[i]->firstVertex);
 			}
 		}
 	}
-	else {
-		vks::tools::exitFatal("Could not load glTF file \"" + filename + "\": " + error, -1);
-		return;
-	}
+}
 
-	// Pre-Calculations for requested features
-	if ((fileLoadingFlags & FileLoadingFlags::PreTransformVertices) || (fileLoadingFlags & FileLoadingFlags::PreMultiplyVertexColors) || (fileLoadingFlags & FileLoadingFlags::FlipY)) {
-		const bool preTransform = fileLoadingFlags & FileLoadingFlags::PreTransformVertices;
-		const bool preMultiplyColor = fileLoadingFlags & FileLoadingFlags::PreMultiplyVertexColors;
-		const bool flipY = fileLoadingFlags & FileLoadingFlags::FlipY;
-		for (Node* node : linearNodes) {
-			if (node->mesh) {
-				const glm::mat4 localMatrix = node->getMatrix();
-				for (Primitive* primitive : node->mesh->primitives) {
-					for (uint32_t i = 0; i < primitive->vertexCount; i++) {
-						Vertex& vertex = vertexBuffer[primitive->firstVertex + i];
-						// Pre-transform vertex positions by node-hierarchy
-						if (preTransform) {
-							vertex.pos = glm::vec3(localMatrix * glm::vec4(vertex.pos, 1.0f));
-							vertex.normal = glm::normalize(glm::mat3(localMatrix) * vertex.normal);
-						}
-						// Flip Y-Axis of vertex positions
-						if (flipY) {
-							vertex.pos.y *= -1.0f;
-							vertex.normal.y *= -1.0f;
-						}
-						// Pre-Multiply vertex colors with material base color
-						if (preMultiplyColor) {
-							vertex.color = primitive->material.baseColorFactor * vertex.color;
-						}
-					}
+/*
+	Splits the index range of each primitive into meshlets and calculates their culling data
+	Primitives are processed in parallel, the results are then concatenated in primitive order so the output is the same for every run
+*/
+void vkglTF::Model::generateMeshlets(const std::vector<uint32_t>& indexBuffer, const std::vector<Vertex>& vertexBuffer)
+{
+	std::vector<Primitive*> primitives;
+	for (auto node : linearNodes) {
+		if (node->mesh) {
+			for (Primitive* primitive : node->mesh->primitives) {
+				if ((primitive->indexCount >= 3) && (primitive->vertexCount > 0)) {
+					primitives.push_back(primitive);
 				}
 			}
 		}
 	}
+	if (primitives.empty()) {
+		return;
+	}
 
-	for (auto extension : gltfModel.extensionsUsed) {
-		if (extension == "KHR_materials_pbrSpecularGlossiness") {
-			std::cout << "Required extension: " << extension;
-			metallicRoughnessWorkflow = false;
-		}
+	std::vector<vks::meshlets::MeshletData> primitiveMeshlets(primitives.size());
+	parallelFor(primitives.size(), [&](size_t index) {
+		const Primitive* primitive = primitives[index];
+		primitiveMeshlets[index] = vks::meshlets::build(&indexBuffer[primitive->firstIndex], primitive->indexCount, primitive->firstVertex, primitive->vertexCount, [&vertexBuffer](uint32_t vertex) { return vertexBuffer[vertex].pos; });
+	});
+
+	meshletData = vks::meshlets::MeshletData();
+	for (size_t i = 0; i < primitives.size(); i++) {
+		primitives[i]->firstMeshlet = static_cast<uint32_t>(meshletData.meshlets.size());
+		primitives[i]->meshletCount = static_cast<uint32_t>(primitiveMeshlets[i].meshlets.size());
+		meshletData.append(primitiveMeshlets[i]);
 	}
+}
 
-	//calcLMUV  only triangles
-	if (isCalcLMUV)
-	{
-		auto FindFaceSameVertex = [&](Face face, int i) {
-			for (auto& t : face.triangles)
-			{
-				if (t.vertices[0] == i)return true;
-				if (t.vertices[1] == i)return true;
-				if (t.vertices[2] == i)return true;
-				return false;
+/*
+	Lightmap cache
+	Charts, lightmap coordinates and atlas layout generated by calcLightmapUV are stored in a binary file next to the model
+	Every primitive is identified by a hash of its positions and indices, the cache is only used if all hashes and the atlas settings match
+*/
+
+const uint32_t lightmapCacheMagic = 0x4d4c4b56; // "VKLM"
+const uint32_t lightmapCacheVersion = 1;
+
+struct LightmapCache {
+	struct Primitive {
+		uint64_t hash;
+		vks::lightmap::Charts charts;
+		std::vector<glm::vec2> uv2;
+		std::vector<vkglTF::Model::Box> boxes;
+	};
+	uint64_t settingsHash = 0;
+	vkglTF::Model::LightmapAtlas atlas;
+	std::vector<Primitive> primitives;
+};
+
+// 64 bit FNV-1a
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ull)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; i++) {
+		hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+	}
+	return hash;
+}
+
+template<typename T>
+void writeBinaryValue(std::ofstream& file, const T& value)
+{
+	file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+void writeBinaryVector(std::ofstream& file, const std::vector<T>& values)
+{
+	writeBinaryValue(file, static_cast<uint32_t>(values.size()));
+	file.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+}
+
+template<typename T>
+bool readBinaryValue(std::ifstream& file, T& value)
+{
+	return static_cast<bool>(file.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+// The element count is checked against the file size, so a corrupt file can't trigger huge allocations
+template<typename T>
+bool readBinaryVector(std::ifstream& file, std::vector<T>& values, size_t fileSize)
+{
+	uint32_t count;
+	if (!readBinaryValue(file, count) || (static_cast<size_t>(count) > fileSize / sizeof(T))) {
+		return false;
+	}
+	values.resize(count);
+	return static_cast<bool>(file.read(reinterpret_cast<char*>(values.data()), values.size() * sizeof(T)));
+}
+
+bool writeLightmapCache(const std::string& filename, const LightmapCache& cache)
+{
+	std::ofstream file(filename, std::ios::binary);
+	if (!file.is_open()) {
+		return false;
+	}
+	writeBinaryValue(file, lightmapCacheMagic);
+	writeBinaryValue(file, lightmapCacheVersion);
+	writeBinaryValue(file, cache.settingsHash);
+	writeBinaryValue(file, cache.atlas.width);
+	writeBinaryValue(file, cache.atlas.height);
+	writeBinaryValue(file, cache.atlas.texelsPerUnit);
+	writeBinaryValue(file, cache.atlas.efficiency);
+	writeBinaryValue(file, static_cast<uint32_t>(cache.primitives.size()));
+	for (const LightmapCache::Primitive& primitive : cache.primitives) {
+		writeBinaryValue(file, primitive.hash);
+		writeBinaryValue(file, primitive.charts.chartCount);
+		writeBinaryVector(file, primitive.charts.triangleChart);
+		writeBinaryVector(file, primitive.charts.chartAxis);
+		writeBinaryVector(file, primitive.charts.indices);
+		writeBinaryVector(file, primitive.charts.splitVertices);
+		writeBinaryVector(file, primitive.uv2);
+		writeBinaryValue(file, static_cast<uint32_t>(primitive.boxes.size()));
+		for (const vkglTF::Model::Box& box : primitive.boxes) {
+			const float values[6] = { box.x, box.y, box.w, box.h, box.x2, box.y2 };
+			file.write(reinterpret_cast<const char*>(values), sizeof(values));
+			writeBinaryValue(file, static_cast<int32_t>(box.face));
+			writeBinaryValue(file, static_cast<uint8_t>(box.swap));
+		}
+	}
+	return file.good();
+}
+
+bool readLightmapCache(const std::string& filename, LightmapCache& cache)
+{
+	std::ifstream file(filename, std::ios::binary | std::ios::ate);
+	if (!file.is_open()) {
+		return false;
+	}
+	const size_t fileSize = static_cast<size_t>(file.tellg());
+	file.seekg(0);
+	uint32_t magic, version, primitiveCount;
+	if (!readBinaryValue(file, magic) || !readBinaryValue(file, version) || (magic != lightmapCacheMagic) || (version != lightmapCacheVersion)) {
+		return false;
+	}
+	if (!readBinaryValue(file, cache.settingsHash) || !readBinaryValue(file, cache.atlas.width) || !readBinaryValue(file, cache.atlas.height) || !readBinaryValue(file, cache.atlas.texelsPerUnit) || !readBinaryValue(file, cache.atlas.efficiency) || !readBinaryValue(file, primitiveCount)) {
+		return false;
+	}
+	if (primitiveCount > fileSize) {
+		return false;
+	}
+	cache.primitives.resize(primitiveCount);
+	for (LightmapCache::Primitive& primitive : cache.primitives) {
+		uint32_t boxCount;
+		if (!readBinaryValue(file, primitive.hash) || !readBinaryValue(file, primitive.charts.chartCount)
+			|| !readBinaryVector(file, primitive.charts.triangleChart, fileSize) || !readBinaryVector(file, primitive.charts.chartAxis, fileSize)
+			|| !readBinaryVector(file, primitive.charts.indices, fileSize) || !readBinaryVector(file, primitive.charts.splitVertices, fileSize)
+			|| !readBinaryVector(file, primitive.uv2, fileSize) || !readBinaryValue(file, boxCount) || (boxCount > fileSize)) {
+			return false;
+		}
+		primitive.boxes.resize(boxCount);
+		for (vkglTF::Model::Box& box : primitive.boxes) {
+			float values[6];
+			int32_t face;
+			uint8_t swap;
+			if (!file.read(reinterpret_cast<char*>(values), sizeof(values)) || !readBinaryValue(file, face) || !readBinaryValue(file, swap)) {
+				return false;
 			}
-			};
-		//build faces & boxes
+			box = { values[0], values[1], values[2], values[3], values[4], values[5], face, swap != 0 };
+		}
+	}
+	return true;
+}
+
+/*
+	Generates lightmap coordinates (uv2) by projecting charts of connected triangles with the same dominant normal axis onto their axis plane
+	Vertices shared by several charts are split, the split copies are stored at the end of their primitive's vertex range
+	The charts of all primitives are packed into a single power of two atlas (see lightmapSettings and lightmapAtlas)
+	If the model has been loaded with a lightmap cache file that matches its geometry, charts and coordinates are taken from the cache instead
+*/
+void vkglTF::Model::calcLightmapUV(std::vector<uint32_t>& indexBuffer, std::vector<Vertex>& vertexBuffer)
+{
+	std::vector<Primitive*> primitives;
+	for (auto node : linearNodes) {
+		if (node->mesh) {
+			primitives.insert(primitives.end(), node->mesh->primitives.begin(), node->mesh->primitives.end());
+		}
+	}
+	std::sort(primitives.begin(), primitives.end(), [](const Primitive* lhs, const Primitive* rhs) { return lhs->firstVertex < rhs->firstVertex; });
+
+	// Hash the positions and (primitive relative) indices of every primitive and the settings that affect the atlas
+	LightmapCache cache;
+	cache.primitives.resize(primitives.size());
+	std::vector<std::vector<uint32_t>> primitiveIndices(primitives.size());
+	parallelFor(primitives.size(), [&](size_t index) {
+		const Primitive* primitive = primitives[index];
+		std::vector<uint32_t>& localIndices = primitiveIndices[index];
+		localIndices.assign(indexBuffer.begin() + primitive->firstIndex, indexBuffer.begin() + primitive->firstIndex + primitive->indexCount);
+		for (uint32_t& localIndex : localIndices) {
+			localIndex -= primitive->firstVertex;
+		}
+		const uint32_t counts[2] = { primitive->vertexCount, primitive->indexCount };
+		uint64_t hash = hashBytes(counts, sizeof(counts));
+		for (uint32_t i = 0; i < primitive->vertexCount; i++) {
+			hash = hashBytes(&vertexBuffer[primitive->firstVertex + i].pos, sizeof(glm::vec3), hash);
+		}
+		cache.primitives[index].hash = hashBytes(localIndices.data(), localIndices.size() * sizeof(uint32_t), hash);
+	});
+	cache.settingsHash = hashBytes(&lightmapSettings.texelsPerUnit, sizeof(float));
+	cache.settingsHash = hashBytes(&lightmapSettings.padding, sizeof(uint32_t), cache.settingsHash);
+	cache.settingsHash = hashBytes(&lightmapSettings.maxSize, sizeof(uint32_t), cache.settingsHash);
+	cache.settingsHash = hashBytes(&lightmapSettings.allowRotation, sizeof(bool), cache.settingsHash);
+
+	// Cached data is only used if it matches all primitives and is consistent with them
+	LightmapCache cached;
+	bool cacheHit = !lightmapCacheFile.empty() && readLightmapCache(lightmapCacheFile, cached) && (cached.settingsHash == cache.settingsHash) && (cached.primitives.size() == primitives.size());
+	for (size_t i = 0; cacheHit && (i < primitives.size()); i++) {
+		const Primitive* primitive = primitives[i];
+		const LightmapCache::Primitive& entry = cached.primitives[i];
+		const vks::lightmap::Charts& charts = entry.charts;
+		const size_t vertexCount = primitive->vertexCount + charts.splitVertices.size();
+		// Primitives without triangles don't get any charts
+		const uint32_t chartIndexCount = ((primitive->indexCount < 3) || (primitive->vertexCount == 0)) ? 0 : primitive->indexCount;
+		cacheHit = (entry.hash == cache.primitives[i].hash) && (charts.indices.size() == chartIndexCount) && (charts.triangleChart.size() == chartIndexCount / 3)
+			&& (charts.chartAxis.size() == charts.chartCount) && (entry.uv2.size() == vertexCount) && (entry.boxes.size() == charts.chartCount);
+		for (size_t j = 0; cacheHit && (j < charts.indices.size()); j++) {
+			cacheHit = charts.indices[j] < vertexCount;
+		}
+		for (size_t j = 0; cacheHit && (j < charts.splitVertices.size()); j++) {
+			cacheHit = charts.splitVertices[j] < primitive->vertexCount;
+		}
+		for (size_t j = 0; cacheHit && (j < charts.triangleChart.size()); j++) {
+			cacheHit = charts.triangleChart[j] < charts.chartCount;
+		}
+		for (size_t j = 0; cacheHit && (j < charts.chartAxis.size()); j++) {
+			cacheHit = (charts.chartAxis[j] >= 0) && (charts.chartAxis[j] < 3);
+		}
+		for (size_t j = 0; cacheHit && (j < entry.boxes.size()); j++) {
+			cacheHit = (entry.boxes[j].face >= 0) && (static_cast<uint32_t>(entry.boxes[j].face) < charts.chartCount);
+		}
+	}
+
+	std::vector<vks::lightmap::Charts> primitiveCharts(primitives.size());
+	if (cacheHit) {
+		for (size_t i = 0; i < primitives.size(); i++) {
+			primitiveCharts[i] = std::move(cached.primitives[i].charts);
+		}
+	} else {
+		parallelFor(primitives.size(), [&](size_t index) {
+			const Primitive* primitive = primitives[index];
+			if ((primitive->indexCount < 3) || (primitive->vertexCount == 0)) {
+				return;
+			}
+			primitiveCharts[index] = vks::lightmap::buildCharts(primitiveIndices[index].data(), primitiveIndices[index].size(), primitive->vertexCount, [&](uint32_t vertex) { return vertexBuffer[primitive->firstVertex + vertex].pos; });
+		});
+	}
+
+	// Rebuild the vertex buffer with the split vertices appended to each primitive's range
+	std::vector<Vertex> chartVertexBuffer;
+	size_t splitCount = 0;
+	for (const vks::lightmap::Charts& charts : primitiveCharts) {
+		splitCount += charts.splitVertices.size();
+	}
+	chartVertexBuffer.reserve(vertexBuffer.size() + splitCount);
+	uint32_t cursor = 0;
+	for (size_t i = 0; i < primitives.size(); i++) {
+		Primitive* primitive = primitives[i];
+		const vks::lightmap::Charts& charts = primitiveCharts[i];
+		// Vertices that don't belong to any primitive are kept as they are
+		if (primitive->firstVertex > cursor) {
+			chartVertexBuffer.insert(chartVertexBuffer.end(), vertexBuffer.begin() + cursor, vertexBuffer.begin() + primitive->firstVertex);
+		}
+		const uint32_t firstVertex = static_cast<uint32_t>(chartVertexBuffer.size());
+		chartVertexBuffer.insert(chartVertexBuffer.end(), vertexBuffer.begin() + primitive->firstVertex, vertexBuffer.begin() + primitive->firstVertex + primitive->vertexCount);
+		for (uint32_t splitVertex : charts.splitVertices) {
+			chartVertexBuffer.push_back(vertexBuffer[primitive->firstVertex + splitVertex]);
+		}
+		if (charts.indices.empty()) {
+			// Primitives without charts keep their indices, rebased to the new start of their vertex range
+			for (size_t j = 0; j < primitiveIndices[i].size(); j++) {
+				indexBuffer[primitive->firstIndex + j] = primitiveIndices[i][j] + firstVertex;
+			}
+		}
+		for (size_t j = 0; j < charts.indices.size(); j++) {
+			indexBuffer[primitive->firstIndex + j] = charts.indices[j] + firstVertex;
+		}
+		cursor = std::max(cursor, primitive->firstVertex + primitive->vertexCount);
+		primitive->firstVertex = firstVertex;
+		primitive->vertexCount += static_cast<uint32_t>(charts.splitVertices.size());
+	}
+	if (cursor < vertexBuffer.size()) {
+		chartVertexBuffer.insert(chartVertexBuffer.end(), vertexBuffer.begin() + cursor, vertexBuffer.end());
+	}
+	vertexBuffer.swap(chartVertexBuffer);
+
+	faces.clear();
+	boxes.clear();
+	std::vector<std::vector<std::vector<uint32_t>>> chartVertices;
+	// Primitive of each entry in faces and boxes
+	std::vector<size_t> chartPrimitives;
+	for (size_t i = 0; i < primitives.size(); i++) {
+		const Primitive* primitive = primitives[i];
+		const vks::lightmap::Charts& charts = primitiveCharts[i];
+		if (charts.chartCount == 0) {
+			continue;
+		}
+
+		// One face per chart, after splitting every vertex belongs to exactly one of them
+		std::vector<Face> tempFaces(charts.chartCount);
+		std::vector<std::vector<uint32_t>> faceVertices(charts.chartCount);
+		std::vector<bool> vertexAdded(primitive->vertexCount, false);
+		for (size_t t = 0; t < charts.triangleChart.size(); t++) {
+			const uint32_t chart = charts.triangleChart[t];
+			Face::Triangle tTriangle;
+			tTriangle.side = charts.chartAxis[chart];
+			tTriangle.vertices.resize(3);
+			for (size_t c = 0; c < 3; c++) {
+				uint32_t localIndex = charts.indices[t * 3 + c];
+				tTriangle.vertices[c] = static_cast<int>(primitive->firstVertex + localIndex);
+				if (!vertexAdded[localIndex]) {
+					vertexAdded[localIndex] = true;
+					faceVertices[chart].push_back(primitive->firstVertex + localIndex);
+				}
+			}
+			const glm::vec3& p0 = vertexBuffer[tTriangle.vertices[0]].pos;
+			tTriangle.normal = glm::normalize(glm::cross(vertexBuffer[tTriangle.vertices[2]].pos - p0, vertexBuffer[tTriangle.vertices[1]].pos - p0));
+			tTriangle.distance = glm::dot(tTriangle.normal, p0);
+			tempFaces[chart].triangles.push_back(std::move(tTriangle));
+		}
+
+		if (cacheHit) {
+			const LightmapCache::Primitive& entry = cached.primitives[i];
+			for (uint32_t v = 0; v < primitive->vertexCount; v++) {
+				vertexBuffer[primitive->firstVertex + v].uv2.x = entry.uv2[v].x;
+				vertexBuffer[primitive->firstVertex + v].uv2.y = entry.uv2[v].y;
+			}
+			faces.push_back(std::move(tempFaces));
+			boxes.push_back(entry.boxes);
+			chartPrimitives.push_back(i);
+			continue;
+		}
+
+		// Project each chart onto the plane of its axis (in object space units) and calculate its bounding box
+		std::vector<Box> tempBoxes;
+		for (uint32_t f = 0; f < charts.chartCount; f++) {
+			const int side = charts.chartAxis[f];
+			Box tBox;
+			tBox.face = f;
+			tBox.swap = false;
+			tBox.x = tBox.y = FLT_MAX;
+			tBox.x2 = tBox.y2 = -FLT_MAX;
+			for (uint32_t vertexIndex : faceVertices[f]) {
+				Vertex& v = vertexBuffer[vertexIndex];
+				v.uv2[0] = v.pos[side == 0 ? 1 : 0];
+				v.uv2[1] = v.pos[side == 2 ? 1 : 2];
+				tBox.x = std::min(tBox.x, v.uv2[0]);
+				tBox.x2 = std::max(tBox.x2, v.uv2[0]);
+				tBox.y = std::min(tBox.y, v.uv2[1]);
+				tBox.y2 = std::max(tBox.y2, v.uv2[1]);
+			}
+			tBox.w = tBox.x2 - tBox.x;
+			tBox.h = tBox.y2 - tBox.y;
+			tempBoxes.push_back(tBox);
+		}
+
+		faces.push_back(std::move(tempFaces));
+		boxes.push_back(std::move(tempBoxes));
+		chartVertices.push_back(std::move(faceVertices));
+		chartPrimitives.push_back(i);
+	}
+
+	if (cacheHit) {
+		lightmapAtlas = cached.atlas;
+		std::cout << "Lightmap atlas: " << lightmapAtlas.width << "x" << lightmapAtlas.height << " loaded from " << lightmapCacheFile << std::endl;
+		return;
+	}
+
+	// Pack the charts of all primitives into a single atlas at the requested texel density
+	// If they don't fit into the largest allowed atlas the density is halved until they do
+	// Every chart covers at least one texel plus padding, so once all charts are at that size lowering the density doesn't help anymore and packing fails
+	std::vector<vks::rectpack::Rect> rects;
+	float texelsPerUnit = lightmapSettings.texelsPerUnit;
+	uint32_t atlasWidth = 0, atlasHeight = 0;
+	const uint32_t padding = lightmapSettings.padding;
+	bool packed = false;
+	while (true) {
+		rects.clear();
+		bool minimal = true;
+		for (const std::vector<Box>& primitiveBoxes : boxes) {
+			for (const Box& box : primitiveBoxes) {
+				const float width = std::ceil(box.w * texelsPerUnit);
+				const float height = std::ceil(box.h * texelsPerUnit);
+				minimal = minimal && (width <= 1.0f) && (height <= 1.0f);
+				vks::rectpack::Rect rect;
+				// Charts larger than the atlas are clamped to a size that still can't be packed to keep the conversion in range
+				const float maxSize = static_cast<float>(lightmapSettings.maxSize) + 1.0f;
+				rect.width = static_cast<uint32_t>(std::min(std::max(width, 1.0f), maxSize)) + padding * 2;
+				rect.height = static_cast<uint32_t>(std::min(std::max(height, 1.0f), maxSize)) + padding * 2;
+				rects.push_back(rect);
+			}
+		}
+		if (rects.empty() || vks::rectpack::packAtlas(rects, lightmapSettings.maxSize, lightmapSettings.allowRotation, atlasWidth, atlasHeight)) {
+			packed = true;
+			break;
+		}
+		if (minimal) {
+			break;
+		}
+		texelsPerUnit *= 0.5f;
+		std::cout << "Lightmap charts don't fit into a " << lightmapSettings.maxSize << "x" << lightmapSettings.maxSize << " atlas, reducing texel density to " << texelsPerUnit << " texels per unit" << std::endl;
+	}
+
+	lightmapAtlas = {};
+	if (!packed) {
+		// Without an atlas the model has no usable lightmap coordinates, so they are reset instead of leaving projected object space values
+		std::cerr << "Lightmap: " << rects.size() << " charts with " << padding << " texels padding don't fit into a " << lightmapSettings.maxSize << "x" << lightmapSettings.maxSize << " atlas at any texel density, lightmap coordinates are not generated" << std::endl;
+		for (Vertex& vertex : vertexBuffer) {
+			vertex.uv2 = glm::vec4(0.0f);
+		}
+		faces.clear();
+		boxes.clear();
+		return;
+	}
+	if (rects.empty()) {
+		return;
+	}
+	lightmapAtlas.width = atlasWidth;
+	lightmapAtlas.height = atlasHeight;
+	lightmapAtlas.texelsPerUnit = texelsPerUnit;
+
+	// Move the charts to their place in the atlas and normalize the lightmap coordinates, rotated charts have their axes swapped
+	uint64_t usedTexels = 0;
+	size_t rectIndex = 0;
+	for (size_t i = 0; i < boxes.size(); i++) {
+		for (Box& box : boxes[i]) {
+			const vks::rectpack::Rect& rect = rects[rectIndex++];
+			usedTexels += static_cast<uint64_t>(rect.width) * rect.height;
+			for (uint32_t vertexIndex : chartVertices[i][box.face]) {
+				Vertex& v = vertexBuffer[vertexIndex];
+				glm::vec2 local = (glm::vec2(v.uv2) - glm::vec2(box.x, box.y)) * texelsPerUnit;
+				if (rect.rotated) {
+					std::swap(local.x, local.y);
+				}
+				v.uv2.x = (static_cast<float>(rect.x + padding) + local.x) / static_cast<float>(atlasWidth);
+				v.uv2.y = (static_cast<float>(rect.y + padding) + local.y) / static_cast<float>(atlasHeight);
+			}
+			// Boxes store the old (projected) start in x2/y2 and the final position and size in lightmap coordinates
+			box.x2 = box.x;
+			box.y2 = box.y;
+			box.swap = rect.rotated;
+			if (rect.rotated) {
+				std::swap(box.w, box.h);
+			}
+			box.x = static_cast<float>(rect.x + padding) / static_cast<float>(atlasWidth);
+			box.y = static_cast<float>(rect.y + padding) / static_cast<float>(atlasHeight);
+			box.w = box.w * texelsPerUnit / static_cast<float>(atlasWidth);
+			box.h = box.h * texelsPerUnit / static_cast<float>(atlasHeight);
+		}
+	}
+	lightmapAtlas.efficiency = static_cast<float>(static_cast<double>(usedTexels) / (static_cast<double>(atlasWidth) * atlasHeight));
+	std::cout << "Lightmap atlas: " << atlasWidth << "x" << atlasHeight << ", " << rects.size() << " charts at " << texelsPerUnit << " texels per unit, " << lightmapAtlas.efficiency * 100.0f << "% used" << std::endl;
+
+	if (!lightmapCacheFile.empty()) {
+		cache.atlas = lightmapAtlas;
+		for (size_t i = 0; i < primitives.size(); i++) {
+			const Primitive* primitive = primitives[i];
+			cache.primitives[i].charts = std::move(primitiveCharts[i]);
+			cache.primitives[i].uv2.resize(primitive->vertexCount);
+			for (uint32_t v = 0; v < primitive->vertexCount; v++) {
+				cache.primitives[i].uv2[v] = glm::vec2(vertexBuffer[primitive->firstVertex + v].uv2);
+			}
+		}
+		for (size_t i = 0; i < boxes.size(); i++) {
+			cache.primitives[chartPrimitives[i]].boxes = boxes[i];
+		}
+		if (!writeLightmapCache(lightmapCacheFile, cache)) {
+			std::cout << "Could not write lightmap cache " << lightmapCacheFile << std::endl;
+		}
+	}
+}
+
+/*
+	Applies the pre-transform, vertex color and y-flip file loading flags to the vertices of all primitives
+*/
+void vkglTF::Model::preprocessVertices(std::vector<Vertex>& vertexBuffer, uint32_t fileLoadingFlags)
+{
+	if ((fileLoadingFlags & FileLoadingFlags::PreTransformVertices) || (fileLoadingFlags & FileLoadingFlags::PreMultiplyVertexColors) || (fileLoadingFlags & FileLoadingFlags::FlipY)) {
+		const bool preTransform = fileLoadingFlags & FileLoadingFlags::PreTransformVertices;
+		const bool preMultiplyColor = fileLoadingFlags & FileLoadingFlags::PreMultiplyVertexColors;
+		const bool flipY = fileLoadingFlags & FileLoadingFlags::FlipY;
 		for (Node* node : linearNodes) {
 			if (node->mesh) {
+				const glm::mat4 localMatrix = node->worldMatrix;
 				for (Primitive* primitive : node->mesh->primitives) {
-					std::vector<Face> tempFaces;
-					std::vector<Box> tempBoxes;
-					int trianglesNum = primitive->indexCount / 3;
-					for (uint32_t i = 0; i < trianglesNum; i++) 
-					{
-						//calc faces
-						int vi0 = indexBuffer[primitive->firstIndex + i * 3 + 0];
-						int vi1 = indexBuffer[primitive->firstIndex + i * 3 + 1];
-						int vi2 = indexBuffer[primitive->firstIndex + i * 3 + 2];
-						Vertex& v0 = vertexBuffer[vi0];
-						Vertex& v1 = vertexBuffer[vi1];
-						Vertex& v2 = vertexBuffer[vi2];
-						Face::Triangle tTriangle;
-						tTriangle.normal = glm::normalize(glm::cross(v2.pos - v0.pos, v1.pos - v0.pos));
-						tTriangle.distance = glm::dot(tTriangle.normal, v0.pos);
-						tTriangle.vertices.resize(3);
-						tTriangle.vertices[0] = vi0;
-						tTriangle.vertices[1] = vi1;
-						tTriangle.vertices[2] = vi2;
-						if (tTriangle.normal[1] * tTriangle.normal[1] < tTriangle.normal[0] * tTriangle.normal[0] &&
-							tTriangle.normal[2] * tTriangle.normal[2] < tTriangle.normal[0] * tTriangle.normal[0]) {
-							tTriangle.side = 0;//max n-x
-						}
-						else if (tTriangle.normal[0] * tTriangle.normal[0] < tTriangle.normal[1] * tTriangle.normal[1] &&
-							tTriangle.normal[2] * tTriangle.normal[2] < tTriangle.normal[1] * tTriangle.normal[1])
-						{
-							tTriangle.side = 1;//max n-y
-						}
-						else
-						{
-							tTriangle.side = 2;//max n-z
-						}
-
-						int faceId = -1;
-						bool findFace = false;
-						for (int fi = 0; fi < tempFaces.size(); fi++)
-						{
-							if (FindFaceSameVertex(tempFaces[fi], vi0) ||
-								FindFaceSameVertex(tempFaces[fi], vi1) ||
-								FindFaceSameVertex(tempFaces[fi], vi2))
-							{
-								findFace = true;
-								faceId = fi;
-								break;
-							}
-						}
-						if (findFace)
-						{
-							tempFaces[faceId].triangles.push_back(tTriangle);
-						}
-						else
-						{
-							Face tFace;
-							tFace.triangles.push_back(tTriangle);
-							tempFaces.push_back(std::move(tFace));
-						}
-					}
-					int faceNum = tempFaces.size();
-					//calc boxes
-					for (uint32_t i = 0; i < faceNum; i++) {
-						if (i == 5)
-						{
-							std::cout << "";
-						}
-						Box tBox;
-						tBox.face = i;
-						tBox.swap = false;
-						int tNum = tempFaces[i].triangles.size();
-						int dealVertNum = 0;
-						for (int tTid = 0; tTid < tNum; tTid++)
-						{
-							for (int vi = 0; vi < 3; vi++)
-							{
-								Vertex& v = vertexBuffer[tempFaces[i].triangles[tTid].vertices[vi]];
-								v.uv2[0] = v.pos[tempFaces[i].triangles[tTid].side == 0 ? 1 : 0] * LIGHTMAP_SCALE;
-								v.uv2[1] = v.pos[tempFaces[i].triangles[tTid].side == 2 ? 1 : 2] * LIGHTMAP_SCALE;
-								if (dealVertNum == 0)
-								{
-									tBox.x = v.uv2[0];
-									tBox.x2 = v.uv2[0];
-									tBox.y = v.uv2[1];
-									tBox.y2 = v.uv2[1];
-								}
-								else
-								{
-									tBox.x = std::min(tBox.x, v.uv2[0]);
-									tBox.x2 = std::max(tBox.x2, v.uv2[0]);
-									tBox.y = std::min(tBox.y, v.uv2[1]);
-									tBox.y2 = std::max(tBox.y2, v.uv2[1]);
-								}
-								dealVertNum++;
-							}
-						}
-						//ensure y dir length is larger than x dir
-						if ((tBox.x2 - tBox.x) > (tBox.y2 - tBox.y))
-						{
-							for (int tTid = 0; tTid < tNum; tTid++)
-							{
-								for (int vi = 0; vi < 3; vi++)
-								{
-									Vertex& v = vertexBuffer[tempFaces[i].triangles[tTid].vertices[vi]];
-									auto temp = v.uv2[0];
-									v.uv2[0] = v.uv2[1];
-									v.uv2[1] = temp;
-								}
-							}
-							auto temp = tBox.x;
-							tBox.x = tBox.y;
-							tBox.y = temp;
-							temp = tBox.x2;
-							tBox.x2 = tBox.y2;
-							tBox.y2 = temp;
-							tBox.swap = true;
-						}
-						tBox.w = tBox.x2 - tBox.x;
-						tBox.h = tBox.y2 - tBox.y;
-						if (tBox.h > 1.0)
-						{
-							std::cout << "h attension!" << std::endl;
+					for (uint32_t i = 0; i < primitive->vertexCount; i++) {
+						Vertex& vertex = vertexBuffer[primitive->firstVertex + i];
+						// Pre-transform vertex positions by node-hierarchy
+						if (preTransform) {
+							vertex.pos = glm::vec3(localMatrix * glm::vec4(vertex.pos, 1.0f));
+							vertex.normal = glm::normalize(glm::mat3(localMatrix) * vertex.normal);
 						}
-						tempBoxes.push_back(tBox);
-					}//face loop to generate box
-					//x dir larger to shorter...
-					std::sort(tempBoxes.begin(), tempBoxes.end(), [&](const Box& lhs, const Box& rhs) { return lhs.w > rhs.w; });
-					float padding = LIGHTMAP_PADDING;
-					auto x = padding, y = padding;
-					auto rowSize = 0.0f;
-					auto rowHeight = 1.0f;
-					//Adjust box position according to padding, 2D box Packing:larger first,y first
-					for (int i = 0; i < faceNum; i++)
-					{
-						int tNum = tempFaces[tempBoxes[i].face].triangles.size();
-						if (y + tempBoxes[i].h > rowHeight - padding)
-						{
-							y = padding;
-							x += rowSize + padding;
-							rowSize = 0.0;
+						// Flip Y-Axis of vertex positions
+						if (flipY) {
+							vertex.pos.y *= -1.0f;
+							vertex.normal.y *= -1.0f;
 						}
-						rowSize = std::max(rowSize, tempBoxes[i].w);//y dir maybe n boxes, rowSize records the first of these n boxes, for x start of next y dir boxes
-						float offset[2] = { x - tempBoxes[i].x, y - tempBoxes[i].y };//offset for move box start at (x,y);	
-						std::vector<int> dealIds;
-						for (int tTid = 0; tTid < tNum; tTid++)
-						{
-							for (int vi = 0; vi < 3; vi++)
-							{
-								auto& vIds = tempFaces[tempBoxes[i].face].triangles[tTid].vertices;
-								if (std::find(dealIds.begin(), dealIds.end(), vIds[vi]) == dealIds.end())
-								{
-									Vertex& v = vertexBuffer[vIds[vi]];
-									v.uv2.x += offset[0];
-									v.uv2.y += offset[1];
-									dealIds.push_back(vIds[vi]);
-									if (v.uv2.y > 1)
-									{
-										std::cout << "attension!" << std::endl;
-									}
-								}		
-							}
+						// Pre-Multiply vertex colors with material base color
+						if (preMultiplyColor) {
+							vertex.color = primitive->material.baseColorFactor * vertex.color;
 						}
-						tempBoxes[i].x2 = tempBoxes[i].x;
-						tempBoxes[i].y2 = tempBoxes[i].y;//old start racord;
-						tempBoxes[i].x = x;
-						tempBoxes[i].y = y;
-						y += tempBoxes[i].h + padding;//change y for packing box in y dir;
 					}
+				}
+			}
+		}
+	}
+}
 
-					////CPU CALC LIGHTMAP VALUE ACCORDING BOXES COORDINATES
+/*
+	Bakes the irradiance for the lightmap atlas created by calcLightmapUV on the CPU and writes it to lightmapSettings.bakeFile
+	Vertex colors are used as the surface albedo, so PreMultiplyVertexColors should be set for textured materials
+*/
+bool vkglTF::Model::bakeLightmap(const std::vector<uint32_t>& indexBuffer, const std::vector<Vertex>& vertexBuffer, bool preTransformed)
+{
+	if ((lightmapAtlas.width == 0) || (lightmapAtlas.height == 0)) {
+		return false;
+	}
 
-					faces.push_back(std::move(tempFaces));
-					boxes.push_back(std::move(tempBoxes));
+	// The scene is baked in world space, vertices of models that haven't been pre-transformed are moved by their node's matrix
+	vks::lightmap::BakeInput input;
+	input.positions.resize(vertexBuffer.size());
+	input.normals.resize(vertexBuffer.size());
+	input.albedo.resize(vertexBuffer.size());
+	input.lightmapUV.resize(vertexBuffer.size());
+	for (size_t i = 0; i < vertexBuffer.size(); i++) {
+		const Vertex& vertex = vertexBuffer[i];
+		input.positions[i] = vertex.pos;
+		input.normals[i] = vertex.normal;
+		input.albedo[i] = glm::vec3(vertex.color);
+		input.lightmapUV[i] = glm::vec2(vertex.uv2);
+	}
+	for (Node* node : linearNodes) {
+		if (!node->mesh) {
+			continue;
+		}
+		for (Primitive* primitive : node->mesh->primitives) {
+			if (!preTransformed) {
+				for (uint32_t i = primitive->firstVertex; i < primitive->firstVertex + primitive->vertexCount; i++) {
+					input.positions[i] = glm::vec3(node->worldMatrix * glm::vec4(input.positions[i], 1.0f));
+					input.normals[i] = glm::normalize(glm::mat3(node->worldMatrix) * input.normals[i]);
 				}
 			}
+			input.indices.insert(input.indices.end(), indexBuffer.begin() + primitive->firstIndex, indexBuffer.begin() + primitive->firstIndex + primitive->indexCount);
 		}
+	}
 
-		//build box map
+	auto tStart = std::chrono::high_resolution_clock::now();
+	vks::lightmap::Baker baker(input, lightmapSettings.bake);
+	std::vector<glm::vec4> texels = baker.bake(lightmapAtlas.width, lightmapAtlas.height);
+	auto tDuration = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+	if (!vks::lightmap::writeKTX(lightmapSettings.bakeFile, texels, lightmapAtlas.width, lightmapAtlas.height)) {
+		std::cerr << "Could not write lightmap \"" << lightmapSettings.bakeFile << "\"" << std::endl;
+		return false;
 	}
+	std::cout << "Baked " << lightmapAtlas.width << "x" << lightmapAtlas.height << " lightmap with " << lightmapSettings.bake.samples << " samples per texel in " << tDuration << " ms to " << lightmapSettings.bakeFile << std::endl;
+	return true;
+}
 
-	auto t = sizeof(float);
-	size_t vertexBufferSize = vertexBuffer.size() * sizeof(Vertex);
-	size_t indexBufferSize = indexBuffer.size() * sizeof(uint32_t);
-	indices.count = static_cast<uint32_t>(indexBuffer.size());
-	vertices.count = static_cast<uint32_t>(vertexBuffer.size());
+/*
+	Links skins to their nodes and calculates the initial pose, called once the node hierarchy has been created
+*/
+void vkglTF::Model::setupNodes()
+{
+	// Assign skins
+	for (auto node : linearNodes) {
+		if (node->skinIndex > -1) {
+			node->skin = skins[node->skinIndex];
+		}
+	}
 
-	assert((vertexBufferSize > 0) && (indexBufferSize > 0));
+	// Flatten the node hierarchy so that parents are always stored before their children
+	transformOrder.clear();
+	transformOrder.reserve(linearNodes.size());
+	transformOrder.insert(transformOrder.end(), nodes.begin(), nodes.end());
+	for (size_t i = 0; i < transformOrder.size(); i++) {
+		Node* node = transformOrder[i];
+		transformOrder.insert(transformOrder.end(), node->children.begin(), node->children.end());
+	}
 
-	struct StagingBuffer {
-		VkBuffer buffer;
-		VkDeviceMemory memory;
-	} vertexStaging, indexStaging;
+	// Initial pose, without a device (offline lightmap baking) there are no node buffers and only the world matrices are calculated
+	if (device) {
+		allocateNodeBuffer();
+	}
+	updateNodeMatrices();
+	if (device) {
+		for (auto node : nodes) {
+			node->update();
+		}
+	}
+}
 
-	// Create staging buffers
-	// Vertex data
-	VK_CHECK_RESULT(device->createBuffer(
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		vertexBufferSize,
-		&vertexStaging.buffer,
-		&vertexStaging.memory,
-		vertexBuffer.data()));
-	// Index data
-	VK_CHECK_RESULT(device->createBuffer(
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		indexBufferSize,
-		&indexStaging.buffer,
-		&indexStaging.memory,
-		indexBuffer.data()));
+/*
+	Suballocates the NodeUniformBlock and joint palette of every mesh from a single persistently mapped buffer
+	Slices are aligned for use as dynamic uniform buffers and storage buffers, the descriptor range covers the largest slice
+*/
+void vkglTF::Model::allocateNodeBuffer()
+{
+	const VkPhysicalDeviceLimits& limits = device->properties.limits;
+	// Slices are at least vec4 aligned, so the compute skinning pass can address joint matrices as vec4 columns
+	const VkDeviceSize alignment = std::max({ limits.minUniformBufferOffsetAlignment, limits.minStorageBufferOffsetAlignment, static_cast<VkDeviceSize>(16) });
+	VkDeviceSize offset = 0;
+	VkDeviceSize range = 0;
+	for (Node* node : linearNodes) {
+		if (!node->mesh) {
+			continue;
+		}
+		Mesh* mesh = node->mesh;
+		mesh->jointCount = node->skin ? static_cast<uint32_t>(std::min(node->skin->joints.size(), node->skin->inverseBindMatrices.size())) : 0;
+		const VkDeviceSize sliceSize = sizeof(NodeUniformBlock) + mesh->jointCount * sizeof(glm::mat4);
+		offset = (offset + alignment - 1) / alignment * alignment;
+		mesh->uniformBuffer.dynamicOffset = static_cast<uint32_t>(offset);
+		mesh->uniformBuffer.descriptor = { VK_NULL_HANDLE, offset, sliceSize };
+		offset += sliceSize;
+		range = std::max(range, sliceSize);
+	}
+	if (range == 0) {
+		return;
+	}
+	// The last slice is bound with the full descriptor range, so the buffer is padded to cover it
+	const VkDeviceSize lastOffset = (offset - 1) / alignment * alignment;
+	const VkDeviceSize bufferSize = std::max(offset, lastOffset + range);
+	VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &nodeBuffer, bufferSize));
+	VK_CHECK_RESULT(nodeBuffer.map());
+	memset(nodeBuffer.mapped, 0, static_cast<size_t>(bufferSize));
+	// Joints beyond the uniform buffer range limit can only be read through storage buffer bindings of nodeBuffer
+	nodeBuffer.descriptor.range = std::min<VkDeviceSize>(range, limits.maxUniformBufferRange);
+	for (Node* node : linearNodes) {
+		if (!node->mesh) {
+			continue;
+		}
+		Mesh* mesh = node->mesh;
+		mesh->uniformBuffer.buffer = nodeBuffer.buffer;
+		mesh->uniformBuffer.descriptor.buffer = nodeBuffer.buffer;
+		mesh->uniformBuffer.mapped = static_cast<char*>(nodeBuffer.mapped) + mesh->uniformBuffer.dynamicOffset;
+		NodeUniformBlock* block = static_cast<NodeUniformBlock*>(mesh->uniformBuffer.mapped);
+		block->matrix = glm::mat4(1.0f);
+		block->jointcount = static_cast<float>(mesh->jointCount);
+	}
+}
 
+/*
+	Creates the device local vertex and index buffers (and the meshlet storage buffers if meshlets have been generated) and records the copies from the staged data into copyCmd
+*/
+void vkglTF::Model::uploadGeometry(const StagingArena::Allocation& vertexStaging, VkDeviceSize vertexBufferSize, const StagingArena::Allocation& indexStaging, VkDeviceSize indexBufferSize, VkCommandBuffer copyCmd, StagingArena& staging)
+{
 	// Create device local buffers
-	// Vertex buffer
+	// Vertex buffer, skinned models can also be read and copied by the compute skinning pre-pass
+	const VkBufferUsageFlags skinningUsage = skins.empty() ? 0 : (VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
 	VK_CHECK_RESULT(device->createBuffer(
-	    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | memoryPropertyFlags,
+	    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | skinningUsage | memoryPropertyFlags,
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 		vertexBufferSize,
 		&vertices.buffer,
@@ -1521,123 +2753,1050 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device
 		&indices.memory));
 
 	// Copy from staging buffers
-	VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
 	VkBufferCopy copyRegion = {};
 
+	copyRegion.srcOffset = vertexStaging.offset;
 	copyRegion.size = vertexBufferSize;
 	vkCmdCopyBuffer(copyCmd, vertexStaging.buffer, vertices.buffer, 1, &copyRegion);
 
+	copyRegion.srcOffset = indexStaging.offset;
 	copyRegion.size = indexBufferSize;
 	vkCmdCopyBuffer(copyCmd, indexStaging.buffer, indices.buffer, 1, &copyRegion);
 
-	device->flushCommandBuffer(copyCmd, transferQueue, true);
+	// Meshlet data is uploaded to storage buffers to be read from task and mesh shaders
+	if (!meshletData.meshlets.empty()) {
+		auto uploadStorageBuffer = [&](StorageBuffer& storageBuffer, const void* data, VkDeviceSize size) {
+			StagingArena::Allocation stagingRegion = staging.allocate(size);
+			memcpy(stagingRegion.mapped, data, static_cast<size_t>(size));
+			VK_CHECK_RESULT(device->createBuffer(
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | memoryPropertyFlags,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				size,
+				&storageBuffer.buffer,
+				&storageBuffer.memory));
+			VkBufferCopy storageCopyRegion = { stagingRegion.offset, 0, size };
+			vkCmdCopyBuffer(copyCmd, stagingRegion.buffer, storageBuffer.buffer, 1, &storageCopyRegion);
+		};
+		// Triangle indices are padded so they can be read as 32 bit values
+		meshletData.triangles.resize((meshletData.triangles.size() + 3) & ~static_cast<size_t>(3), 0);
+		uploadStorageBuffer(meshletBuffers.meshlets, meshletData.meshlets.data(), meshletData.meshlets.size() * sizeof(vks::meshlets::Meshlet));
+		uploadStorageBuffer(meshletBuffers.bounds, meshletData.bounds.data(), meshletData.bounds.size() * sizeof(vks::meshlets::MeshletBounds));
+		uploadStorageBuffer(meshletBuffers.vertices, meshletData.vertices.data(), meshletData.vertices.size() * sizeof(uint32_t));
+		uploadStorageBuffer(meshletBuffers.triangles, meshletData.triangles.data(), meshletData.triangles.size());
+	}
+}
+
+void vkglTF::Model::setupDescriptors()
+{
+	// All meshes share a single dynamic uniform buffer descriptor
+	const uint32_t uboCount = (nodeBuffer.buffer != VK_NULL_HANDLE) ? 1 : 0;
+	uint32_t imageCount{ 0 };
+	for (auto material : materials) {
+		if (material.baseColorTexture != nullptr) {
+			imageCount++;
+		}
+	}
+	std::vector<VkDescriptorPoolSize> poolSizes = {
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, std::max(uboCount, 1u) },
+	};
+	if (imageCount > 0) {
+		if (descriptorBindingFlags & DescriptorBindingFlags::ImageBaseColor) {
+			poolSizes.push_back({ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageCount });
+		}
+		if (descriptorBindingFlags & DescriptorBindingFlags::ImageNormalMap) {
+			poolSizes.push_back({ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageCount });
+		}
+	}
+	VkDescriptorPoolCreateInfo descriptorPoolCI{};
+	descriptorPoolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptorPoolCI.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	descriptorPoolCI.pPoolSizes = poolSizes.data();
+	descriptorPoolCI.maxSets = std::max(uboCount + imageCount, 1u);
+	VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolCI, nullptr, &descriptorPool));
+
+	// Descriptors for per-node uniform buffers
+	{
+		// Layout is global, so only create if it hasn't already been created before
+		if (descriptorSetLayoutUbo == VK_NULL_HANDLE) {
+			std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT, 0),
+			};
+			VkDescriptorSetLayoutCreateInfo descriptorLayoutCI{};
+			descriptorLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+			descriptorLayoutCI.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+			descriptorLayoutCI.pBindings = setLayoutBindings.data();
+			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorLayoutCI, nullptr, &descriptorSetLayoutUbo));
+		}
+		if (uboCount > 0) {
+			VkDescriptorSetAllocateInfo descriptorSetAllocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayoutUbo, 1);
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &descriptorSetAllocInfo, &nodeDescriptorSet));
+			VkWriteDescriptorSet writeDescriptorSet = vks::initializers::writeDescriptorSet(nodeDescriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 0, &nodeBuffer.descriptor);
+			vkUpdateDescriptorSets(device->logicalDevice, 1, &writeDescriptorSet, 0, nullptr);
+			for (auto node : linearNodes) {
+				if (node->mesh) {
+					node->mesh->uniformBuffer.descriptorSet = nodeDescriptorSet;
+				}
+			}
+		}
+	}
+
+	// Descriptors for per-material images
+	{
+		// Layout is global, so only create if it hasn't already been created before
+		if (descriptorSetLayoutImage == VK_NULL_HANDLE) {
+			std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings{};
+			if (descriptorBindingFlags & DescriptorBindingFlags::ImageBaseColor) {
+				setLayoutBindings.push_back(vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, static_cast<uint32_t>(setLayoutBindings.size())));
+			}
+			if (descriptorBindingFlags & DescriptorBindingFlags::ImageNormalMap) {
+				setLayoutBindings.push_back(vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, static_cast<uint32_t>(setLayoutBindings.size())));
+			}
+			VkDescriptorSetLayoutCreateInfo descriptorLayoutCI{};
+			descriptorLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+			descriptorLayoutCI.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+			descriptorLayoutCI.pBindings = setLayoutBindings.data();
+			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorLayoutCI, nullptr, &descriptorSetLayoutImage));
+		}
+		for (auto& material : materials) {
+			if (material.baseColorTexture != nullptr) {
+				material.createDescriptorSet(descriptorPool, vkglTF::descriptorSetLayoutImage, descriptorBindingFlags);
+			}
+		}
+	}
+}
+
+/*
+	Cooked models
+	A cooked model stores the final state of a model after loading and processing a glTF file, so it can be loaded without parsing or converting anything:
+	header, textures, materials, nodes, skins, animations, meshlets, vertex and index data
+	Node references are stored as indices into the node list, which is written in transform order (parents before their children)
+	Large data blocks (pixels, vertices, indices) are 16 byte aligned, so they can be copied straight from the memory mapped file into staging memory
+*/
+
+const uint32_t cookedMagic = 0x43474b56; // "VKGC"
+const uint32_t cookedVersion = 3;
+const size_t cookedBlockAlignment = 16;
+
+enum CookedTextureType : uint32_t { CookedTextureRGBA8 = 0, CookedTextureKTX = 1 };
+// Material texture indices that don't refer to an entry in Model::textures
+const int32_t cookedTextureNone = -1;
+const int32_t cookedTextureEmpty = -2;
+
+void writeBinaryString(std::ofstream& file, const std::string& value)
+{
+	writeBinaryValue(file, static_cast<uint32_t>(value.size()));
+	file.write(value.data(), value.size());
+}
+
+void writeBinaryBlock(std::ofstream& file, const void* data, size_t size)
+{
+	const char padding[cookedBlockAlignment] = {};
+	writeBinaryValue(file, static_cast<uint64_t>(size));
+	file.write(padding, (cookedBlockAlignment - static_cast<size_t>(file.tellp()) % cookedBlockAlignment) % cookedBlockAlignment);
+	file.write(static_cast<const char*>(data), size);
+}
+
+/*
+	Bounds checked reads from a memory mapped cooked model, a truncated or corrupt file sets valid to false instead of reading past the end of the mapping
+*/
+struct CookedReader {
+	const unsigned char* data;
+	size_t size;
+	size_t offset = 0;
+	bool valid = true;
+
+	CookedReader(const unsigned char* data, size_t size) : data(data), size(size) {};
+
+	bool available(size_t count)
+	{
+		valid = valid && (count <= size - offset);
+		return valid;
+	}
+
+	template<typename T>
+	T value()
+	{
+		T result{};
+		if (available(sizeof(T))) {
+			memcpy(&result, data + offset, sizeof(T));
+			offset += sizeof(T);
+		}
+		return result;
+	}
+
+	template<typename T>
+	void vector(std::vector<T>& values)
+	{
+		const uint32_t count = value<uint32_t>();
+		if (available(static_cast<size_t>(count) * sizeof(T))) {
+			values.resize(count);
+			memcpy(values.data(), data + offset, values.size() * sizeof(T));
+			offset += values.size() * sizeof(T);
+		}
+	}
+
+	std::string string()
+	{
+		const uint32_t length = value<uint32_t>();
+		if (!available(length)) {
+			return std::string();
+		}
+		std::string result(reinterpret_cast<const char*>(data + offset), length);
+		offset += length;
+		return result;
+	}
+
+	// Returns a pointer to the aligned data block in the mapping without copying it
+	const unsigned char* block(size_t& blockSize)
+	{
+		blockSize = static_cast<size_t>(value<uint64_t>());
+		const size_t padding = (cookedBlockAlignment - offset % cookedBlockAlignment) % cookedBlockAlignment;
+		if (!available(padding) || !available(padding + blockSize)) {
+			blockSize = 0;
+			return nullptr;
+		}
+		const unsigned char* result = data + offset + padding;
+		offset += padding + blockSize;
+		return result;
+	}
+};
+
+void vkglTF::Model::writeCooked(const std::string& filename, const tinygltf::Model& gltfModel, uint32_t fileLoadingFlags, const std::vector<VertexComponent>& packedComponents, const void* vertexData, size_t vertexDataSize, const std::vector<uint32_t>& indexBuffer)
+{
+	std::ofstream file(filename, std::ios::binary);
+	if (!file.is_open()) {
+		std::cerr << "Could not write cooked model \"" << filename << "\"" << std::endl;
+		return;
+	}
+
+	writeBinaryValue(file, cookedMagic);
+	writeBinaryValue(file, cookedVersion);
+	writeBinaryValue(file, fileLoadingFlags);
+	writeBinaryValue(file, vertexStride);
+	writeBinaryValue(file, static_cast<uint32_t>(packedComponents.size()));
+	for (VertexComponent component : packedComponents) {
+		writeBinaryValue(file, static_cast<uint32_t>(component));
+	}
+	writeBinaryValue(file, static_cast<uint8_t>(metallicRoughnessWorkflow));
+	writeBinaryValue(file, lightmapAtlas);
+
+	// Textures, images have already been decoded for the upload, external ktx files are referenced by their uri
+	writeBinaryValue(file, static_cast<uint32_t>(textures.size()));
+	for (size_t i = 0; i < textures.size(); i++) {
+		const tinygltf::Image& image = gltfModel.images[i];
+		if (isKtxImage(image)) {
+			writeBinaryValue(file, CookedTextureKTX);
+			writeBinaryString(file, image.uri);
+			continue;
+		}
+		writeBinaryValue(file, CookedTextureRGBA8);
+		writeBinaryValue(file, static_cast<uint32_t>(image.width));
+		writeBinaryValue(file, static_cast<uint32_t>(image.height));
+		if (image.component == 3) {
+			std::vector<unsigned char> rgba(static_cast<size_t>(image.width) * image.height * 4, 255);
+			for (size_t p = 0; p < static_cast<size_t>(image.width) * image.height; p++) {
+				memcpy(&rgba[p * 4], &image.image[p * 3], 3);
+			}
+			writeBinaryBlock(file, rgba.data(), rgba.size());
+		} else {
+			writeBinaryBlock(file, image.image.data(), image.image.size());
+		}
+	}
+	// The empty texture is only created if images have been loaded
+	writeBinaryValue(file, static_cast<uint8_t>(emptyTexture.device != nullptr));
+
+	// Materials
+	auto textureIndex = [this](const Texture* texture) {
+		if (texture == nullptr) {
+			return cookedTextureNone;
+		}
+		if (texture == &emptyTexture) {
+			return cookedTextureEmpty;
+		}
+		return static_cast<int32_t>(texture - textures.data());
+	};
+	writeBinaryValue(file, static_cast<uint32_t>(materials.size()));
+	for (const Material& material : materials) {
+		writeBinaryValue(file, static_cast<uint32_t>(material.alphaMode));
+		writeBinaryValue(file, material.alphaCutoff);
+		writeBinaryValue(file, material.metallicFactor);
+		writeBinaryValue(file, material.roughnessFactor);
+		writeBinaryValue(file, material.baseColorFactor);
+		for (const Texture* texture : { material.baseColorTexture, material.metallicRoughnessTexture, material.normalTexture, material.occlusionTexture, material.emissiveTexture }) {
+			writeBinaryValue(file, textureIndex(texture));
+		}
+	}
+
+	// Nodes are written in transform order, so every parent is stored before its children and roots and siblings keep their order
+	std::unordered_map<const Node*, int32_t> linearIndex;
+	for (size_t i = 0; i < transformOrder.size(); i++) {
+		linearIndex[transformOrder[i]] = static_cast<int32_t>(i);
+	}
+	auto nodeIndex = [&linearIndex](const Node* node) {
+		return node ? linearIndex.at(node) : -1;
+	};
+	writeBinaryValue(file, static_cast<uint32_t>(transformOrder.size()));
+	for (const Node* node : transformOrder) {
+		writeBinaryValue(file, nodeIndex(node->parent));
+		writeBinaryValue(file, node->index);
+		writeBinaryString(file, node->name);
+		writeBinaryValue(file, node->matrix);
+		writeBinaryValue(file, node->translation);
+		writeBinaryValue(file, node->scale);
+		writeBinaryValue(file, node->rotation);
+		writeBinaryValue(file, node->skinIndex);
+		writeBinaryValue(file, static_cast<uint8_t>(node->mesh != nullptr));
+		if (!node->mesh) {
+			continue;
+		}
+		writeBinaryString(file, node->mesh->name);
+		writeBinaryValue(file, node->mesh->index);
+		writeBinaryValue(file, static_cast<uint32_t>(node->mesh->primitives.size()));
+		for (const Primitive* primitive : node->mesh->primitives) {
+			writeBinaryValue(file, primitive->firstIndex);
+			writeBinaryValue(file, primitive->indexCount);
+			writeBinaryValue(file, primitive->firstVertex);
+			writeBinaryValue(file, primitive->vertexCount);
+			writeBinaryValue(file, static_cast<uint32_t>(&primitive->material - materials.data()));
+			writeBinaryValue(file, primitive->dimensions.min);
+			writeBinaryValue(file, primitive->dimensions.max);
+			writeBinaryVector(file, primitive->lods);
+			writeBinaryValue(file, primitive->firstMeshlet);
+			writeBinaryValue(file, primitive->meshletCount);
+		}
+	}
+
+	// Skins
+	writeBinaryValue(file, static_cast<uint32_t>(skins.size()));
+	for (const Skin* skin : skins) {
+		writeBinaryString(file, skin->name);
+		writeBinaryValue(file, nodeIndex(skin->skeletonRoot));
+		std::vector<int32_t> joints;
+		for (const Node* joint : skin->joints) {
+			joints.push_back(nodeIndex(joint));
+		}
+		writeBinaryVector(file, joints);
+		writeBinaryVector(file, skin->inverseBindMatrices);
+	}
+
+	// Animations
+	writeBinaryValue(file, static_cast<uint32_t>(animations.size()));
+	for (const Animation& animation : animations) {
+		writeBinaryString(file, animation.name);
+		writeBinaryValue(file, animation.start);
+		writeBinaryValue(file, animation.end);
+		writeBinaryValue(file, static_cast<uint32_t>(animation.samplers.size()));
+		for (const AnimationSampler& sampler : animation.samplers) {
+			writeBinaryValue(file, static_cast<uint32_t>(sampler.interpolation));
+			writeBinaryVector(file, sampler.inputs);
+			writeBinaryVector(file, sampler.outputsVec4);
+		}
+		writeBinaryValue(file, static_cast<uint32_t>(animation.channels.size()));
+		for (const AnimationChannel& channel : animation.channels) {
+			writeBinaryValue(file, static_cast<uint32_t>(channel.path));
+			writeBinaryValue(file, nodeIndex(channel.node));
+			writeBinaryValue(file, channel.samplerIndex);
+		}
+	}
+
+	// Meshlets
+	writeBinaryVector(file, meshletData.meshlets);
+	writeBinaryVector(file, meshletData.bounds);
+	writeBinaryVector(file, meshletData.vertices);
+	writeBinaryVector(file, meshletData.triangles);
+
+	// Geometry in its final (optionally packed) layout
+	writeBinaryValue(file, static_cast<uint32_t>(vertices.count));
+	writeBinaryBlock(file, vertexData, vertexDataSize);
+	writeBinaryBlock(file, indexBuffer.data(), indexBuffer.size() * sizeof(uint32_t));
+
+	if (!file.good()) {
+		std::cerr << "Could not write cooked model \"" << filename << "\"" << std::endl;
+	}
+}
+
+void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device, VkQueue transferQueue, uint32_t fileLoadingFlags, float scale, const std::vector<VertexComponent>& packedComponents)
+{
+	tinygltf::Model gltfModel;
+	tinygltf::TinyGLTF gltfContext;
+	if (fileLoadingFlags & FileLoadingFlags::DontLoadImages) {
+		gltfContext.SetImageLoader(loadImageDataFuncEmpty, nullptr);
+	} else {
+		gltfContext.SetImageLoader(loadImageDataFunc, nullptr);
+	}
+#if defined(__ANDROID__)
+	// On Android all assets are packed with the apk in a compressed form, so we need to open them using the asset manager
+	// We let tinygltf handle this, by passing the asset manager of our app
+	tinygltf::asset_manager = androidApp->activity->assetManager;
+#endif
+	size_t pos = filename.find_last_of('/');
+	path = filename.substr(0, pos);
+#if defined(__ANDROID__)
+	// Assets are stored in the apk and can't be written to
+	lightmapCacheFile.clear();
+#else
+	lightmapCacheFile = lightmapSettings.cache ? filename + ".lmcache" : "";
+#endif
+
+	std::string error, warning;
+
+	this->device = device;
+
+#if defined(__ANDROID__)
+	// On Android all assets are packed with the apk in a compressed form, so we need to open them using the asset manager
+	// We let tinygltf handle this, by passing the asset manager of our app
+	tinygltf::asset_manager = androidApp->activity->assetManager;
+#endif
+	// Binary glTF files are memory mapped so their embedded buffer can be read in place, the mapping is released once the model has been uploaded
+	bool fileLoaded = false;
+	bool binary = (filename.size() > 4) && (filename.compare(filename.size() - 4, 4, ".glb") == 0);
+	vks::MappedFile mappedFile;
+	int binBuffer = -1;
+	const unsigned char* binData = nullptr;
+	if (binary) {
+#if defined(__ANDROID__)
+		fileLoaded = gltfContext.LoadBinaryFromFile(&gltfModel, &error, &warning, filename);
+#else
+		fileLoaded = loadBinaryMapped(gltfContext, gltfModel, error, warning, filename, path, !(fileLoadingFlags & FileLoadingFlags::DontLoadImages), mappedFile, binBuffer, binData);
+#endif
+	} else {
+		fileLoaded = gltfContext.LoadASCIIFromFile(&gltfModel, &error, &warning, filename);
+	}
+
+	bufferData.resize(gltfModel.buffers.size());
+	for (size_t i = 0; i < gltfModel.buffers.size(); i++) {
+		bufferData[i] = (static_cast<int>(i) == binBuffer) ? binData : gltfModel.buffers[i].data.data();
+	}
+
+	std::vector<uint32_t> indexBuffer;
+	std::vector<Vertex> vertexBuffer;
+
+	// All uploads for this model (images and geometry) are staged in a single arena and recorded into one command buffer that is submitted once
+	StagingArena staging(device);
+	VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+
+	if (fileLoaded) {
+		if (!(fileLoadingFlags & FileLoadingFlags::DontLoadImages)) {
+			// Streamed images are never decoded while loading, so they can't be cooked
+			if ((fileLoadingFlags & FileLoadingFlags::StreamTextures) && cookFile.empty()) {
+				loadStreamedImages(gltfModel, copyCmd, staging);
+			} else {
+				loadImages(gltfModel, device, copyCmd, staging);
+			}
+		}
+		loadMaterials(gltfModel);
+		const tinygltf::Scene &scene = gltfModel.scenes[gltfModel.defaultScene > -1 ? gltfModel.defaultScene : 0];
+		for (size_t i = 0; i < scene.nodes.size(); i++) {
+			const tinygltf::Node node = gltfModel.nodes[scene.nodes[i]];
+			loadNode(nullptr, node, scene.nodes[i], gltfModel, indexBuffer, vertexBuffer, scale);
+		}
+		if (gltfModel.animations.size() > 0) {
+			loadAnimations(gltfModel);
+		}
+		loadSkins(gltfModel);
+
+		setupNodes();
+	}
+	else {
+		vks::tools::exitFatal("Could not load glTF file \"" + filename + "\": " + error, -1);
+		return;
+	}
+
+	preTransformed = fileLoadingFlags & FileLoadingFlags::PreTransformVertices;
+
+	preprocessVertices(vertexBuffer, fileLoadingFlags);
+
+	for (auto extension : gltfModel.extensionsUsed) {
+		if (extension == "KHR_materials_pbrSpecularGlossiness") {
+			std::cout << "Required extension: " << extension;
+			metallicRoughnessWorkflow = false;
+		}
+	}
+
+	if (fileLoadingFlags & FileLoadingFlags::OptimizeVertexCache) {
+		optimizeVertexCache(indexBuffer, vertexBuffer);
+	}
+
+	//calcLMUV  only triangles
+	// Lightmap charts keep the triangle order but may split vertices, so this has to run after the vertices have been reordered and before anything that depends on the final vertices
+	if (isCalcLMUV) {
+		calcLightmapUV(indexBuffer, vertexBuffer);
+		if (!lightmapSettings.bakeFile.empty()) {
+			bakeLightmap(indexBuffer, vertexBuffer, fileLoadingFlags & FileLoadingFlags::PreTransformVertices);
+		}
+	}
+
+	// LODs and meshlets are generated from the final vertex positions, so errors and culling data match the pre-transformed vertices
+	if (fileLoadingFlags & FileLoadingFlags::GenerateLODs) {
+		generateLODs(indexBuffer, vertexBuffer);
+	}
+	if (fileLoadingFlags & FileLoadingFlags::GenerateMeshlets) {
+		generateMeshlets(indexBuffer, vertexBuffer);
+	}
+
+	this->packedComponents = packedComponents;
+	vertexStride = packedComponents.empty() ? sizeof(Vertex) : Vertex::packedStride(packedComponents);
+	size_t vertexBufferSize = vertexBuffer.size() * vertexStride;
+	size_t indexBufferSize = indexBuffer.size() * sizeof(uint32_t);
+	indices.count = static_cast<uint32_t>(indexBuffer.size());
+	vertices.count = static_cast<uint32_t>(vertexBuffer.size());
+
+	assert((vertexBufferSize > 0) && (indexBufferSize > 0));
+
+	// Stage vertex and index data
+	StagingArena::Allocation vertexStaging = staging.allocate(vertexBufferSize);
+	if (packedComponents.empty()) {
+		memcpy(vertexStaging.mapped, vertexBuffer.data(), vertexBufferSize);
+	} else {
+		// Vertices are packed straight into the staging buffer
+		uint8_t* dst = static_cast<uint8_t*>(vertexStaging.mapped);
+		for (const Vertex& vertex : vertexBuffer) {
+			Vertex::pack(vertex, packedComponents, dst);
+			dst += vertexStride;
+		}
+	}
+	StagingArena::Allocation indexStaging = staging.allocate(indexBufferSize);
+	memcpy(indexStaging.mapped, indexBuffer.data(), indexBufferSize);
+
+	// The cooked file is written from the staged data, so it contains the vertices in their final (optionally packed) layout
+	if (!cookFile.empty()) {
+		writeCooked(cookFile, gltfModel, fileLoadingFlags, packedComponents, vertexStaging.mapped, vertexBufferSize, indexBuffer);
+	}
+
+	uploadGeometry(vertexStaging, vertexBufferSize, indexStaging, indexBufferSize, copyCmd, staging);
+
+	// Submit all of the model's uploads at once, staging memory can be released after that
+	device->flushCommandBuffer(copyCmd, transferQueue, true);
+	staging.destroy();
+
+	bufferData.clear();
+	mappedFile.close();
+
+	getSceneDimensions();
+
+	setupDescriptors();
+}
+
+/*
+	Offline lightmap baking
+	Runs the CPU side of loadFromFile (geometry, node hierarchy and vertex pre-processing) followed by calcLightmapUV and bakeLightmap, no Vulkan objects are created
+*/
+bool vkglTF::Model::bakeLightmapFromFile(std::string filename, uint32_t fileLoadingFlags, float scale)
+{
+	tinygltf::Model gltfModel;
+	tinygltf::TinyGLTF gltfContext;
+	// Images are not needed, vertex colors (pre-multiplied with the material base color) are used as albedo
+	gltfContext.SetImageLoader(loadImageDataFuncEmpty, nullptr);
+	size_t pos = filename.find_last_of('/');
+	path = filename.substr(0, pos);
+	lightmapCacheFile = lightmapSettings.cache ? filename + ".lmcache" : "";
+
+	std::string error, warning;
+	bool binary = (filename.size() > 4) && (filename.compare(filename.size() - 4, 4, ".glb") == 0);
+	bool fileLoaded = binary ? gltfContext.LoadBinaryFromFile(&gltfModel, &error, &warning, filename) : gltfContext.LoadASCIIFromFile(&gltfModel, &error, &warning, filename);
+	if (!fileLoaded) {
+		std::cerr << "Could not load glTF file \"" << filename << "\": " << error << std::endl;
+		return false;
+	}
+	bufferData.resize(gltfModel.buffers.size());
+	for (size_t i = 0; i < gltfModel.buffers.size(); i++) {
+		bufferData[i] = gltfModel.buffers[i].data.data();
+	}
+
+	std::vector<uint32_t> indexBuffer;
+	std::vector<Vertex> vertexBuffer;
+	loadMaterials(gltfModel);
+	const tinygltf::Scene &scene = gltfModel.scenes[gltfModel.defaultScene > -1 ? gltfModel.defaultScene : 0];
+	for (size_t i = 0; i < scene.nodes.size(); i++) {
+		const tinygltf::Node node = gltfModel.nodes[scene.nodes[i]];
+		loadNode(nullptr, node, scene.nodes[i], gltfModel, indexBuffer, vertexBuffer, scale);
+	}
+	loadSkins(gltfModel);
+	setupNodes();
+	bufferData.clear();
+
+	preTransformed = fileLoadingFlags & FileLoadingFlags::PreTransformVertices;
+	preprocessVertices(vertexBuffer, fileLoadingFlags);
+	// Lightmap charts depend on the vertex order, so this has to match loadFromFile
+	if (fileLoadingFlags & FileLoadingFlags::OptimizeVertexCache) {
+		optimizeVertexCache(indexBuffer, vertexBuffer);
+	}
+	if (vertexBuffer.empty() || indexBuffer.empty()) {
+		std::cerr << "glTF file \"" << filename << "\" contains no geometry" << std::endl;
+		return false;
+	}
+	calcLightmapUV(indexBuffer, vertexBuffer);
+	return bakeLightmap(indexBuffer, vertexBuffer, preTransformed);
+}
+
+void vkglTF::Model::loadFromCooked(std::string filename, vks::VulkanDevice *device, VkQueue transferQueue)
+{
+	this->device = device;
+	size_t pos = filename.find_last_of('/');
+	path = filename.substr(0, pos);
+
+	// The cooked file is memory mapped and its data blocks are copied straight into staging memory
+	const unsigned char* fileData = nullptr;
+	size_t fileSize = 0;
+#if defined(__ANDROID__)
+	// Assets are compressed in the apk, so the file is read into memory instead
+	std::vector<unsigned char> assetData;
+	AAsset* asset = AAssetManager_open(androidApp->activity->assetManager, filename.c_str(), AASSET_MODE_STREAMING);
+	if (asset) {
+		assetData.resize(AAsset_getLength(asset));
+		AAsset_read(asset, assetData.data(), assetData.size());
+		AAsset_close(asset);
+		fileData = assetData.data();
+		fileSize = assetData.size();
+	}
+#else
+	vks::MappedFile mappedFile;
+	if (mappedFile.open(filename)) {
+		fileData = mappedFile.data();
+		fileSize = mappedFile.size();
+	}
+#endif
+	if (!fileData) {
+		vks::tools::exitFatal("Could not load cooked model \"" + filename + "\"", -1);
+		return;
+	}
+
+	CookedReader reader(fileData, fileSize);
+	if ((reader.value<uint32_t>() != cookedMagic) || (reader.value<uint32_t>() != cookedVersion)) {
+		vks::tools::exitFatal("\"" + filename + "\" is not a cooked model or has been cooked with a different version", -1);
+		return;
+	}
+	// File loading flags and packed vertex components have already been applied to the cooked data
+	preTransformed = reader.value<uint32_t>() & FileLoadingFlags::PreTransformVertices;
+	vertexStride = reader.value<uint32_t>();
+	packedComponents.clear();
+	const uint32_t packedComponentCount = reader.value<uint32_t>();
+	for (uint32_t i = 0; (i < packedComponentCount) && reader.valid; i++) {
+		const uint32_t component = reader.value<uint32_t>();
+		if (component > static_cast<uint32_t>(VertexComponent::UV2)) {
+			reader.valid = false;
+			break;
+		}
+		packedComponents.push_back(static_cast<VertexComponent>(component));
+	}
+	if (reader.valid && (vertexStride != (packedComponents.empty() ? sizeof(Vertex) : Vertex::packedStride(packedComponents)))) {
+		reader.valid = false;
+	}
+	metallicRoughnessWorkflow = reader.value<uint8_t>() != 0;
+	lightmapAtlas = reader.value<LightmapAtlas>();
+
+	StagingArena staging(device);
+	VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+
+	// Textures
+	const uint32_t textureCount = reader.value<uint32_t>();
+	for (uint32_t i = 0; (i < textureCount) && reader.valid; i++) {
+		vkglTF::Texture texture;
+		if (reader.value<uint32_t>() == CookedTextureKTX) {
+			tinygltf::Image image;
+			image.uri = reader.string();
+			texture.fromglTfImage(image, path, device, copyCmd, staging);
+		} else {
+			const uint32_t width = reader.value<uint32_t>();
+			const uint32_t height = reader.value<uint32_t>();
+			size_t size;
+			const unsigned char* pixels = reader.block(size);
+			if (!reader.valid || (size != static_cast<size_t>(width) * height * 4)) {
+				reader.valid = false;
+				break;
+			}
+			texture.fromRGBA8(pixels, width, height, device, copyCmd, staging);
+		}
+		texture.index = static_cast<uint32_t>(textures.size());
+		textures.push_back(texture);
+	}
+	if (reader.value<uint8_t>() != 0) {
+		createEmptyTexture(copyCmd, staging);
+	}
+
+	// Materials
+	auto materialTexture = [this](int32_t index) -> Texture* {
+		if (index == cookedTextureEmpty) {
+			return &emptyTexture;
+		}
+		if ((index < 0) || (static_cast<size_t>(index) >= textures.size())) {
+			return nullptr;
+		}
+		return &textures[index];
+	};
+	const uint32_t materialCount = reader.value<uint32_t>();
+	for (uint32_t i = 0; (i < materialCount) && reader.valid; i++) {
+		vkglTF::Material material(device);
+		material.alphaMode = static_cast<Material::AlphaMode>(reader.value<uint32_t>());
+		material.alphaCutoff = reader.value<float>();
+		material.metallicFactor = reader.value<float>();
+		material.roughnessFactor = reader.value<float>();
+		material.baseColorFactor = reader.value<glm::vec4>();
+		material.baseColorTexture = materialTexture(reader.value<int32_t>());
+		material.metallicRoughnessTexture = materialTexture(reader.value<int32_t>());
+		material.normalTexture = materialTexture(reader.value<int32_t>());
+		material.occlusionTexture = materialTexture(reader.value<int32_t>());
+		material.emissiveTexture = materialTexture(reader.value<int32_t>());
+		materials.push_back(material);
+	}
+
+	// Nodes are stored with parents before their children, so a node's parent has always been read before the node itself
+	const uint32_t nodeCount = reader.value<uint32_t>();
+	auto node = [this](int32_t index) -> Node* {
+		return ((index >= 0) && (static_cast<size_t>(index) < linearNodes.size())) ? linearNodes[index] : nullptr;
+	};
+	for (uint32_t i = 0; (i < nodeCount) && reader.valid; i++) {
+		const int32_t parentIndex = reader.value<int32_t>();
+		if ((parentIndex >= static_cast<int32_t>(i)) || (parentIndex < -1)) {
+			reader.valid = false;
+			break;
+		}
+		Node* newNode = new Node{};
+		linearNodes.push_back(newNode);
+		newNode->parent = node(parentIndex);
+		if (newNode->parent) {
+			newNode->parent->children.push_back(newNode);
+		} else {
+			nodes.push_back(newNode);
+		}
+		newNode->index = reader.value<uint32_t>();
+		newNode->name = reader.string();
+		newNode->matrix = reader.value<glm::mat4>();
+		newNode->translation = reader.value<glm::vec3>();
+		newNode->scale = reader.value<glm::vec3>();
+		newNode->rotation = reader.value<glm::quat>();
+		newNode->skinIndex = reader.value<int32_t>();
+		if (reader.value<uint8_t>() == 0) {
+			continue;
+		}
+		newNode->mesh = new Mesh(device);
+		newNode->mesh->name = reader.string();
+		newNode->mesh->index = reader.value<uint32_t>();
+		const uint32_t primitiveCount = reader.value<uint32_t>();
+		for (uint32_t p = 0; (p < primitiveCount) && reader.valid; p++) {
+			const uint32_t firstIndex = reader.value<uint32_t>();
+			const uint32_t indexCount = reader.value<uint32_t>();
+			const uint32_t firstVertex = reader.value<uint32_t>();
+			const uint32_t vertexCount = reader.value<uint32_t>();
+			const uint32_t material = reader.value<uint32_t>();
+			if (material >= materials.size()) {
+				reader.valid = false;
+				break;
+			}
+			// Primitives reference their material, so the material list must not change from here on
+			Primitive* newPrimitive = new Primitive(firstIndex, indexCount, materials[material]);
+			newPrimitive->firstVertex = firstVertex;
+			newPrimitive->vertexCount = vertexCount;
+			const glm::vec3 min = reader.value<glm::vec3>();
+			const glm::vec3 max = reader.value<glm::vec3>();
+			newPrimitive->setDimensions(min, max);
+			reader.vector(newPrimitive->lods);
+			newPrimitive->firstMeshlet = reader.value<uint32_t>();
+			newPrimitive->meshletCount = reader.value<uint32_t>();
+			newNode->mesh->primitives.push_back(newPrimitive);
+		}
+	}
+
+	// Skins
+	const uint32_t skinCount = reader.value<uint32_t>();
+	for (uint32_t i = 0; (i < skinCount) && reader.valid; i++) {
+		Skin* newSkin = new Skin{};
+		skins.push_back(newSkin);
+		newSkin->name = reader.string();
+		const int32_t skeletonRoot = reader.value<int32_t>();
+		newSkin->skeletonRoot = node(skeletonRoot);
+		std::vector<int32_t> joints;
+		reader.vector(joints);
+		// Joints are addressed by their position in the skin, so a joint that can't be resolved makes the whole file unusable
+		for (int32_t joint : joints) {
+			if (!node(joint)) {
+				reader.valid = false;
+				break;
+			}
+			newSkin->joints.push_back(node(joint));
+		}
+		if ((skeletonRoot != -1) && !newSkin->skeletonRoot) {
+			reader.valid = false;
+		}
+		reader.vector(newSkin->inverseBindMatrices);
+	}
+	for (Node* linearNode : linearNodes) {
+		if (linearNode->skinIndex >= static_cast<int32_t>(skins.size())) {
+			linearNode->skinIndex = -1;
+		}
+	}
+
+	// Animations
+	const uint32_t animationCount = reader.value<uint32_t>();
+	for (uint32_t i = 0; (i < animationCount) && reader.valid; i++) {
+		vkglTF::Animation animation{};
+		animation.name = reader.string();
+		animation.start = reader.value<float>();
+		animation.end = reader.value<float>();
+		const uint32_t samplerCount = reader.value<uint32_t>();
+		for (uint32_t s = 0; (s < samplerCount) && reader.valid; s++) {
+			vkglTF::AnimationSampler sampler{};
+			sampler.interpolation = static_cast<AnimationSampler::InterpolationType>(reader.value<uint32_t>());
+			reader.vector(sampler.inputs);
+			reader.vector(sampler.outputsVec4);
+			animation.samplers.push_back(sampler);
+		}
+		const uint32_t channelCount = reader.value<uint32_t>();
+		for (uint32_t c = 0; (c < channelCount) && reader.valid; c++) {
+			vkglTF::AnimationChannel channel{};
+			channel.path = static_cast<AnimationChannel::PathType>(reader.value<uint32_t>());
+			channel.node = node(reader.value<int32_t>());
+			channel.samplerIndex = reader.value<uint32_t>();
+			if (channel.node && (channel.samplerIndex < animation.samplers.size())) {
+				animation.channels.push_back(channel);
+			}
+		}
+		animations.push_back(animation);
+	}
+
+	// Meshlets
+	reader.vector(meshletData.meshlets);
+	reader.vector(meshletData.bounds);
+	reader.vector(meshletData.vertices);
+	reader.vector(meshletData.triangles);
+
+	// Geometry is uploaded as is
+	vertices.count = reader.value<uint32_t>();
+	size_t vertexBufferSize, indexBufferSize;
+	const unsigned char* vertexData = reader.block(vertexBufferSize);
+	const unsigned char* indexData = reader.block(indexBufferSize);
+	indices.count = static_cast<uint32_t>(indexBufferSize / sizeof(uint32_t));
+
+	// Ranges are only checked once the buffer sizes are known, a truncated or corrupt file would otherwise make the GPU read out of bounds
+	if (reader.valid && ((static_cast<uint64_t>(vertices.count) * vertexStride > vertexBufferSize) || (meshletData.bounds.size() != meshletData.meshlets.size()))) {
+		reader.valid = false;
+	}
+	auto inRange = [](uint32_t first, uint32_t count, uint64_t size) {
+		return static_cast<uint64_t>(first) + count <= size;
+	};
+	for (Node* linearNode : linearNodes) {
+		if (!reader.valid || !linearNode->mesh) {
+			continue;
+		}
+		for (const Primitive* primitive : linearNode->mesh->primitives) {
+			bool valid = inRange(primitive->firstIndex, primitive->indexCount, indices.count)
+				&& inRange(primitive->firstVertex, primitive->vertexCount, vertices.count)
+				&& inRange(primitive->firstMeshlet, primitive->meshletCount, meshletData.meshlets.size());
+			for (const Primitive::LOD& lod : primitive->lods) {
+				valid = valid && inRange(lod.firstIndex, lod.indexCount, indices.count);
+			}
+			if (!valid) {
+				reader.valid = false;
+				break;
+			}
+		}
+	}
+
+	if (!reader.valid || (vertexBufferSize == 0) || (indexBufferSize == 0)) {
+		vks::tools::exitFatal("Cooked model \"" + filename + "\" is incomplete or corrupt", -1);
+		return;
+	}
+
+	StagingArena::Allocation vertexStaging = staging.allocate(vertexBufferSize);
+	memcpy(vertexStaging.mapped, vertexData, vertexBufferSize);
+	StagingArena::Allocation indexStaging = staging.allocate(indexBufferSize);
+	memcpy(indexStaging.mapped, indexData, indexBufferSize);
+
+	setupNodes();
+	uploadGeometry(vertexStaging, vertexBufferSize, indexStaging, indexBufferSize, copyCmd, staging);
+
+	device->flushCommandBuffer(copyCmd, transferQueue, true);
+	staging.destroy();
+
+	getSceneDimensions();
+
+	setupDescriptors();
+}
+
+void vkglTF::Model::bindBuffers(VkCommandBuffer commandBuffer)
+{
+	const VkDeviceSize offsets[1] = {0};
+	const VkBuffer vertexBuffer = drawVertexBuffer();
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, offsets);
+	vkCmdBindIndexBuffer(commandBuffer, indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+	buffersBound = true;
+}
 
-	vkDestroyBuffer(device->logicalDevice, vertexStaging.buffer, nullptr);
-	vkFreeMemory(device->logicalDevice, vertexStaging.memory, nullptr);
-	vkDestroyBuffer(device->logicalDevice, indexStaging.buffer, nullptr);
-	vkFreeMemory(device->logicalDevice, indexStaging.memory, nullptr);
+/*
+	Compute skinning
+*/
 
-	getSceneDimensions();
+VkBuffer vkglTF::Model::drawVertexBuffer() const
+{
+	return computeSkinning.frames.empty() ? vertices.buffer : computeSkinning.frames[computeSkinning.currentFrame].buffer;
+}
 
-	// Setup descriptors
-	uint32_t uboCount{ 0 };
-	uint32_t imageCount{ 0 };
-	for (auto node : linearNodes) {
-		if (node->mesh) {
-			uboCount++;
-		}
+// Push constant block of skinning.comp, offsets and strides are in floats (or vec4s for the node buffer)
+struct SkinningPushConstants {
+	uint32_t firstVertex;
+	uint32_t vertexCount;
+	uint32_t matrixOffset;
+	uint32_t jointOffset;
+	uint32_t jointCount;
+	uint32_t vertexStride;
+	uint32_t positionOffset;
+	uint32_t normalOffset;
+	uint32_t tangentOffset;
+	uint32_t joint0Offset;
+	uint32_t weight0Offset;
+};
+
+void vkglTF::Model::prepareComputeSkinning(const VkPipelineShaderStageCreateInfo& shaderStage, VkQueue queue, VkPipelineCache pipelineCache, uint32_t frameCount)
+{
+	if (skins.empty() || (nodeBuffer.buffer == VK_NULL_HANDLE)) {
+		return;
 	}
-	for (auto material : materials) {
-		if (material.baseColorTexture != nullptr) {
-			imageCount++;
+	if (vertexStride != sizeof(Vertex)) {
+		std::cout << "Compute skinning requires the default vertex layout, skinning pre-pass disabled" << std::endl;
+		return;
+	}
+	frameCount = std::max(frameCount, 1u);
+	computeSkinning.frames.resize(frameCount);
+	computeSkinning.currentFrame = 0;
+
+	// The skinned vertex buffers start as copies of the source vertices, the pre-pass only rewrites positions, normals and tangents of skinned meshes
+	const VkDeviceSize vertexBufferSize = static_cast<VkDeviceSize>(vertices.count) * vertexStride;
+	VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+	for (auto& frame : computeSkinning.frames) {
+		VK_CHECK_RESULT(device->createBuffer(
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | memoryPropertyFlags,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			vertexBufferSize,
+			&frame.buffer,
+			&frame.memory));
+		VkBufferCopy copyRegion{ 0, 0, vertexBufferSize };
+		vkCmdCopyBuffer(copyCmd, vertices.buffer, frame.buffer, 1, &copyRegion);
+		// The node buffer is rewritten by the CPU for every animation update, so with several frames in flight each frame skins from its own copy
+		if (frameCount > 1) {
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &frame.joints, nodeBuffer.size));
+			VK_CHECK_RESULT(frame.joints.map());
 		}
 	}
-	std::vector<VkDescriptorPoolSize> poolSizes = {
-		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, uboCount },
+	device->flushCommandBuffer(copyCmd, queue, true);
+
+	std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+		// Binding 0 : Source vertices
+		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+		// Binding 1 : Skinned vertices
+		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+		// Binding 2 : Node buffer with the node and joint matrices
+		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
 	};
-	if (imageCount > 0) {
-		if (descriptorBindingFlags & DescriptorBindingFlags::ImageBaseColor) {
-			poolSizes.push_back({ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageCount });
-		}
-		if (descriptorBindingFlags & DescriptorBindingFlags::ImageNormalMap) {
-			poolSizes.push_back({ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageCount });
+	VkDescriptorSetLayoutCreateInfo descriptorLayoutCI = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorLayoutCI, nullptr, &computeSkinning.descriptorSetLayout));
+
+	VkDescriptorPoolSize poolSize = vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 * frameCount);
+	VkDescriptorPoolCreateInfo descriptorPoolCI = vks::initializers::descriptorPoolCreateInfo(1, &poolSize, frameCount);
+	VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolCI, nullptr, &computeSkinning.descriptorPool));
+	for (auto& frame : computeSkinning.frames) {
+		VkDescriptorSetAllocateInfo descriptorSetAllocInfo = vks::initializers::descriptorSetAllocateInfo(computeSkinning.descriptorPool, &computeSkinning.descriptorSetLayout, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &descriptorSetAllocInfo, &frame.descriptorSet));
+		VkDescriptorBufferInfo bufferInfos[3] = {
+			{ vertices.buffer, 0, vertexBufferSize },
+			{ frame.buffer, 0, vertexBufferSize },
+			{ (frameCount > 1) ? frame.joints.buffer : nodeBuffer.buffer, 0, VK_WHOLE_SIZE },
+		};
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets;
+		for (uint32_t i = 0; i < 3; i++) {
+			writeDescriptorSets.push_back(vks::initializers::writeDescriptorSet(frame.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, i, &bufferInfos[i]));
 		}
+		vkUpdateDescriptorSets(device->logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
 	}
-	VkDescriptorPoolCreateInfo descriptorPoolCI{};
-	descriptorPoolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	descriptorPoolCI.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
-	descriptorPoolCI.pPoolSizes = poolSizes.data();
-	descriptorPoolCI.maxSets = uboCount + imageCount;
-	VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolCI, nullptr, &descriptorPool));
 
-	// Descriptors for per-node uniform buffers
-	{
-		// Layout is global, so only create if it hasn't already been created before
-		if (descriptorSetLayoutUbo == VK_NULL_HANDLE) {
-			std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
-				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0),
-			};
-			VkDescriptorSetLayoutCreateInfo descriptorLayoutCI{};
-			descriptorLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-			descriptorLayoutCI.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
-			descriptorLayoutCI.pBindings = setLayoutBindings.data();
-			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorLayoutCI, nullptr, &descriptorSetLayoutUbo));
-		}
-		for (auto node : nodes) {
-			prepareNodeDescriptor(node, descriptorSetLayoutUbo);
-		}
+	VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(SkinningPushConstants), 0);
+	VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::pipelineLayoutCreateInfo(&computeSkinning.descriptorSetLayout, 1);
+	pipelineLayoutCI.pushConstantRangeCount = 1;
+	pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+	VK_CHECK_RESULT(vkCreatePipelineLayout(device->logicalDevice, &pipelineLayoutCI, nullptr, &computeSkinning.pipelineLayout));
+	VkComputePipelineCreateInfo computePipelineCI = vks::initializers::computePipelineCreateInfo(computeSkinning.pipelineLayout, 0);
+	computePipelineCI.stage = shaderStage;
+	VK_CHECK_RESULT(vkCreateComputePipelines(device->logicalDevice, pipelineCache, 1, &computePipelineCI, nullptr, &computeSkinning.pipeline));
+}
+
+void vkglTF::Model::recordComputeSkinning(VkCommandBuffer commandBuffer, uint32_t frame)
+{
+	if ((computeSkinning.pipeline == VK_NULL_HANDLE) || (frame >= computeSkinning.frames.size())) {
+		return;
+	}
+	ComputeSkinning::Frame& skinningFrame = computeSkinning.frames[frame];
+	computeSkinning.currentFrame = frame;
+	if (skinningFrame.joints.mapped) {
+		// The frame's previous submission has finished once its command buffer is recorded again, so its copy can be overwritten
+		memcpy(skinningFrame.joints.mapped, nodeBuffer.mapped, static_cast<size_t>(nodeBuffer.size));
 	}
 
-	// Descriptors for per-material images
-	{
-		// Layout is global, so only create if it hasn't already been created before
-		if (descriptorSetLayoutImage == VK_NULL_HANDLE) {
-			std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings{};
-			if (descriptorBindingFlags & DescriptorBindingFlags::ImageBaseColor) {
-				setLayoutBindings.push_back(vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, static_cast<uint32_t>(setLayoutBindings.size())));
-			}
-			if (descriptorBindingFlags & DescriptorBindingFlags::ImageNormalMap) {
-				setLayoutBindings.push_back(vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, static_cast<uint32_t>(setLayoutBindings.size())));
-			}
-			VkDescriptorSetLayoutCreateInfo descriptorLayoutCI{};
-			descriptorLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-			descriptorLayoutCI.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
-			descriptorLayoutCI.pBindings = setLayoutBindings.data();
-			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorLayoutCI, nullptr, &descriptorSetLayoutImage));
+	// Vertex fetches of earlier draws reading this frame's buffer must be done before the skinned vertices are overwritten
+	VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
+	bufferBarrier.buffer = skinningFrame.buffer;
+	bufferBarrier.size = VK_WHOLE_SIZE;
+	bufferBarrier.srcAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+	bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computeSkinning.pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computeSkinning.pipelineLayout, 0, 1, &skinningFrame.descriptorSet, 0, nullptr);
+	SkinningPushConstants pushConstants{};
+	pushConstants.vertexStride = vertexStride / sizeof(float);
+	pushConstants.positionOffset = offsetof(Vertex, pos) / sizeof(float);
+	pushConstants.normalOffset = offsetof(Vertex, normal) / sizeof(float);
+	pushConstants.tangentOffset = offsetof(Vertex, tangent) / sizeof(float);
+	pushConstants.joint0Offset = offsetof(Vertex, joint0) / sizeof(float);
+	pushConstants.weight0Offset = offsetof(Vertex, weight0) / sizeof(float);
+	for (Node* node : linearNodes) {
+		if (!node->skin || !node->mesh || (node->mesh->jointCount == 0) || node->mesh->primitives.empty()) {
+			continue;
 		}
-		for (auto& material : materials) {
-			if (material.baseColorTexture != nullptr) {
-				material.createDescriptorSet(descriptorPool, vkglTF::descriptorSetLayoutImage, descriptorBindingFlags);
-			}
+		// The primitives of a mesh are stored consecutively, so the whole mesh is skinned with a single dispatch
+		uint32_t firstVertex = UINT32_MAX;
+		uint32_t lastVertex = 0;
+		for (const Primitive* primitive : node->mesh->primitives) {
+			firstVertex = std::min(firstVertex, primitive->firstVertex);
+			lastVertex = std::max(lastVertex, primitive->firstVertex + primitive->vertexCount);
+		}
+		if (lastVertex <= firstVertex) {
+			continue;
 		}
+		pushConstants.firstVertex = firstVertex;
+		pushConstants.vertexCount = lastVertex - firstVertex;
+		pushConstants.matrixOffset = static_cast<uint32_t>(node->mesh->uniformBuffer.dynamicOffset / sizeof(glm::vec4));
+		pushConstants.jointOffset = static_cast<uint32_t>((node->mesh->uniformBuffer.dynamicOffset + sizeof(NodeUniformBlock)) / sizeof(glm::vec4));
+		pushConstants.jointCount = node->mesh->jointCount;
+		vkCmdPushConstants(commandBuffer, computeSkinning.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SkinningPushConstants), &pushConstants);
+		vkCmdDispatch(commandBuffer, (pushConstants.vertexCount + 63) / 64, 1, 1);
 	}
+
+	bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	bufferBarrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
 }
 
-void vkglTF::Model::bindBuffers(VkCommandBuffer commandBuffer)
+// Returns true if primitives with this material are drawn for the alpha mode selected by the render flags
+static bool matchesRenderFlags(const vkglTF::Material& material, uint32_t renderFlags)
 {
-	const VkDeviceSize offsets[1] = {0};
-	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertices.buffer, offsets);
-	vkCmdBindIndexBuffer(commandBuffer, indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-	buffersBound = true;
+	bool skip = false;
+	if (renderFlags & vkglTF::RenderFlags::RenderOpaqueNodes) {
+		skip = (material.alphaMode != vkglTF::Material::ALPHAMODE_OPAQUE);
+	}
+	if (renderFlags & vkglTF::RenderFlags::RenderAlphaMaskedNodes) {
+		skip = (material.alphaMode != vkglTF::Material::ALPHAMODE_MASK);
+	}
+	if (renderFlags & vkglTF::RenderFlags::RenderAlphaBlendedNodes) {
+		skip = (material.alphaMode != vkglTF::Material::ALPHAMODE_BLEND);
+	}
+	return !skip;
 }
 
 void vkglTF::Model::drawNode(Node *node, VkCommandBuffer commandBuffer, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindImageSet)
 {
 	if (node->mesh) {
 		for (Primitive* primitive : node->mesh->primitives) {
-			bool skip = false;
 			const vkglTF::Material& material = primitive->material;
-			if (renderFlags & RenderFlags::RenderOpaqueNodes) {
-				skip = (material.alphaMode != Material::ALPHAMODE_OPAQUE);
-			}
-			if (renderFlags & RenderFlags::RenderAlphaMaskedNodes) {
-				skip = (material.alphaMode != Material::ALPHAMODE_MASK);
-			}
-			if (renderFlags & RenderFlags::RenderAlphaBlendedNodes) {
-				skip = (material.alphaMode != Material::ALPHAMODE_BLEND);
-			}
-			if (!skip) {
+			if (matchesRenderFlags(material, renderFlags)) {
 				if (renderFlags & RenderFlags::BindImages) {
 					vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, bindImageSet, 1, &material.descriptorSet, 0, nullptr);
 				}
@@ -1654,7 +3813,8 @@ void vkglTF::Model::draw(VkCommandBuffer commandBuffer, uint32_t renderFlags, Vk
 {
 	if (!buffersBound) {
 		const VkDeviceSize offsets[1] = {0};
-		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertices.buffer, offsets);
+		const VkBuffer vertexBuffer = drawVertexBuffer();
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, offsets);
 		vkCmdBindIndexBuffer(commandBuffer, indices.buffer, 0, VK_INDEX_TYPE_UINT32);
 	}
 	for (auto& node : nodes) {
@@ -1662,12 +3822,178 @@ void vkglTF::Model::draw(VkCommandBuffer commandBuffer, uint32_t renderFlags, Vk
 	}
 }
 
+/*
+	Draw lists
+*/
+
+void vkglTF::DrawList::destroy()
+{
+	if (device) {
+		for (vks::Buffer& instanceBuffer : instanceBuffers) {
+			instanceBuffer.destroy();
+		}
+		indirectBuffer.destroy();
+		if (descriptorPool != VK_NULL_HANDLE) {
+			vkDestroyDescriptorPool(device->logicalDevice, descriptorPool, nullptr);
+		}
+	}
+	instanceBuffers.clear();
+	indirectBuffer = vks::Buffer();
+	descriptorPool = VK_NULL_HANDLE;
+	descriptorSets.clear();
+	batches.clear();
+	instanceNodes.clear();
+}
+
+void vkglTF::Model::buildDrawList(DrawList& drawList, uint32_t renderFlags, bool indirect, uint32_t frameCount)
+{
+	drawList.destroy();
+	drawList.device = device;
+	drawList.renderFlags = renderFlags;
+	// Batches start at instances other than zero, which indirect draws only support with this feature
+	drawList.indirect = indirect && device->enabledFeatures.drawIndirectFirstInstance;
+
+	// Pre-transformed vertices and lightmap coordinates are unique to each node, so only nodes of untransformed models without lightmaps can share geometry
+	const bool mergeMeshes = !preTransformed && (lightmapAtlas.width == 0);
+
+	struct Instance {
+		const Primitive* primitive;
+		Node* node;
+		uint32_t material;
+		// Instances with the same geometry key are merged into a single batch
+		uint64_t geometry;
+	};
+	std::vector<Instance> instances;
+	uint32_t uniqueGeometry = 0;
+	for (Node* node : linearNodes) {
+		if (!node->mesh) {
+			continue;
+		}
+		// Skinned nodes have their own joint matrices, so they are never merged
+		const bool merge = mergeMeshes && !node->skin;
+		const uint32_t geometry = merge ? node->mesh->index : uniqueGeometry++;
+		for (size_t p = 0; p < node->mesh->primitives.size(); p++) {
+			const Primitive* primitive = node->mesh->primitives[p];
+			if (!matchesRenderFlags(primitive->material, renderFlags)) {
+				continue;
+			}
+			const uint32_t material = static_cast<uint32_t>(&primitive->material - materials.data());
+			// Merged and unique geometry use separate key ranges
+			const uint64_t key = (static_cast<uint64_t>(merge ? 0 : 1) << 63) | (static_cast<uint64_t>(geometry) << 16) | p;
+			instances.push_back({ primitive, node, material, key });
+		}
+	}
+
+	// Opaque before masked before blended, then by material so material bindings are only changed between groups
+	std::stable_sort(instances.begin(), instances.end(), [](const Instance& a, const Instance& b) {
+		if (a.primitive->material.alphaMode != b.primitive->material.alphaMode) {
+			return a.primitive->material.alphaMode < b.primitive->material.alphaMode;
+		}
+		if (a.material != b.material) {
+			return a.material < b.material;
+		}
+		return a.geometry < b.geometry;
+	});
+
+	drawList.instanceNodes.reserve(instances.size());
+	for (size_t i = 0; i < instances.size(); i++) {
+		const Instance& instance = instances[i];
+		if ((i == 0) || (instance.geometry != instances[i - 1].geometry) || (instance.material != instances[i - 1].material)) {
+			// All instances are drawn with the geometry of the first one
+			drawList.batches.push_back({ instance.primitive, &instance.primitive->material, static_cast<uint32_t>(i), 0 });
+		}
+		drawList.batches.back().instanceCount++;
+		drawList.instanceNodes.push_back(instance.node);
+	}
+
+	// Host visible matrices are rewritten by the CPU every frame, so every frame in flight needs its own copy
+	frameCount = std::max(frameCount, 1u);
+	const VkDeviceSize instanceBufferSize = std::max<size_t>(instances.size(), 1) * sizeof(glm::mat4);
+	drawList.instanceBuffers.resize(frameCount);
+	for (uint32_t i = 0; i < frameCount; i++) {
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &drawList.instanceBuffers[i], instanceBufferSize));
+		VK_CHECK_RESULT(drawList.instanceBuffers[i].map());
+		updateDrawList(drawList, i);
+	}
+
+	if (drawList.indirect && !drawList.batches.empty()) {
+		std::vector<VkDrawIndexedIndirectCommand> commands;
+		commands.reserve(drawList.batches.size());
+		for (const DrawList::Batch& batch : drawList.batches) {
+			commands.push_back({ batch.primitive->indexCount, batch.instanceCount, batch.primitive->firstIndex, 0, batch.firstInstance });
+		}
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &drawList.indirectBuffer, commands.size() * sizeof(VkDrawIndexedIndirectCommand), commands.data()));
+	}
+
+	if (descriptorSetLayoutInstances == VK_NULL_HANDLE) {
+		VkDescriptorSetLayoutBinding setLayoutBinding = vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0);
+		VkDescriptorSetLayoutCreateInfo descriptorLayoutCI = vks::initializers::descriptorSetLayoutCreateInfo(&setLayoutBinding, 1);
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorLayoutCI, nullptr, &descriptorSetLayoutInstances));
+	}
+	VkDescriptorPoolSize poolSize = vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, frameCount);
+	VkDescriptorPoolCreateInfo descriptorPoolCI = vks::initializers::descriptorPoolCreateInfo(1, &poolSize, frameCount);
+	VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolCI, nullptr, &drawList.descriptorPool));
+	drawList.descriptorSets.resize(frameCount);
+	for (uint32_t i = 0; i < frameCount; i++) {
+		VkDescriptorSetAllocateInfo descriptorSetAllocInfo = vks::initializers::descriptorSetAllocateInfo(drawList.descriptorPool, &descriptorSetLayoutInstances, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &descriptorSetAllocInfo, &drawList.descriptorSets[i]));
+		VkWriteDescriptorSet writeDescriptorSet = vks::initializers::writeDescriptorSet(drawList.descriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &drawList.instanceBuffers[i].descriptor);
+		vkUpdateDescriptorSets(device->logicalDevice, 1, &writeDescriptorSet, 0, nullptr);
+	}
+}
+
+void vkglTF::Model::updateDrawList(DrawList& drawList, uint32_t frame)
+{
+	glm::mat4* matrices = static_cast<glm::mat4*>(drawList.instanceBuffers[frame].mapped);
+	for (size_t i = 0; i < drawList.instanceNodes.size(); i++) {
+		// Pre-transformed vertices are already in model space
+		matrices[i] = preTransformed ? glm::mat4(1.0f) : drawList.instanceNodes[i]->worldMatrix;
+	}
+}
+
+void vkglTF::Model::draw(VkCommandBuffer commandBuffer, const DrawList& drawList, VkPipelineLayout pipelineLayout, uint32_t bindImageSet, uint32_t instanceSet, uint32_t frame)
+{
+	if (!buffersBound) {
+		const VkDeviceSize offsets[1] = {0};
+		const VkBuffer vertexBuffer = drawVertexBuffer();
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, offsets);
+		vkCmdBindIndexBuffer(commandBuffer, indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+	}
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, instanceSet, 1, &drawList.descriptorSets[frame], 0, nullptr);
+	const bool multiDraw = drawList.indirect && device->enabledFeatures.multiDrawIndirect;
+	const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+	const std::vector<DrawList::Batch>& batches = drawList.batches;
+	for (size_t first = 0; first < batches.size();) {
+		// Batches are sorted by material, so all batches up to the next material change share the same descriptor set
+		const Material* material = batches[first].material;
+		size_t last = first + 1;
+		while ((last < batches.size()) && (batches[last].material == material)) {
+			last++;
+		}
+		if (drawList.renderFlags & RenderFlags::BindImages) {
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, bindImageSet, 1, &material->descriptorSet, 0, nullptr);
+		}
+		if (multiDraw) {
+			vkCmdDrawIndexedIndirect(commandBuffer, drawList.indirectBuffer.buffer, first * stride, static_cast<uint32_t>(last - first), stride);
+		} else {
+			for (size_t i = first; i < last; i++) {
+				if (drawList.indirect) {
+					vkCmdDrawIndexedIndirect(commandBuffer, drawList.indirectBuffer.buffer, i * stride, 1, stride);
+				} else {
+					vkCmdDrawIndexed(commandBuffer, batches[i].primitive->indexCount, batches[i].instanceCount, batches[i].primitive->firstIndex, 0, batches[i].firstInstance);
+				}
+			}
+		}
+		first = last;
+	}
+}
+
 void vkglTF::Model::getNodeDimensions(Node *node, glm::vec3 &min, glm::vec3 &max)
 {
 	if (node->mesh) {
 		for (Primitive *primitive : node->mesh->primitives) {
-			glm::vec4 locMin = glm::vec4(primitive->dimensions.min, 1.0f) * node->getMatrix();
-			glm::vec4 locMax = glm::vec4(primitive->dimensions.max, 1.0f) * node->getMatrix();
+			glm::vec4 locMin = glm::vec4(primitive->dimensions.min, 1.0f) * node->worldMatrix;
+			glm::vec4 locMax = glm::vec4(primitive->dimensions.max, 1.0f) * node->worldMatrix;
 			if (locMin.x < min.x) { min.x = locMin.x; }
 			if (locMin.y < min.y) { min.y = locMin.y; }
 			if (locMin.z < min.z) { min.z = locMin.z; }
@@ -1693,63 +4019,261 @@ void vkglTF::Model::getSceneDimensions()
 	dimensions.radius = glm::distance(dimensions.min, dimensions.max) / 2.0f;
 }
 
-void vkglTF::Model::updateAnimation(uint32_t index, float time)
+/*
+	Animation channels are evaluated in batches with all keyframe values stored as structure of arrays
+	Every interpolation mode is expressed as a weighted sum of four terms (start value, out-tangent, end value, in-tangent),
+	so the compiler can interpolate all channels of a batch with SIMD instructions
+*/
+namespace
 {
-	if (index > static_cast<uint32_t>(animations.size()) - 1) {
-		std::cout << "No animation with index " << index << std::endl;
-		return;
-	}
-	Animation &animation = animations[index];
+	const uint32_t animationBatchSize = 64;
+
+	struct AnimationBatch {
+		// [term][lane]
+		alignas(16) float weights[4][animationBatchSize];
+		// [term][component][lane]
+		alignas(16) float values[4][4][animationBatchSize];
+		// [component][lane]
+		alignas(16) float results[4][animationBatchSize];
+		const vkglTF::AnimationChannel* channels[animationBatchSize];
+		uint32_t count = 0;
+
+		void add(const vkglTF::AnimationChannel* channel, const glm::vec4 terms[4], const float termWeights[4])
+		{
+			for (uint32_t t = 0; t < 4; t++) {
+				weights[t][count] = termWeights[t];
+				for (uint32_t c = 0; c < 4; c++) {
+					values[t][c][count] = terms[t][c];
+				}
+			}
+			channels[count] = channel;
+			count++;
+		}
 
-	bool updated = false;
-	for (auto& channel : animation.channels) {
-		vkglTF::AnimationSampler &sampler = animation.samplers[channel.samplerIndex];
-		if (sampler.inputs.size() > sampler.outputsVec4.size()) {
-			continue;
+		void evaluate()
+		{
+			for (uint32_t c = 0; c < 4; c++) {
+				float* result = results[c];
+				const float* v0 = values[0][c];
+				const float* v1 = values[1][c];
+				const float* v2 = values[2][c];
+				const float* v3 = values[3][c];
+				for (uint32_t l = 0; l < count; l++) {
+					result[l] = weights[0][l] * v0[l] + weights[1][l] * v1[l] + weights[2][l] * v2[l] + weights[3][l] * v3[l];
+				}
+			}
 		}
+	};
 
-		for (auto i = 0; i < sampler.inputs.size() - 1; i++) {
-			if ((time >= sampler.inputs[i]) && (time <= sampler.inputs[i + 1])) {
-				float u = std::max(0.0f, time - sampler.inputs[i]) / (sampler.inputs[i + 1] - sampler.inputs[i]);
-				if (u <= 1.0f) {
-					switch (channel.path) {
-					case vkglTF::AnimationChannel::PathType::TRANSLATION: {
-						glm::vec4 trans = glm::mix(sampler.outputsVec4[i], sampler.outputsVec4[i + 1], u);
-						channel.node->translation = glm::vec3(trans);
-						break;
-					}
-					case vkglTF::AnimationChannel::PathType::SCALE: {
-						glm::vec4 trans = glm::mix(sampler.outputsVec4[i], sampler.outputsVec4[i + 1], u);
-						channel.node->scale = glm::vec3(trans);
-						break;
-					}
-					case vkglTF::AnimationChannel::PathType::ROTATION: {
-						glm::quat q1;
-						q1.x = sampler.outputsVec4[i].x;
-						q1.y = sampler.outputsVec4[i].y;
-						q1.z = sampler.outputsVec4[i].z;
-						q1.w = sampler.outputsVec4[i].w;
-						glm::quat q2;
-						q2.x = sampler.outputsVec4[i + 1].x;
-						q2.y = sampler.outputsVec4[i + 1].y;
-						q2.z = sampler.outputsVec4[i + 1].z;
-						q2.w = sampler.outputsVec4[i + 1].w;
-						channel.node->rotation = glm::normalize(glm::slerp(q1, q2, u));
-						break;
+	/*
+		Interpolates all channels of an animation at the given time and passes the results to apply(channel, value) batch by batch
+		keyframe(c) returns a reference to the cached keyframe interval of channel c, so the same code serves the model's nodes and animation poses
+		Returns true if any channel has been applied
+	*/
+	template <typename KeyframeFn, typename ApplyFn>
+	bool evaluateAnimation(const vkglTF::Animation& animation, float time, KeyframeFn keyframe, ApplyFn apply)
+	{
+		bool updated = false;
+		AnimationBatch batch;
+
+		auto flushBatch = [&]() {
+			batch.evaluate();
+			for (uint32_t l = 0; l < batch.count; l++) {
+				apply(*batch.channels[l], glm::vec4(batch.results[0][l], batch.results[1][l], batch.results[2][l], batch.results[3][l]));
+			}
+			updated |= (batch.count > 0);
+			batch.count = 0;
+		};
+
+		for (size_t c = 0; c < animation.channels.size(); c++) {
+			const vkglTF::AnimationChannel& channel = animation.channels[c];
+			const vkglTF::AnimationSampler& sampler = animation.samplers[channel.samplerIndex];
+			const bool cubicSpline = (sampler.interpolation == vkglTF::AnimationSampler::InterpolationType::CUBICSPLINE);
+			// Cubic spline samplers store an in-tangent, a value and an out-tangent per keyframe
+			if (sampler.inputs.size() * (cubicSpline ? 3 : 1) > sampler.outputsVec4.size()) {
+				continue;
+			}
+
+			if (!sampler.findInterval(time, keyframe(c))) {
+				continue;
+			}
+			const uint32_t i = keyframe(c);
+			const float delta = sampler.inputs[i + 1] - sampler.inputs[i];
+			const float u = (delta > 0.0f) ? std::min(std::max(0.0f, time - sampler.inputs[i]) / delta, 1.0f) : 0.0f;
+
+			glm::vec4 terms[4];
+			float weights[4];
+			switch (sampler.interpolation) {
+			case vkglTF::AnimationSampler::InterpolationType::STEP: {
+				terms[0] = terms[1] = terms[2] = terms[3] = sampler.outputsVec4[i];
+				weights[0] = 1.0f;
+				weights[1] = weights[2] = weights[3] = 0.0f;
+				break;
+			}
+			case vkglTF::AnimationSampler::InterpolationType::CUBICSPLINE: {
+				// Hermite spline, tangents are scaled by the keyframe interval (see glTF 2.0 spec, appendix C)
+				terms[0] = sampler.outputsVec4[i * 3 + 1];
+				terms[1] = sampler.outputsVec4[i * 3 + 2];
+				terms[2] = sampler.outputsVec4[(i + 1) * 3 + 1];
+				terms[3] = sampler.outputsVec4[(i + 1) * 3];
+				const float u2 = u * u;
+				const float u3 = u2 * u;
+				weights[0] = 2.0f * u3 - 3.0f * u2 + 1.0f;
+				weights[1] = (u3 - 2.0f * u2 + u) * delta;
+				weights[2] = -2.0f * u3 + 3.0f * u2;
+				weights[3] = (u3 - u2) * delta;
+				break;
+			}
+			default: {
+				terms[0] = terms[1] = sampler.outputsVec4[i];
+				terms[2] = terms[3] = sampler.outputsVec4[i + 1];
+				weights[0] = 1.0f - u;
+				weights[2] = u;
+				weights[1] = weights[3] = 0.0f;
+				if (channel.path == vkglTF::AnimationChannel::PathType::ROTATION) {
+					// Spherical linear interpolation along the shortest path, falls back to a linear blend for nearly identical rotations
+					float cosTheta = glm::dot(terms[0], terms[2]);
+					if (cosTheta < 0.0f) {
+						terms[2] = terms[3] = -terms[2];
+						cosTheta = -cosTheta;
 					}
+					if (cosTheta < 1.0f - std::numeric_limits<float>::epsilon()) {
+						const float theta = std::acos(cosTheta);
+						const float sinTheta = std::sin(theta);
+						weights[0] = std::sin((1.0f - u) * theta) / sinTheta;
+						weights[2] = std::sin(u * theta) / sinTheta;
 					}
-					updated = true;
 				}
+				break;
+			}
+			}
+
+			batch.add(&channel, terms, weights);
+			if (batch.count == animationBatchSize) {
+				flushBatch();
 			}
 		}
+		flushBatch();
+		return updated;
+	}
+}
+
+void vkglTF::Model::updateAnimation(uint32_t index, float time)
+{
+	if (index > static_cast<uint32_t>(animations.size()) - 1) {
+		std::cout << "No animation with index " << index << std::endl;
+		return;
 	}
+	Animation &animation = animations[index];
+
+	// Applies the interpolated values to the target nodes
+	const bool updated = evaluateAnimation(animation, time,
+		[&animation](size_t c) -> uint32_t& { return animation.channels[c].keyframe; },
+		[](const AnimationChannel& channel, const glm::vec4& value) {
+			switch (channel.path) {
+			case vkglTF::AnimationChannel::PathType::TRANSLATION:
+				channel.node->translation = glm::vec3(value);
+				break;
+			case vkglTF::AnimationChannel::PathType::SCALE:
+				channel.node->scale = glm::vec3(value);
+				break;
+			case vkglTF::AnimationChannel::PathType::ROTATION:
+				channel.node->rotation = glm::normalize(glm::quat(value.w, value.x, value.y, value.z));
+				break;
+			}
+			channel.node->dirty = true;
+		});
+
 	if (updated) {
+		updateNodeMatrices();
 		for (auto &node : nodes) {
 			node->update();
 		}
 	}
 }
 
+void vkglTF::Model::updateAnimation(uint32_t index, float time, AnimationPose& pose) const
+{
+	if (index >= static_cast<uint32_t>(animations.size())) {
+		std::cout << "No animation with index " << index << std::endl;
+		return;
+	}
+	const Animation& animation = animations[index];
+
+	// Poses start from the model's current node transforms and are indexed by glTF node index
+	size_t nodeCount = 0;
+	for (const Node* node : linearNodes) {
+		nodeCount = std::max(nodeCount, static_cast<size_t>(node->index) + 1);
+	}
+	if (pose.worldMatrices.size() != nodeCount) {
+		pose.translations.resize(nodeCount);
+		pose.rotations.resize(nodeCount);
+		pose.scales.resize(nodeCount);
+		pose.worldMatrices.resize(nodeCount);
+		pose.jointMatrices.resize(nodeCount);
+		for (const Node* node : linearNodes) {
+			pose.translations[node->index] = node->translation;
+			pose.rotations[node->index] = node->rotation;
+			pose.scales[node->index] = node->scale;
+		}
+		pose.animation = UINT32_MAX;
+	}
+	if (pose.animation != index) {
+		pose.animation = index;
+		pose.keyframes.assign(animation.channels.size(), 0);
+	}
+
+	evaluateAnimation(animation, time,
+		[&pose](size_t c) -> uint32_t& { return pose.keyframes[c]; },
+		[&pose](const AnimationChannel& channel, const glm::vec4& value) {
+			const uint32_t node = channel.node->index;
+			switch (channel.path) {
+			case vkglTF::AnimationChannel::PathType::TRANSLATION:
+				pose.translations[node] = glm::vec3(value);
+				break;
+			case vkglTF::AnimationChannel::PathType::SCALE:
+				pose.scales[node] = glm::vec3(value);
+				break;
+			case vkglTF::AnimationChannel::PathType::ROTATION:
+				pose.rotations[node] = glm::normalize(glm::quat(value.w, value.x, value.y, value.z));
+				break;
+			}
+		});
+
+	// Same as updateNodeMatrices, but for the pose's transforms
+	for (const Node* node : transformOrder) {
+		const glm::mat4 localMatrix = glm::translate(glm::mat4(1.0f), pose.translations[node->index]) * glm::mat4(pose.rotations[node->index]) * glm::scale(glm::mat4(1.0f), pose.scales[node->index]) * node->matrix;
+		pose.worldMatrices[node->index] = node->parent ? pose.worldMatrices[node->parent->index] * localMatrix : localMatrix;
+	}
+	for (const Node* node : linearNodes) {
+		if (!node->mesh || !node->skin) {
+			continue;
+		}
+		std::vector<glm::mat4>& jointMatrices = pose.jointMatrices[node->index];
+		jointMatrices.resize(node->mesh->jointCount);
+		const glm::mat4 inverseTransform = glm::inverse(pose.worldMatrices[node->index]);
+		for (size_t i = 0; i < jointMatrices.size(); i++) {
+			jointMatrices[i] = inverseTransform * pose.worldMatrices[node->skin->joints[i]->index] * node->skin->inverseBindMatrices[i];
+		}
+	}
+}
+
+void vkglTF::Model::updateNodeMatrices()
+{
+	// Parents are stored before their children, so a parent's world matrix is always up-to-date when visiting a child
+	for (Node* node : transformOrder) {
+		if (node->parent && node->parent->dirty) {
+			node->dirty = true;
+		}
+		if (node->dirty) {
+			node->worldMatrix = node->parent ? node->parent->worldMatrix * node->localMatrix() : node->localMatrix();
+		}
+	}
+	for (Node* node : transformOrder) {
+		node->dirty = false;
+	}
+}
+
 /*
 	Helper functions
 */
@@ -1778,26 +4302,122 @@ vkglTF::Node* vkglTF::Model::nodeFromIndex(uint32_t index) {
 	return nodeFound;
 }
 
-void vkglTF::Model::prepareNodeDescriptor(vkglTF::Node* node, VkDescriptorSetLayout descriptorSetLayout) {
-	if (node->mesh) {
-		VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
-		descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-		descriptorSetAllocInfo.descriptorPool = descriptorPool;
-		descriptorSetAllocInfo.pSetLayouts = &descriptorSetLayout;
-		descriptorSetAllocInfo.descriptorSetCount = 1;
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &descriptorSetAllocInfo, &node->mesh->uniformBuffer.descriptorSet));
+/*
+	Animation system
+*/
 
-		VkWriteDescriptorSet writeDescriptorSet{};
-		writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		writeDescriptorSet.descriptorCount = 1;
-		writeDescriptorSet.dstSet = node->mesh->uniformBuffer.descriptorSet;
-		writeDescriptorSet.dstBinding = 0;
-		writeDescriptorSet.pBufferInfo = &node->mesh->uniformBuffer.descriptor;
+vkglTF::AnimationSystem::AnimationSystem(uint32_t threadCount)
+{
+	if (threadCount == 0) {
+		threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+	}
+	threadPool = new vks::ThreadPool();
+	threadPool->setThreadCount(threadCount);
+}
 
-		vkUpdateDescriptorSets(device->logicalDevice, 1, &writeDescriptorSet, 0, nullptr);
+vkglTF::AnimationSystem::~AnimationSystem()
+{
+	delete threadPool;
+}
+
+void vkglTF::AnimationSystem::update(const std::vector<Instance>& instances)
+{
+	const auto tStart = std::chrono::high_resolution_clock::now();
+	// Threads pick the next instance from a shared counter, as models with many channels or joints take much longer to update
+	std::atomic<size_t> next{ 0 };
+	std::atomic<uint64_t> threadTime{ 0 };
+	std::atomic<uint32_t> joints{ 0 };
+	for (auto& thread : threadPool->threads) {
+		thread->addJob([&instances, &next, &threadTime, &joints] {
+			const auto tThreadStart = std::chrono::high_resolution_clock::now();
+			uint32_t threadJoints = 0;
+			size_t index;
+			while ((index = next++) < instances.size()) {
+				const Instance& instance = instances[index];
+				if (instance.animation < instance.model->animations.size()) {
+					if (instance.pose) {
+						instance.model->updateAnimation(instance.animation, instance.time, *instance.pose);
+					} else {
+						instance.model->updateAnimation(instance.animation, instance.time);
+					}
+				}
+				for (Node* node : instance.model->linearNodes) {
+					if (node->mesh) {
+						threadJoints += node->mesh->jointCount;
+					}
+				}
+			}
+			joints += threadJoints;
+			threadTime += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - tThreadStart).count();
+		});
 	}
-	for (auto& child : node->children) {
-		prepareNodeDescriptor(child, descriptorSetLayout);
+	threadPool->wait();
+	statistics.updateTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+	statistics.threadTime = static_cast<float>(threadTime.load()) / 1000.0f;
+	statistics.models = static_cast<uint32_t>(instances.size());
+	statistics.joints = joints.load();
+}
+
+float vkglTF::AnimationSystem::validate(Model& model)
+{
+	float maxError = 0.0f;
+	auto compare = [&maxError](const glm::mat4& reference, const glm::mat4& value) {
+		for (int c = 0; c < 4; c++) {
+			for (int r = 0; r < 4; r++) {
+				maxError = std::max(maxError, std::abs(reference[c][r] - value[c][r]));
+			}
+		}
+	};
+	for (Node* node : model.linearNodes) {
+		if (!node->mesh || !node->mesh->uniformBuffer.mapped) {
+			continue;
+		}
+		const char* data = static_cast<const char*>(node->mesh->uniformBuffer.mapped);
+		// Node::getMatrix walks the parent chain, so the reference doesn't depend on the cached world matrices
+		const glm::mat4 matrix = node->getMatrix();
+		compare(matrix, reinterpret_cast<const NodeUniformBlock*>(data)->matrix);
+		if (node->skin) {
+			const glm::mat4* jointMatrices = reinterpret_cast<const glm::mat4*>(data + sizeof(NodeUniformBlock));
+			const glm::mat4 inverseTransform = glm::inverse(matrix);
+			for (uint32_t i = 0; i < node->mesh->jointCount; i++) {
+				compare(inverseTransform * node->skin->joints[i]->getMatrix() * node->skin->inverseBindMatrices[i], jointMatrices[i]);
+			}
+		}
+	}
+	return maxError;
+}
+
+float vkglTF::AnimationSystem::validate(const Model& model, const AnimationPose& pose)
+{
+	float maxError = 0.0f;
+	auto compare = [&maxError](const glm::mat4& reference, const glm::mat4& value) {
+		for (int c = 0; c < 4; c++) {
+			for (int r = 0; r < 4; r++) {
+				maxError = std::max(maxError, std::abs(reference[c][r] - value[c][r]));
+			}
+		}
+	};
+	// Walks the parent chain like Node::getMatrix, so the reference doesn't depend on the order the pose's world matrices were computed in
+	auto getMatrix = [&pose](const Node* node) {
+		glm::mat4 m(1.0f);
+		for (const Node* p = node; p; p = p->parent) {
+			m = glm::translate(glm::mat4(1.0f), pose.translations[p->index]) * glm::mat4(pose.rotations[p->index]) * glm::scale(glm::mat4(1.0f), pose.scales[p->index]) * p->matrix * m;
+		}
+		return m;
+	};
+	for (const Node* node : model.linearNodes) {
+		if (!node->mesh || (node->index >= pose.worldMatrices.size())) {
+			continue;
+		}
+		const glm::mat4 matrix = getMatrix(node);
+		compare(matrix, pose.worldMatrices[node->index]);
+		if (node->skin) {
+			const std::vector<glm::mat4>& jointMatrices = pose.jointMatrices[node->index];
+			const glm::mat4 inverseTransform = glm::inverse(matrix);
+			for (size_t i = 0; i < jointMatrices.size(); i++) {
+				compare(inverseTransform * getMatrix(node->skin->joints[i]) * node->skin->inverseBindMatrices[i], jointMatrices[i]);
+			}
+		}
 	}
+	return maxError;
 }
@@ -22,6 +22,8 @@
 
 #include "vulkan/vulkan.h"
 #include "VulkanDevice.h"
+#include "meshlets.hpp"
+#include "lightmapbaker.hpp"
 
 #include <ktx.h>
 #include <ktxvulkan.h>
@@ -42,6 +44,11 @@
 #include <android/asset_manager.h>
 #endif
 
+namespace vks
+{
+	class ThreadPool;
+}
+
 namespace vkglTF
 {
 	enum DescriptorBindingFlags {
@@ -51,30 +58,71 @@ namespace vkglTF
 
 	extern VkDescriptorSetLayout descriptorSetLayoutImage;
 	extern VkDescriptorSetLayout descriptorSetLayoutUbo;
+	extern VkDescriptorSetLayout descriptorSetLayoutInstances;
 	extern VkMemoryPropertyFlags memoryPropertyFlags;
 	extern uint32_t descriptorBindingFlags;
 	extern bool isCalcLMUV;
 
 	struct Node;
+	struct TextureStreamer;
+
+	/*
+		Host visible staging memory for uploads that are recorded into a shared command buffer
+		Allocations are sub-allocated linearly from large persistently mapped blocks and are all released at once
+		after the command buffer copying from them has finished executing
+	*/
+	struct StagingArena {
+		struct Block {
+			VkBuffer buffer;
+			VkDeviceMemory memory;
+			uint8_t* mapped;
+			VkDeviceSize size;
+			VkDeviceSize offset;
+		};
+		struct Allocation {
+			VkBuffer buffer;
+			VkDeviceSize offset;
+			void* mapped;
+		};
+		vks::VulkanDevice* device = nullptr;
+		// Minimum size of a block, requests larger than this get a dedicated block, set to 0 to size every block to its request
+		VkDeviceSize blockSize = 32 * 1024 * 1024;
+		std::vector<Block> blocks;
+		StagingArena(vks::VulkanDevice* device) : device(device) {};
+		~StagingArena();
+		/** @brief Returns a mapped region of at least size bytes, the offset is aligned to the device's optimal buffer copy offset alignment */
+		Allocation allocate(VkDeviceSize size);
+		/** @brief Releases all blocks, may only be called after all copies from the arena have finished executing */
+		void destroy();
+	};
 
 	/*
 		glTF texture loading class
 	*/
 	struct Texture {
 		vks::VulkanDevice* device = nullptr;
-		VkImage image;
+		// Streamed textures don't own any Vulkan objects until their first level has been uploaded (see FileLoadingFlags::StreamTextures)
+		VkImage image = VK_NULL_HANDLE;
 		VkImageLayout imageLayout;
-		VkDeviceMemory deviceMemory;
-		VkImageView view;
+		VkDeviceMemory deviceMemory = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
 		uint32_t width, height;
 		uint32_t mipLevels;
 		uint32_t layerCount;
 		VkDescriptorImageInfo descriptor;
-		VkSampler sampler;
+		VkSampler sampler = VK_NULL_HANDLE;
 		uint32_t index;
 		void updateDescriptor();
 		void destroy();
 		void fromglTfImage(tinygltf::Image& gltfimage, std::string path, vks::VulkanDevice* device, VkQueue copyQueue);
+		/** @brief Records the upload of the image into copyCmd, image data is staged in the given arena which may only be destroyed after copyCmd has been executed */
+		void fromglTfImage(tinygltf::Image& gltfimage, std::string path, vks::VulkanDevice* device, VkCommandBuffer copyCmd, StagingArena& staging);
+		/** @brief Records the upload of RGBA8 pixel data into copyCmd and generates the mip chain from it */
+		void fromRGBA8(const unsigned char* buffer, uint32_t width, uint32_t height, vks::VulkanDevice* device, VkCommandBuffer copyCmd, StagingArena& staging);
+		/** @brief Records the upload of a complete RGBA8 mip chain into copyCmd, levels[0] has the given size and each following level is half the size of the previous one */
+		void fromRGBA8Levels(const std::vector<const unsigned char*>& levels, uint32_t width, uint32_t height, vks::VulkanDevice* device, VkCommandBuffer copyCmd, StagingArena& staging);
+	private:
+		void createSamplerAndView(VkFormat format);
 	};
 
 	/*
@@ -101,6 +149,8 @@ namespace vkglTF
 
 		Material(vks::VulkanDevice* device) : device(device) {};
 		void createDescriptorSet(VkDescriptorPool descriptorPool, VkDescriptorSetLayout descriptorSetLayout, uint32_t descriptorBindingFlags);
+		/** @brief Writes the current descriptors of the material's textures to its descriptor set, which must not be in use by the device */
+		void updateDescriptorSet(uint32_t descriptorBindingFlags);
 	};
 
 	/*
@@ -111,6 +161,20 @@ namespace vkglTF
 		uint32_t indexCount;
 		uint32_t firstVertex;
 		uint32_t vertexCount;
+		/*
+			Level of detail as a range in the shared index buffer
+			error is the object space distance the simplified surface may deviate from the original, so it can be projected to pick a level by screen space error
+		*/
+		struct LOD {
+			uint32_t firstIndex;
+			uint32_t indexCount;
+			float error;
+		};
+		// Levels of detail with decreasing triangle counts, lods[0] is the original index range. Only set if LODs have been generated
+		std::vector<LOD> lods;
+		// Range in the model's meshlet arrays, only set if meshlets have been generated
+		uint32_t firstMeshlet = 0;
+		uint32_t meshletCount = 0;
 		Material& material;
 
 		struct Dimensions {
@@ -128,27 +192,37 @@ namespace vkglTF
 	/*
 		glTF mesh
 	*/
+	/*
+		Layout of a mesh's slice of the model's node buffer, compatible with std140 and std430
+		The joint matrices of skinned meshes directly follow this header, so a slice is only as large as the mesh's actual joint palette
+	*/
+	struct NodeUniformBlock {
+		glm::mat4 matrix;
+		float jointcount;
+		float padding[3];
+	};
+
 	struct Mesh {
 		vks::VulkanDevice* device;
 
 		std::vector<Primitive*> primitives;
 		std::string name;
+		// Index of the glTF mesh, nodes referencing the same mesh share the same geometry unless vertices have been pre-transformed
+		uint32_t index = 0;
+		// Number of joint matrices stored after the NodeUniformBlock
+		uint32_t jointCount = 0;
 
+		// Slice of the model's shared node buffer
 		struct UniformBuffer {
-			VkBuffer buffer;
-			VkDeviceMemory memory;
-			VkDescriptorBufferInfo descriptor;
+			VkBuffer buffer = VK_NULL_HANDLE;
+			VkDescriptorBufferInfo descriptor{};
+			// Shared by all meshes of a model, bind it with dynamicOffset
 			VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
-			void* mapped;
+			uint32_t dynamicOffset = 0;
+			void* mapped = nullptr;
 		} uniformBuffer;
 
-		struct UniformBlock {
-			glm::mat4 matrix;
-			glm::mat4 jointMatrix[64]{};
-			float jointcount{ 0 };
-		} uniformBlock;
-
-		Mesh(vks::VulkanDevice* device, glm::mat4 matrix);
+		Mesh(vks::VulkanDevice* device);
 		~Mesh();
 	};
 
@@ -177,6 +251,10 @@ namespace vkglTF
 		glm::vec3 translation{};
 		glm::vec3 scale{ 1.0f };
 		glm::quat rotation{};
+		// World matrix cached by Model::updateNodeMatrices, only valid after that has been called
+		glm::mat4 worldMatrix{ 1.0f };
+		// Set when the local transform changes, the cached world matrix of this node and its children will be recalculated
+		bool dirty = true;
 		glm::mat4 localMatrix();
 		glm::mat4 getMatrix();
 		void update();
@@ -191,6 +269,8 @@ namespace vkglTF
 		PathType path;
 		Node* node;
 		uint32_t samplerIndex;
+		// Index of the keyframe interval used by the last update, playback usually advances from here
+		uint32_t keyframe = 0;
 	};
 
 	/*
@@ -201,6 +281,8 @@ namespace vkglTF
 		InterpolationType interpolation;
 		std::vector<float> inputs;
 		std::vector<glm::vec4> outputsVec4;
+		/** @brief Finds the keyframe interval containing time, starting at the cached interval and falling back to a binary search for seeks */
+		bool findInterval(float time, uint32_t& keyframe) const;
 	};
 
 	/*
@@ -214,6 +296,49 @@ namespace vkglTF
 		float end = std::numeric_limits<float>::min();
 	};
 
+	/*
+		Animation state of one instance of a model that is shared by several animated instances, see Model::updateAnimation
+		Node transforms and world matrices are indexed by glTF node index, joint matrices are only stored for skinned mesh nodes
+	*/
+	struct AnimationPose {
+		// Animation the cached keyframe intervals belong to
+		uint32_t animation = UINT32_MAX;
+		std::vector<uint32_t> keyframes;
+		std::vector<glm::vec3> translations;
+		std::vector<glm::quat> rotations;
+		std::vector<glm::vec3> scales;
+		std::vector<glm::mat4> worldMatrices;
+		std::vector<std::vector<glm::mat4>> jointMatrices;
+	};
+
+	/*
+		Flattened and sorted list of draws built by Model::buildDrawList
+		Primitives of nodes sharing a glTF mesh are merged into instanced draws, the per-instance node matrices are stored in a storage buffer
+		Each frame in flight has its own copy of the instance matrices, so updating the matrices for one frame doesn't touch data a previous frame may still read
+		Models loaded with FileLoadingFlags::PreTransformVertices (or with lightmap coordinates) store unique vertices per node, so they get one instance per node and identity matrices
+	*/
+	struct DrawList {
+		struct Batch {
+			const Primitive* primitive;
+			const Material* material;
+			uint32_t firstInstance;
+			uint32_t instanceCount;
+		};
+		vks::VulkanDevice* device = nullptr;
+		std::vector<Batch> batches;
+		// Node of each instance, matrices are written in this order
+		std::vector<Node*> instanceNodes;
+		// One matrix per instance and frame in flight, shaders index this with gl_InstanceIndex
+		std::vector<vks::Buffer> instanceBuffers;
+		// One VkDrawIndexedIndirectCommand per batch, only created for indirect draw lists
+		vks::Buffer indirectBuffer;
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		std::vector<VkDescriptorSet> descriptorSets;
+		uint32_t renderFlags = 0;
+		bool indirect = false;
+		void destroy();
+	};
+
 	/*
 		glTF default vertex layout with easy Vulkan mapping functions
 	*/
@@ -234,8 +359,12 @@ namespace vkglTF
 		static VkVertexInputBindingDescription inputBindingDescription(uint32_t binding);
 		static VkVertexInputAttributeDescription inputAttributeDescription(uint32_t binding, uint32_t location, VertexComponent component);
 		static std::vector<VkVertexInputAttributeDescription> inputAttributeDescriptions(uint32_t binding, const std::vector<VertexComponent> components);
-		/** @brief Returns the default pipeline vertex input state create info structure for the requested vertex components */
-		static VkPipelineVertexInputStateCreateInfo* getPipelineVertexInputState(const std::vector<VertexComponent> components);
+		/** @brief Returns the default pipeline vertex input state create info structure for the requested vertex components, if packed is set the structure describes the matching packed layout (see Vertex::pack) */
+		static VkPipelineVertexInputStateCreateInfo* getPipelineVertexInputState(const std::vector<VertexComponent> components, bool packed = false);
+		/** @brief Returns the size of a packed vertex that only stores the given components */
+		static uint32_t packedStride(const std::vector<VertexComponent>& components);
+		/** @brief Writes the given components of the vertex to dst in their quantized form, in the order they're passed in */
+		static void pack(const Vertex& vertex, const std::vector<VertexComponent>& components, uint8_t* dst);
 	};
 
 	enum FileLoadingFlags {
@@ -243,7 +372,11 @@ namespace vkglTF
 		PreTransformVertices = 0x00000001,
 		PreMultiplyVertexColors = 0x00000002,
 		FlipY = 0x00000004,
-		DontLoadImages = 0x00000008
+		DontLoadImages = 0x00000008,
+		OptimizeVertexCache = 0x00000010,
+		GenerateMeshlets = 0x00000020,
+		GenerateLODs = 0x00000040,
+		StreamTextures = 0x00000080
 	};
 
 	enum RenderFlags {
@@ -260,9 +393,28 @@ namespace vkglTF
 	private:
 		vkglTF::Texture* getTexture(uint32_t index);
 		vkglTF::Texture emptyTexture;
-		void createEmptyTexture(VkQueue transferQueue);
+		void createEmptyTexture(VkCommandBuffer copyCmd, StagingArena& staging);
+		void loadStreamedImages(tinygltf::Model& gltfModel, VkCommandBuffer copyCmd, StagingArena& staging);
+		void optimizeVertexCache(std::vector<uint32_t>& indexBuffer, std::vector<Vertex>& vertexBuffer);
+		void generateLODs(std::vector<uint32_t>& indexBuffer, const std::vector<Vertex>& vertexBuffer);
+		void generateMeshlets(const std::vector<uint32_t>& indexBuffer, const std::vector<Vertex>& vertexBuffer);
+		void preprocessVertices(std::vector<Vertex>& vertexBuffer, uint32_t fileLoadingFlags);
+		bool bakeLightmap(const std::vector<uint32_t>& indexBuffer, const std::vector<Vertex>& vertexBuffer, bool preTransformed);
+		void setupNodes();
+		void allocateNodeBuffer();
+		void uploadGeometry(const StagingArena::Allocation& vertexStaging, VkDeviceSize vertexBufferSize, const StagingArena::Allocation& indexStaging, VkDeviceSize indexBufferSize, VkCommandBuffer copyCmd, StagingArena& staging);
+		void setupDescriptors();
+		void writeCooked(const std::string& filename, const tinygltf::Model& gltfModel, uint32_t fileLoadingFlags, const std::vector<VertexComponent>& packedComponents, const void* vertexData, size_t vertexDataSize, const std::vector<uint32_t>& indexBuffer);
+		// Start of each glTF buffer's data while a file is loaded, points into the memory mapped binary chunk for glb files
+		std::vector<const unsigned char*> bufferData;
+		// Background decoding and residency state of streamed textures, only created with FileLoadingFlags::StreamTextures
+		TextureStreamer* textureStreamer = nullptr;
+		// Set if the vertices have been transformed by their node matrices on load
+		bool preTransformed = false;
+		// Sidecar file used by calcLightmapUV to store and reuse generated lightmap charts, empty if caching is disabled
+		std::string lightmapCacheFile;
 	public:
-		vks::VulkanDevice* device;
+		vks::VulkanDevice* device = nullptr;
 		VkDescriptorPool descriptorPool;
 
 		struct Vertices {
@@ -276,8 +428,57 @@ namespace vkglTF
 			VkDeviceMemory memory;
 		} indices;
 
+		// Meshlets of all primitives as flat arrays (see meshlets.hpp), only generated with FileLoadingFlags::GenerateMeshlets
+		vks::meshlets::MeshletData meshletData;
+		// Device local storage buffers with the contents of meshletData, triangles are stored as three 8 bit local indices each
+		struct StorageBuffer {
+			VkBuffer buffer = VK_NULL_HANDLE;
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+		};
+		struct MeshletBuffers {
+			StorageBuffer meshlets;
+			StorageBuffer bounds;
+			StorageBuffer vertices;
+			StorageBuffer triangles;
+		} meshletBuffers;
+
+		/*
+			Optional compute pre-pass that skins all skinned meshes once per frame (shaders/base/skinning.comp)
+			Once prepared, the skinned vertex buffer is bound instead of the source vertices by bindBuffers and draw, so every later pass reads pre-skinned vertices
+			Skinned vertices are written in model space (the mesh node's matrix is applied), so they are drawn like pre-transformed vertices
+			Every frame in flight has its own skinned vertex buffer, so skinning the next frame never overwrites vertices a previous frame may still read
+		*/
+		struct ComputeSkinning {
+			struct Frame {
+				VkBuffer buffer = VK_NULL_HANDLE;
+				VkDeviceMemory memory = VK_NULL_HANDLE;
+				// Copy of the node buffer taken when the pre-pass is recorded, only used with more than one frame in flight
+				vks::Buffer joints;
+				VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+			};
+			std::vector<Frame> frames;
+			// Frame last recorded by recordComputeSkinning, its skinned vertices are bound by bindBuffers and draw
+			uint32_t currentFrame = 0;
+			VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+			VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+			VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+			VkPipeline pipeline = VK_NULL_HANDLE;
+		} computeSkinning;
+
+		/*
+			Persistently mapped buffer holding the NodeUniformBlocks and joint matrices of all meshes, suballocated by allocateNodeBuffer
+			There is only a single copy that is shared by all frames in flight, so updateAnimation and AnimationSystem::update must only write to it once no submitted frame
+			reading it is still executing (e.g. after waiting for that frame's fence, with one frame in flight submitFrame already waits for the queue to become idle)
+			Skinned meshes can be drawn from more frames in flight with the compute skinning pre-pass, which copies the joints to a per-frame buffer when it's recorded
+		*/
+		vks::Buffer nodeBuffer;
+		// Single descriptor set for nodeBuffer using a dynamic uniform buffer (descriptorSetLayoutUbo), each mesh is selected by its dynamic offset
+		VkDescriptorSet nodeDescriptorSet = VK_NULL_HANDLE;
+
 		std::vector<Node*> nodes;
 		std::vector<Node*> linearNodes;
+		// All nodes with parents stored before their children, used to update the cached world matrices in a single pass
+		std::vector<Node*> transformOrder;
 
 		std::vector<Skin*> skins;
 
@@ -314,27 +515,198 @@ namespace vkglTF
 			float radius;
 		} dimensions;
 
+		// Size of a single vertex in the vertex buffer, smaller than sizeof(Vertex) if the model was loaded with packed vertex components
+		uint32_t vertexStride = sizeof(Vertex);
+		// Packed vertex components of the vertex buffer (empty for the default layout), pass these to Vertex::getPipelineVertexInputState with packed set
+		std::vector<VertexComponent> packedComponents;
+
+		// Average cache miss ratio (transformed vertices per triangle) of all primitives before and after FileLoadingFlags::OptimizeVertexCache has been applied
+		struct VertexCacheStatistics {
+			float acmrBefore = 0.0f;
+			float acmrAfter = 0.0f;
+		} vertexCacheStatistics;
+
+		// Maximum number of levels of detail per primitive (including the original) generated with FileLoadingFlags::GenerateLODs
+		uint32_t maxLODLevels = 4;
+
+		// Lightmap atlas parameters used by calcLightmapUV, padding is the number of texels kept free around each chart
+		// If bakeFile is set, an irradiance lightmap for the atlas is baked on the CPU while loading and written to that KTX file
+		// If cache is set, charts and lightmap coordinates are stored next to the model file (with an added .lmcache extension) and reused as long as its geometry doesn't change
+		// Caching is opt-in, as the directory of shipped assets may not be writable (or contain files that shouldn't be changed by running an example)
+		struct LightmapSettings {
+			float texelsPerUnit = 16.0f;
+			uint32_t padding = 2;
+			uint32_t maxSize = 4096;
+			bool allowRotation = true;
+			bool cache = false;
+			std::string bakeFile;
+			vks::lightmap::BakeSettings bake;
+		} lightmapSettings;
+
+		// Lightmap atlas created by calcLightmapUV, texelsPerUnit may be lower than requested if the charts didn't fit and efficiency is the fraction of the atlas covered by charts
+		// The size is zero (and all lightmap coordinates are reset) if the charts don't fit into lightmapSettings.maxSize at any texel density
+		struct LightmapAtlas {
+			uint32_t width = 0;
+			uint32_t height = 0;
+			float texelsPerUnit = 0.0f;
+			float efficiency = 0.0f;
+		} lightmapAtlas;
+
+		// Texture streaming parameters used with FileLoadingFlags::StreamTextures
+		// memoryBudget limits the device memory of all streamed images, textures that haven't been visible for the longest time are evicted first to stay within it
+		// texelsPerPixel is the texture resolution requested per pixel a primitive covers on screen, uploads and decodes are limited per updateTextureStreaming call to keep frame times stable
+		struct TextureStreamingSettings {
+			VkDeviceSize memoryBudget = 256 * 1024 * 1024;
+			float texelsPerPixel = 1.0f;
+			uint32_t maxUploadsPerUpdate = 4;
+			uint32_t maxPendingDecodes = 2;
+		} textureStreamingSettings;
+
+		// Current state of texture streaming, updated by updateTextureStreaming
+		struct TextureStreamingStatistics {
+			VkDeviceSize memoryUsed = 0;
+			uint32_t residentTextures = 0;
+			uint32_t streamedTextures = 0;
+			uint32_t evictions = 0;
+		} textureStreamingStatistics;
+
 		bool metallicRoughnessWorkflow = true;
 		bool buffersBound = false;
 		std::string path;
 
+		// If set, loadFromFile writes the final model data to this file, so it can be loaded with loadFromCooked without parsing or processing the glTF file again
+		std::string cookFile;
+
 		Model() {};
 		~Model();
 		void loadNode(vkglTF::Node* parent, const tinygltf::Node& node, uint32_t nodeIndex, const tinygltf::Model& model, std::vector<uint32_t>& indexBuffer, std::vector<Vertex>& vertexBuffer, float globalscale);
 		void loadSkins(tinygltf::Model& gltfModel);
-		void loadImages(tinygltf::Model& gltfModel, vks::VulkanDevice* device, VkQueue transferQueue);
+		void loadImages(tinygltf::Model& gltfModel, vks::VulkanDevice* device, VkCommandBuffer copyCmd, StagingArena& staging);
 		void loadMaterials(tinygltf::Model& gltfModel);
 		void loadAnimations(tinygltf::Model& gltfModel);
-		void loadFromFile(std::string filename, vks::VulkanDevice* device, VkQueue transferQueue, uint32_t fileLoadingFlags = vkglTF::FileLoadingFlags::None, float scale = 1.0f);
+		/** @brief Loads the glTF file, if packedComponents is not empty the vertex buffer only contains these components in their packed form (see Vertex::pack) */
+		void loadFromFile(std::string filename, vks::VulkanDevice* device, VkQueue transferQueue, uint32_t fileLoadingFlags = vkglTF::FileLoadingFlags::None, float scale = 1.0f, const std::vector<VertexComponent>& packedComponents = {});
+		/** @brief Loads a model written by loadFromFile with cookFile set, the file loading flags and packed vertex components used for cooking apply to the loaded model */
+		void loadFromCooked(std::string filename, vks::VulkanDevice* device, VkQueue transferQueue);
+		/**
+		* Generates the lightmap coordinates of a glTF file and bakes its lightmap on the CPU to lightmapSettings.bakeFile without a Vulkan device
+		* Only the geometry is loaded (no images or GPU buffers), so the model can't be rendered afterwards
+		* The atlas layout matches that of loadFromFile with lightmap coordinates enabled and the same file loading flags (and lightmap settings)
+		*
+		* @return False if the file couldn't be loaded, its charts didn't fit into an atlas or the lightmap couldn't be written
+		*/
+		bool bakeLightmapFromFile(std::string filename, uint32_t fileLoadingFlags = vkglTF::FileLoadingFlags::None, float scale = 1.0f);
 		void bindBuffers(VkCommandBuffer commandBuffer);
+		/** @brief Vertex buffer bound by bindBuffers and draw, the skinned vertices of the last recorded frame if compute skinning has been prepared */
+		VkBuffer drawVertexBuffer() const;
+		/**
+		* Creates the skinned vertex buffers and compute pipeline for the skinning pre-pass, only supported for the default (unpacked) vertex layout
+		*
+		* @param shaderStage Compute shader stage for skinning.comp, the shader module is owned by the caller
+		* @param queue Queue used to initialize the skinned vertex buffers with the static vertices
+		* @param frameCount Number of frames in flight, each one gets its own skinned vertex buffer
+		*/
+		void prepareComputeSkinning(const VkPipelineShaderStageCreateInfo& shaderStage, VkQueue queue, VkPipelineCache pipelineCache = VK_NULL_HANDLE, uint32_t frameCount = 1);
+		/**
+		* Records the skinning dispatches for a frame and the barrier to vertex input, must be recorded outside of a render pass
+		* With a single frame the dispatches read the node buffer when they execute, so pre-recorded command buffers pick up animation updates
+		* With more than one frame the current joint matrices are copied to the frame's own buffer right away, so the command buffer has to be recorded every frame after the animation has been updated
+		*/
+		void recordComputeSkinning(VkCommandBuffer commandBuffer, uint32_t frame = 0);
 		void drawNode(Node* node, VkCommandBuffer commandBuffer, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1);
 		void draw(VkCommandBuffer commandBuffer, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1);
+		/**
+		* Flattens the node tree into a draw list sorted by alpha mode and material
+		* Nodes referencing the same glTF mesh are merged into a single instanced draw, skinned nodes and models with pre-transformed vertices or lightmap coordinates are drawn with one instance per node
+		*
+		* @param drawList Draw list to (re)build, any previous contents are destroyed
+		* @param renderFlags Alpha mode filter and BindImages, same as for draw
+		* @param indirect Also write the batches to an indirect buffer, ignored if the device doesn't support drawIndirectFirstInstance
+		* @param frameCount Number of frames in flight, each one gets its own instance buffer and descriptor set
+		*/
+		void buildDrawList(DrawList& drawList, uint32_t renderFlags = 0, bool indirect = false, uint32_t frameCount = 1);
+		/** @brief Writes the current world matrices of all instances to the instance buffer of a frame, call after node matrices have changed and only for frames the GPU has finished */
+		void updateDrawList(DrawList& drawList, uint32_t frame = 0);
+		/**
+		* Draws a draw list built for this model
+		* Materials are only bound when they change, indirect draw lists issue a single multi draw per material if multiDrawIndirect is enabled
+		*
+		* @param instanceSet Set index the instance matrices (descriptorSetLayoutInstances) are bound to
+		* @param frame Frame in flight whose instance matrices are used
+		*/
+		void draw(VkCommandBuffer commandBuffer, const DrawList& drawList, VkPipelineLayout pipelineLayout, uint32_t bindImageSet = 1, uint32_t instanceSet = 2, uint32_t frame = 0);
 		void getNodeDimensions(Node* node, glm::vec3& min, glm::vec3& max);
 		void getSceneDimensions();
+		/** @brief Applies an animation to the model's nodes and writes the results to nodeBuffer, which must not be in use by a frame that is still executing */
 		void updateAnimation(uint32_t index, float time);
+		/**
+		* Evaluates an animation into a pose instead of the model's nodes and node buffer
+		* The model isn't modified, so one model can be shared by many animated instances whose poses are updated on different threads
+		*/
+		void updateAnimation(uint32_t index, float time, AnimationPose& pose) const;
+		/**
+		* Streams texture levels for the given view if the model has been loaded with FileLoadingFlags::StreamTextures
+		* Must be called between frames from the thread submitting to queue, as changed textures are swapped once the queue is idle
+		* Material descriptor sets of swapped textures are updated in place, which invalidates all command buffers they are bound in
+		*
+		* @param projection Projection matrix used to estimate the screen coverage of primitives
+		* @param view View matrix
+		* @param viewportHeight Height of the viewport in pixels
+		* @param queue Queue used for uploads, this must be the queue the model is rendered with
+		* @return True if material descriptor sets have been updated, command buffers using the model must be re-recorded before they're submitted again
+		*/
+		bool updateTextureStreaming(const glm::mat4& projection, const glm::mat4& view, uint32_t viewportHeight, VkQueue queue);
+		/** @brief Recalculates the cached world matrices of all dirty nodes (and their children) in parent-before-child order */
+		void updateNodeMatrices();
 		Node* findNode(Node* parent, uint32_t index);
 		Node* nodeFromIndex(uint32_t index);
-		void prepareNodeDescriptor(vkglTF::Node* node, VkDescriptorSetLayout descriptorSetLayout);
-		void calcLightmapUV();
+		/** @brief Builds lightmap charts for all primitives and stores their packed lightmap coordinates in uv2, may split vertices shared by several charts */
+		void calcLightmapUV(std::vector<uint32_t>& indexBuffer, std::vector<Vertex>& vertexBuffer);
+	};
+	/*
+		Evaluates animations, world matrices and joint palettes of many models in parallel on a persistent vks::ThreadPool
+		Every model is updated by a single thread and writes its results straight into its persistently mapped node buffer,
+		instances with an AnimationPose leave the model untouched and write their results into the pose instead
+	*/
+	class AnimationSystem {
+	private:
+		vks::ThreadPool* threadPool = nullptr;
+	public:
+		struct Instance {
+			Model* model;
+			uint32_t animation;
+			float time;
+			// Optional pose the animation is evaluated into, instances with a pose can share a model
+			AnimationPose* pose;
+		};
+
+		// Timings of the last update in milliseconds, threadTime is the sum of the time spent on all threads
+		struct Statistics {
+			float updateTime = 0.0f;
+			float threadTime = 0.0f;
+			uint32_t models = 0;
+			uint32_t joints = 0;
+		} statistics;
+
+		/** @brief Creates the thread pool, a thread count of zero uses one thread per hardware thread */
+		explicit AnimationSystem(uint32_t threadCount = 0);
+		~AnimationSystem();
+		AnimationSystem(const AnimationSystem&) = delete;
+		AnimationSystem& operator=(const AnimationSystem&) = delete;
+
+		/**
+		* Applies the given animation time to all instances and waits for the results, each model must only be listed once by instances without a pose
+		* Instances without a pose write to their model's node buffer, so no frame that reads it may still be executing (see Model::nodeBuffer)
+		*/
+		void update(const std::vector<Instance>& instances);
+		/**
+		* Recomputes the node matrices and joint palettes of a model on the CPU from its node hierarchy without using the cached world matrices
+		* Only reads the mapped node buffer, so palettes can be validated without submitting any GPU work
+		*
+		* @return Largest absolute difference between the reference and the data in the node buffer
+		*/
+		static float validate(Model& model);
+		/** @brief Same as validate, but checks the world matrices and joint palettes of a pose of the model */
+		static float validate(const Model& model, const AnimationPose& pose);
 	};
-}
\ No newline at end of file
+}
@@ -9,29 +9,224 @@
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <numeric>
 #include <limits>
 #include <functional>
 #include <chrono>
 #include <iomanip>
+#include <cmath>
 
 namespace vks
 {
 	class Benchmark {
+	public:
+		/*
+			Frame time statistics of a set of frames in ms
+		*/
+		struct Statistics {
+			uint32_t frames = 0;
+			double mean = 0.0;
+			double stdDev = 0.0;
+			double min = 0.0;
+			double max = 0.0;
+			double p50 = 0.0;
+			double p90 = 0.0;
+			double p99 = 0.0;
+			double p999 = 0.0;
+			// Mean of all frames within the interquartile fences (Q1 - 1.5 * IQR, Q3 + 1.5 * IQR), so single hitches don't skew it
+			double trimmedMean = 0.0;
+			// Mean absolute difference between consecutive frames, large values indicate uneven frame pacing even if the mean is low
+			double frameToFrame = 0.0;
+			// Number of frames taking more than twice as long as the median
+			uint32_t stutterFrames = 0;
+		};
+
+		/*
+			Results of a single benchmark run
+		*/
+		struct Run {
+			double runtime = 0.0;
+			std::vector<double> frameTimes;
+			Statistics statistics;
+		};
+
+		/*
+			Confidence interval of the mean frame time across all runs
+		*/
+		struct ConfidenceInterval {
+			double level = 0.95;
+			double mean = 0.0;
+			double lower = 0.0;
+			double upper = 0.0;
+		};
+
 	private:
 		FILE *stream;
 		VkPhysicalDeviceProperties deviceProps;
+
+		// Nearest-rank percentile of sorted values
+		static double percentile(const std::vector<double>& sorted, double p)
+		{
+			const size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * static_cast<double>(sorted.size())));
+			return sorted[std::min(std::max(rank, static_cast<size_t>(1)), sorted.size()) - 1];
+		}
+
+		// Two-sided 95% quantile of the t-distribution for the given degrees of freedom
+		static double tQuantile95(size_t degreesOfFreedom)
+		{
+			static const double table[30] = {
+				12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+				2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+				2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+			};
+			return (degreesOfFreedom >= 1 && degreesOfFreedom <= 30) ? table[degreesOfFreedom - 1] : 1.960;
+		}
+
+		// Frames per second of a run, runs shorter than a single frame have no meaningful rate
+		static double framesPerSecond(size_t frames, double runtime)
+		{
+			return (runtime > 0.0) ? static_cast<double>(frames) / (runtime / 1000.0) : 0.0;
+		}
+
+		// JSON has no representation for inf and nan, so these are written as 0
+		static double jsonNumber(double value)
+		{
+			return std::isfinite(value) ? value : 0.0;
+		}
+
+		static void writeJsonString(std::ostream& out, const std::string& value)
+		{
+			out << "\"";
+			for (char c : value) {
+				switch (c) {
+				case '"': out << "\\\""; break;
+				case '\\': out << "\\\\"; break;
+				case '\n': out << "\\n"; break;
+				case '\t': out << "\\t"; break;
+				default:
+					if (static_cast<unsigned char>(c) < 0x20) {
+						out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec << std::setfill(' ');
+					} else {
+						out << c;
+					}
+				}
+			}
+			out << "\"";
+		}
+
+		static void writeJsonStatistics(std::ostream& out, const Statistics& statistics, const std::string& indent)
+		{
+			out << "{\n";
+			out << indent << "\t\"frames\": " << statistics.frames << ",\n";
+			out << indent << "\t\"mean\": " << jsonNumber(statistics.mean) << ",\n";
+			out << indent << "\t\"stdDev\": " << jsonNumber(statistics.stdDev) << ",\n";
+			out << indent << "\t\"min\": " << jsonNumber(statistics.min) << ",\n";
+			out << indent << "\t\"max\": " << jsonNumber(statistics.max) << ",\n";
+			out << indent << "\t\"p50\": " << jsonNumber(statistics.p50) << ",\n";
+			out << indent << "\t\"p90\": " << jsonNumber(statistics.p90) << ",\n";
+			out << indent << "\t\"p99\": " << jsonNumber(statistics.p99) << ",\n";
+			out << indent << "\t\"p99.9\": " << jsonNumber(statistics.p999) << ",\n";
+			out << indent << "\t\"trimmedMean\": " << jsonNumber(statistics.trimmedMean) << ",\n";
+			out << indent << "\t\"frameToFrame\": " << jsonNumber(statistics.frameToFrame) << ",\n";
+			out << indent << "\t\"stutterFrames\": " << statistics.stutterFrames << "\n";
+			out << indent << "}";
+		}
+
+		static void printStatistics(const Statistics& statistics)
+		{
+			std::cout << "mean   : " << statistics.mean << " ms (stddev " << statistics.stdDev << " ms, trimmed " << statistics.trimmedMean << " ms)" << "\n";
+			std::cout << "best   : " << ((statistics.min > 0.0) ? 1000.0 / statistics.min : 0.0) << " fps (" << statistics.min << " ms)" << "\n";
+			std::cout << "worst  : " << ((statistics.max > 0.0) ? 1000.0 / statistics.max : 0.0) << " fps (" << statistics.max << " ms)" << "\n";
+			std::cout << "p50    : " << statistics.p50 << " ms" << "\n";
+			std::cout << "p90    : " << statistics.p90 << " ms" << "\n";
+			std::cout << "p99    : " << statistics.p99 << " ms" << "\n";
+			std::cout << "p99.9  : " << statistics.p999 << " ms" << "\n";
+			std::cout << "stutter: " << statistics.stutterFrames << " frames, " << statistics.frameToFrame << " ms mean frame-to-frame variation" << "\n";
+		}
+
 	public:
 		bool active = false;
 		bool outputFrameTimes = false;
 		int outputFrames = -1; // -1 means no frames limit
 		uint32_t warmup = 1;   // Default to 1 sec of warm-up
 		uint32_t duration = 10;
+		uint32_t runs = 1;     // Number of measured runs after a single warm-up, the frame limit applies to each run
 		std::vector<double> frameTimes;
 		std::string filename = "";
 
 		double runtime = 0.0;
 		uint32_t frameCount = 0;
 
+		// Statistics of all frames, of each run and across runs, available after run()
+		Statistics statistics;
+		std::vector<Run> runResults;
+		ConfidenceInterval confidenceInterval;
+
+		// Optional average GPU time per pass in ms, filled by the caller before saving the results
+		std::vector<std::pair<std::string, double>> gpuPassTimes;
+		// Optional callback invoked once the warm-up phase has finished, e.g. to discard statistics gathered during warm-up
+		std::function<void()> warmupFinished;
+		// Optional callback invoked at the start of each measured run, e.g. to restart a camera track
+		std::function<void()> runStarted;
+
+		/** @brief Calculates frame time statistics for the given frame times in ms */
+		static Statistics calculateStatistics(const std::vector<double>& times)
+		{
+			Statistics result;
+			if (times.empty()) {
+				return result;
+			}
+			std::vector<double> sorted(times);
+			std::sort(sorted.begin(), sorted.end());
+			const double count = static_cast<double>(times.size());
+			result.frames = static_cast<uint32_t>(times.size());
+			result.mean = std::accumulate(times.begin(), times.end(), 0.0) / count;
+			double variance = 0.0;
+			for (double t : times) {
+				variance += (t - result.mean) * (t - result.mean);
+			}
+			result.stdDev = (times.size() > 1) ? std::sqrt(variance / (count - 1.0)) : 0.0;
+			result.min = sorted.front();
+			result.max = sorted.back();
+			result.p50 = percentile(sorted, 50.0);
+			result.p90 = percentile(sorted, 90.0);
+			result.p99 = percentile(sorted, 99.0);
+			result.p999 = percentile(sorted, 99.9);
+
+			const double q1 = percentile(sorted, 25.0);
+			const double q3 = percentile(sorted, 75.0);
+			const double lowerFence = q1 - 1.5 * (q3 - q1);
+			const double upperFence = q3 + 1.5 * (q3 - q1);
+			double trimmedSum = 0.0;
+			size_t trimmedCount = 0;
+			for (double t : sorted) {
+				if ((t >= lowerFence) && (t <= upperFence)) {
+					trimmedSum += t;
+					trimmedCount++;
+				}
+			}
+			result.trimmedMean = (trimmedCount > 0) ? trimmedSum / static_cast<double>(trimmedCount) : result.mean;
+
+			double frameToFrame = 0.0;
+			for (size_t i = 1; i < times.size(); i++) {
+				frameToFrame += std::abs(times[i] - times[i - 1]);
+			}
+			result.frameToFrame = (times.size() > 1) ? frameToFrame / (count - 1.0) : 0.0;
+			result.stutterFrames = static_cast<uint32_t>(std::count_if(times.begin(), times.end(), [&result](double t) { return t > 2.0 * result.p50; }));
+			return result;
+		}
+
+		/** @brief Returns the file name of the JSON results, which is the results file name with its extension replaced by .json */
+		std::string getJsonFilename() const
+		{
+			const size_t extension = filename.find_last_of('.');
+			const size_t separator = filename.find_last_of("/\\");
+			if ((extension != std::string::npos) && ((separator == std::string::npos) || (extension > separator))) {
+				return filename.substr(0, extension) + ".json";
+			}
+			return filename + ".json";
+		}
+
 		void run(std::function<void()> renderFunc, VkPhysicalDeviceProperties deviceProps) {
 			active = true;
 			this->deviceProps = deviceProps;
@@ -51,24 +246,62 @@ namespace vks
 					auto tDiff = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
 					tMeasured += tDiff;
 				};
+				if (warmupFinished) {
+					warmupFinished();
+				}
 			}
 
 			// Benchmark phase
 			{
-				while (runtime < (duration * 1000.0)) {
-					auto tStart = std::chrono::high_resolution_clock::now();
-					renderFunc();
-					auto tDiff = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
-					runtime += tDiff;
-					frameTimes.push_back(tDiff);
-					frameCount++;
-					if (outputFrames != -1 && outputFrames == frameCount) break;
-				};
+				runResults.resize(std::max(runs, 1u));
+				for (Run& run : runResults) {
+					if (runStarted) {
+						runStarted();
+					}
+					while (run.runtime < (duration * 1000.0)) {
+						auto tStart = std::chrono::high_resolution_clock::now();
+						renderFunc();
+						auto tDiff = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+						run.runtime += tDiff;
+						run.frameTimes.push_back(tDiff);
+						if (outputFrames != -1 && static_cast<size_t>(outputFrames) == run.frameTimes.size()) break;
+					};
+					run.statistics = calculateStatistics(run.frameTimes);
+					runtime += run.runtime;
+					frameCount += static_cast<uint32_t>(run.frameTimes.size());
+					frameTimes.insert(frameTimes.end(), run.frameTimes.begin(), run.frameTimes.end());
+				}
+				statistics = calculateStatistics(frameTimes);
+
+				// The confidence interval uses the mean frame time of each run as a sample, frames within a run are not independent
+				confidenceInterval.mean = statistics.mean;
+				confidenceInterval.lower = confidenceInterval.upper = statistics.mean;
+				if (runResults.size() > 1) {
+					const double n = static_cast<double>(runResults.size());
+					double mean = 0.0;
+					for (const Run& run : runResults) {
+						mean += run.statistics.mean / n;
+					}
+					double variance = 0.0;
+					for (const Run& run : runResults) {
+						variance += (run.statistics.mean - mean) * (run.statistics.mean - mean) / (n - 1.0);
+					}
+					const double margin = tQuantile95(runResults.size() - 1) * std::sqrt(variance / n);
+					confidenceInterval.mean = mean;
+					confidenceInterval.lower = mean - margin;
+					confidenceInterval.upper = mean + margin;
+				}
+
 				std::cout << "Benchmark finished" << "\n";
 				std::cout << "device : " << deviceProps.deviceName << " (driver version: " << deviceProps.driverVersion << ")" << "\n";
 				std::cout << "runtime: " << (runtime / 1000.0) << "\n";
 				std::cout << "frames : " << frameCount << "\n";
-				std::cout << "fps    : " << frameCount / (runtime / 1000.0) << "\n";
+				std::cout << "fps    : " << framesPerSecond(frameCount, runtime) << "\n";
+				printStatistics(statistics);
+				if (runResults.size() > 1) {
+					std::cout << "runs   : " << runResults.size() << ", mean " << confidenceInterval.mean << " ms, 95% confidence interval [" << confidenceInterval.lower << ", " << confidenceInterval.upper << "] ms" << "\n";
+				}
+				std::cout << "\n";
 			}
 		}
 
@@ -78,27 +311,96 @@ namespace vks
 				result << std::fixed << std::setprecision(4);
 
 				result << "device,driverversion,duration (ms),frames,fps" << "\n";
-				result << deviceProps.deviceName << "," << deviceProps.driverVersion << "," << runtime << "," << frameCount << "," << frameCount / (runtime / 1000.0) << "\n";
+				result << deviceProps.deviceName << "," << deviceProps.driverVersion << "," << runtime << "," << frameCount << "," << framesPerSecond(frameCount, runtime) << "\n";
+
+				result << "\n" << "run,frames,mean (ms),stddev (ms),min (ms),max (ms),p50 (ms),p90 (ms),p99 (ms),p99.9 (ms),trimmed mean (ms),frame-to-frame (ms),stutter frames" << "\n";
+				for (size_t i = 0; i <= runResults.size(); i++) {
+					// The last row contains the statistics of all runs combined
+					const Statistics& s = (i < runResults.size()) ? runResults[i].statistics : statistics;
+					result << ((i < runResults.size()) ? std::to_string(i) : "all") << "," << s.frames << "," << s.mean << "," << s.stdDev << "," << s.min << "," << s.max << "," << s.p50 << "," << s.p90 << "," << s.p99 << "," << s.p999 << "," << s.trimmedMean << "," << s.frameToFrame << "," << s.stutterFrames << "\n";
+				}
+				if (runResults.size() > 1) {
+					result << "\n" << "confidence level,mean (ms),lower (ms),upper (ms)" << "\n";
+					result << confidenceInterval.level << "," << confidenceInterval.mean << "," << confidenceInterval.lower << "," << confidenceInterval.upper << "\n";
+				}
 
 				if (outputFrameTimes) {
 					result << "\n" << "frame,ms" << "\n";
 					for (size_t i = 0; i < frameTimes.size(); i++) {
 						result << i << "," << frameTimes[i] << "\n";
 					}
-					double tMin = *std::min_element(frameTimes.begin(), frameTimes.end());
-					double tMax = *std::max_element(frameTimes.begin(), frameTimes.end());
-					double tAvg = std::accumulate(frameTimes.begin(), frameTimes.end(), 0.0) / (double)frameTimes.size();
-					std::cout << "best   : " << (1000.0 / tMin) << " fps (" << tMin << " ms)" << "\n";
-					std::cout << "worst  : " << (1000.0 / tMax) << " fps (" << tMax << " ms)" << "\n";
-					std::cout << "avg    : " << (1000.0 / tAvg) << " fps (" << tAvg << " ms)" << "\n";
-					std::cout << "\n";
+				}
+
+				if (!gpuPassTimes.empty()) {
+					result << "\n" << "pass,gpu ms (avg)" << "\n";
+					for (auto& passTime : gpuPassTimes) {
+						result << passTime.first << "," << passTime.second << "\n";
+						std::cout << "gpu    : " << passTime.first << " " << passTime.second << " ms" << "\n";
+					}
 				}
 
 				result.flush();
+			}
+
+			saveJson();
 #if defined(_WIN32)
-				FreeConsole();
+			FreeConsole();
 #endif
+		}
+
+		/** @brief Writes all results to a machine-readable JSON file next to the results file */
+		void saveJson() {
+			std::ofstream json(getJsonFilename(), std::ios::out);
+			if (!json.is_open()) {
+				return;
+			}
+			json << std::fixed << std::setprecision(4);
+			json << "{\n";
+			json << "\t\"device\": ";
+			writeJsonString(json, deviceProps.deviceName);
+			json << ",\n";
+			json << "\t\"driverVersion\": " << deviceProps.driverVersion << ",\n";
+			json << "\t\"warmup\": " << warmup << ",\n";
+			json << "\t\"duration\": " << duration << ",\n";
+			json << "\t\"runtime\": " << runtime << ",\n";
+			json << "\t\"frames\": " << frameCount << ",\n";
+			json << "\t\"fps\": " << framesPerSecond(frameCount, runtime) << ",\n";
+			json << "\t\"frameTime\": ";
+			writeJsonStatistics(json, statistics, "\t");
+			json << ",\n";
+			json << "\t\"runs\": [";
+			for (size_t i = 0; i < runResults.size(); i++) {
+				json << ((i > 0) ? ",\n" : "\n") << "\t\t{\n";
+				json << "\t\t\t\"runtime\": " << runResults[i].runtime << ",\n";
+				json << "\t\t\t\"fps\": " << framesPerSecond(runResults[i].frameTimes.size(), runResults[i].runtime) << ",\n";
+				json << "\t\t\t\"frameTime\": ";
+				writeJsonStatistics(json, runResults[i].statistics, "\t\t\t");
+				json << "\n\t\t}";
+			}
+			json << "\n\t],\n";
+			// With a single run there is no spread between runs, so the interval collapses to the mean
+			json << "\t\"confidenceInterval\": {\n";
+			json << "\t\t\"level\": " << confidenceInterval.level << ",\n";
+			json << "\t\t\"mean\": " << jsonNumber(confidenceInterval.mean) << ",\n";
+			json << "\t\t\"lower\": " << jsonNumber(confidenceInterval.lower) << ",\n";
+			json << "\t\t\"upper\": " << jsonNumber(confidenceInterval.upper) << "\n";
+			json << "\t},\n";
+			json << "\t\"gpuPasses\": [";
+			for (size_t i = 0; i < gpuPassTimes.size(); i++) {
+				json << ((i > 0) ? ",\n" : "\n") << "\t\t{ \"name\": ";
+				writeJsonString(json, gpuPassTimes[i].first);
+				json << ", \"ms\": " << jsonNumber(gpuPassTimes[i].second) << " }";
+			}
+			json << (gpuPassTimes.empty() ? "]" : "\n\t]");
+			if (outputFrameTimes) {
+				json << ",\n\t\"frameTimes\": [";
+				for (size_t i = 0; i < frameTimes.size(); i++) {
+					json << ((i > 0) ? ", " : "") << jsonNumber(frameTimes[i]);
+				}
+				json << "]";
 			}
+			json << "\n}\n";
+			json.flush();
 		}
 	};
-}
\ No newline at end of file
+}
@@ -0,0 +1,137 @@
+/*
+* Recorded camera and timer tracks for deterministic benchmark runs
+*
+* Copyright (C) 2026 by agent
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+namespace vks
+{
+	/*
+		Camera position, rotation, timer and frame time keyed by frame index
+
+		Tracks are stored as text files with one keyframe per line: frame timer frametime position.x position.y position.z rotation.x rotation.y rotation.z
+		Lines starting with # are comments. Recorded tracks contain every frame, hand written tracks may leave gaps that are linearly interpolated
+	*/
+	class CameraTrack {
+	public:
+		struct Sample {
+			uint32_t frame = 0;
+			float timer = 0.0f;
+			float frameTime = 0.0f;
+			glm::vec3 position = glm::vec3(0.0f);
+			glm::vec3 rotation = glm::vec3(0.0f);
+		};
+
+	private:
+		std::vector<Sample> samples;
+
+	public:
+		bool empty() const
+		{
+			return samples.empty();
+		}
+
+		/** @brief Number of frames covered by the track, frame indices beyond that wrap around */
+		uint32_t frameCount() const
+		{
+			return samples.empty() ? 0 : samples.back().frame + 1;
+		}
+
+		/** @brief Appends a keyframe, frames have to be added in increasing order */
+		void add(const Sample& sample)
+		{
+			if (samples.empty() || (sample.frame > samples.back().frame)) {
+				samples.push_back(sample);
+			}
+		}
+
+		void clear()
+		{
+			samples.clear();
+		}
+
+		/** @brief Returns the camera state for the given frame, interpolated between the surrounding keyframes */
+		Sample sample(uint32_t frame) const
+		{
+			if (samples.empty()) {
+				return Sample();
+			}
+			frame = frame % frameCount();
+			auto next = std::lower_bound(samples.begin(), samples.end(), frame, [](const Sample& sample, uint32_t frame) { return sample.frame < frame; });
+			if (next == samples.begin()) {
+				Sample result = *next;
+				result.frame = frame;
+				return result;
+			}
+			const Sample& a = *(next - 1);
+			const Sample& b = *next;
+			const float t = static_cast<float>(frame - a.frame) / static_cast<float>(b.frame - a.frame);
+			Sample result;
+			result.frame = frame;
+			// The timer wraps from 1 to 0, so interpolate towards the next timer value in positive direction
+			const float timerEnd = (b.timer < a.timer) ? b.timer + 1.0f : b.timer;
+			result.timer = std::fmod(glm::mix(a.timer, timerEnd, t), 1.0f);
+			result.frameTime = glm::mix(a.frameTime, b.frameTime, t);
+			result.position = glm::mix(a.position, b.position, t);
+			result.rotation = glm::mix(a.rotation, b.rotation, t);
+			return result;
+		}
+
+		/** @brief Loads a track from a file, returns false if the file can't be opened or contains no keyframes */
+		bool load(const std::string& filename)
+		{
+			samples.clear();
+			std::ifstream file(filename);
+			if (!file.is_open()) {
+				return false;
+			}
+			std::string line;
+			while (std::getline(file, line)) {
+				if (line.empty() || (line[0] == '#')) {
+					continue;
+				}
+				std::istringstream values(line);
+				Sample sample;
+				if (values >> sample.frame >> sample.timer >> sample.frameTime >> sample.position.x >> sample.position.y >> sample.position.z >> sample.rotation.x >> sample.rotation.y >> sample.rotation.z) {
+					add(sample);
+				}
+			}
+			return !samples.empty();
+		}
+
+		/** @brief Writes the track to a file that can be loaded with load() */
+		bool save(const std::string& filename) const
+		{
+			std::ofstream file(filename);
+			if (!file.is_open()) {
+				return false;
+			}
+			file << "# frame timer frametime position.x position.y position.z rotation.x rotation.y rotation.z" << "\n";
+			// Enough digits to restore the exact float values
+			file << std::setprecision(9);
+			for (const Sample& sample : samples) {
+				file << sample.frame << " " << sample.timer << " " << sample.frameTime << " "
+					<< sample.position.x << " " << sample.position.y << " " << sample.position.z << " "
+					<< sample.rotation.x << " " << sample.rotation.y << " " << sample.rotation.z << "\n";
+			}
+			return true;
+		}
+	};
+}
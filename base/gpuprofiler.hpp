@@ -0,0 +1,250 @@
+/*
+* GPU timestamp profiler for per-pass timings
+*
+* Copyright (C) 2026 by agent
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+#include <algorithm>
+
+#include "vulkan/vulkan.h"
+#include "VulkanDevice.h"
+#include "VulkanTools.h"
+
+namespace vks
+{
+	/*
+		Measures the GPU time of named passes with timestamp queries
+
+		Every command buffer that records markers gets its own range of queries in a shared query pool (ring of slots), so pre-recorded command buffers can be reused without re-recording
+		Results are read with vkGetQueryPoolResults without waiting once the command buffer is known to have finished, timestamps that are not yet available are skipped instead of stalling
+		If the device or the graphics queue doesn't support timestamps, all calls are no-ops
+	*/
+	class GpuProfiler {
+	public:
+		struct Pass {
+			std::string name;
+			// GPU time of the most recently resolved frame in milliseconds
+			double ms = 0.0;
+			// Accumulated GPU time and number of resolved frames since the last call to resetStatistics
+			double totalMs = 0.0;
+			uint64_t samples = 0;
+
+			double average() const
+			{
+				return (samples > 0) ? totalMs / static_cast<double>(samples) : 0.0;
+			}
+		};
+
+	private:
+		struct Slot {
+			uint32_t firstQuery;
+			// Pass index of each begin/end query pair recorded into the command buffer
+			std::vector<uint32_t> scopes;
+		};
+		vks::VulkanDevice* device{ nullptr };
+		VkQueryPool queryPool{ VK_NULL_HANDLE };
+		float timestampPeriod{ 1.0f };
+		uint64_t timestampMask{ UINT64_MAX };
+		uint32_t maxScopes{ 0 };
+		uint32_t slotCount{ 0 };
+		std::unordered_map<VkCommandBuffer, Slot> slots;
+		std::vector<uint32_t> freeSlots;
+		std::vector<uint64_t> results;
+
+		uint32_t findPass(const std::string& name)
+		{
+			for (uint32_t i = 0; i < passes.size(); i++) {
+				if (passes[i].name == name) {
+					return i;
+				}
+			}
+			Pass pass;
+			pass.name = name;
+			passes.push_back(pass);
+			return static_cast<uint32_t>(passes.size() - 1);
+		}
+
+		Slot* findSlot(VkCommandBuffer commandBuffer)
+		{
+			auto it = slots.find(commandBuffer);
+			return (it != slots.end()) ? &it->second : nullptr;
+		}
+
+	public:
+		bool supported = false;
+		// All passes in the order they were first recorded
+		std::vector<Pass> passes;
+
+		/**
+		* Creates the query pool
+		*
+		* @param device Device used to create the query pool
+		* @param queue Graphics queue used for the initial reset of the query pool
+		* @param commandBufferCount Maximum number of command buffers that record markers at the same time
+		* @param maxScopes Maximum number of scopes per command buffer
+		*/
+		void prepare(vks::VulkanDevice* device, VkQueue queue, uint32_t commandBufferCount, uint32_t maxScopes = 32)
+		{
+			this->device = device;
+			this->maxScopes = maxScopes;
+			const uint32_t timestampValidBits = device->queueFamilyProperties[device->queueFamilyIndices.graphics].timestampValidBits;
+			supported = (device->properties.limits.timestampComputeAndGraphics == VK_TRUE) && (timestampValidBits > 0);
+			if (!supported) {
+				return;
+			}
+			timestampPeriod = device->properties.limits.timestampPeriod;
+			timestampMask = (timestampValidBits >= 64) ? UINT64_MAX : ((1ull << timestampValidBits) - 1);
+			slotCount = commandBufferCount;
+			freeSlots.clear();
+			for (uint32_t i = slotCount; i > 0; i--) {
+				freeSlots.push_back(i - 1);
+			}
+
+			VkQueryPoolCreateInfo queryPoolInfo{};
+			queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			queryPoolInfo.queryCount = slotCount * maxScopes * 2;
+			VK_CHECK_RESULT(vkCreateQueryPool(device->logicalDevice, &queryPoolInfo, nullptr, &queryPool));
+			// Queries have to be reset once before their results can be read, even if they have never been written
+			VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			vkCmdResetQueryPool(commandBuffer, queryPool, 0, queryPoolInfo.queryCount);
+			device->flushCommandBuffer(commandBuffer, queue, true);
+			results.resize(maxScopes * 2 * 2);
+		}
+
+		void destroy()
+		{
+			if (queryPool != VK_NULL_HANDLE) {
+				vkDestroyQueryPool(device->logicalDevice, queryPool, nullptr);
+				queryPool = VK_NULL_HANDLE;
+			}
+			slots.clear();
+			freeSlots.clear();
+		}
+
+		/** @brief Starts recording markers into a command buffer, must be called outside of a render pass right after vkBeginCommandBuffer */
+		void beginFrame(VkCommandBuffer commandBuffer)
+		{
+			if (!supported) {
+				return;
+			}
+			Slot* slot = findSlot(commandBuffer);
+			if (!slot) {
+				if (freeSlots.empty()) {
+					return;
+				}
+				slot = &slots[commandBuffer];
+				slot->firstQuery = freeSlots.back() * maxScopes * 2;
+				freeSlots.pop_back();
+			}
+			slot->scopes.clear();
+			vkCmdResetQueryPool(commandBuffer, queryPool, slot->firstQuery, maxScopes * 2);
+		}
+
+		/** @brief Writes the start timestamp of a named pass, returns the scope to pass to end() */
+		uint32_t begin(VkCommandBuffer commandBuffer, const std::string& name)
+		{
+			Slot* slot = supported ? findSlot(commandBuffer) : nullptr;
+			if (!slot || (slot->scopes.size() >= maxScopes)) {
+				return UINT32_MAX;
+			}
+			const uint32_t scope = static_cast<uint32_t>(slot->scopes.size());
+			slot->scopes.push_back(findPass(name));
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, slot->firstQuery + scope * 2);
+			return scope;
+		}
+
+		/** @brief Writes the end timestamp of a scope returned by begin() */
+		void end(VkCommandBuffer commandBuffer, uint32_t scope)
+		{
+			Slot* slot = supported ? findSlot(commandBuffer) : nullptr;
+			if (!slot || (scope >= slot->scopes.size())) {
+				return;
+			}
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, slot->firstQuery + scope * 2 + 1);
+		}
+
+		/**
+		* Reads the timings of the last submission of a command buffer without waiting
+		* Call this once per submission after the command buffer has finished execution (e.g. after waiting for its fence) and before it's submitted again
+		*/
+		void resolve(VkCommandBuffer commandBuffer)
+		{
+			Slot* slot = supported ? findSlot(commandBuffer) : nullptr;
+			if (!slot || slot->scopes.empty()) {
+				return;
+			}
+			const uint32_t queryCount = static_cast<uint32_t>(slot->scopes.size()) * 2;
+			// Each result is followed by its availability, so partially finished results can be used without VK_QUERY_RESULT_WAIT_BIT
+			VkResult result = vkGetQueryPoolResults(device->logicalDevice, queryPool, slot->firstQuery, queryCount, queryCount * 2 * sizeof(uint64_t), results.data(), 2 * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+			if ((result != VK_SUCCESS) && (result != VK_NOT_READY)) {
+				VK_CHECK_RESULT(result);
+			}
+			// A pass may be recorded more than once per frame, so durations are summed up before updating the statistics
+			std::vector<double> frameMs(passes.size(), -1.0);
+			for (size_t i = 0; i < slot->scopes.size(); i++) {
+				const uint64_t* timestamps = &results[i * 4];
+				if ((timestamps[1] == 0) || (timestamps[3] == 0)) {
+					continue;
+				}
+				const uint64_t ticks = (timestamps[2] - timestamps[0]) & timestampMask;
+				double& ms = frameMs[slot->scopes[i]];
+				ms = std::max(ms, 0.0) + static_cast<double>(ticks) * timestampPeriod / 1000000.0;
+			}
+			for (size_t i = 0; i < passes.size(); i++) {
+				if (frameMs[i] >= 0.0) {
+					passes[i].ms = frameMs[i];
+					passes[i].totalMs += frameMs[i];
+					passes[i].samples++;
+				}
+			}
+		}
+
+		/** @brief Returns the slot of a command buffer to the ring, call this before the command buffer is freed */
+		void releaseCommandBuffer(VkCommandBuffer commandBuffer)
+		{
+			Slot* slot = findSlot(commandBuffer);
+			if (slot) {
+				freeSlots.push_back(slot->firstQuery / (maxScopes * 2));
+				slots.erase(commandBuffer);
+			}
+		}
+
+		/** @brief Clears the accumulated timings of all passes, e.g. after a warm-up phase */
+		void resetStatistics()
+		{
+			for (Pass& pass : passes) {
+				pass.totalMs = 0.0;
+				pass.samples = 0;
+			}
+		}
+	};
+
+	/*
+		Writes begin and end timestamps for a pass within the lifetime of the object
+	*/
+	class GpuProfilerScope {
+	private:
+		GpuProfiler& profiler;
+		VkCommandBuffer commandBuffer;
+		uint32_t scope;
+	public:
+		GpuProfilerScope(GpuProfiler& profiler, VkCommandBuffer commandBuffer, const std::string& name) : profiler(profiler), commandBuffer(commandBuffer)
+		{
+			scope = profiler.begin(commandBuffer, name);
+		}
+
+		~GpuProfilerScope()
+		{
+			profiler.end(commandBuffer, scope);
+		}
+	};
+}
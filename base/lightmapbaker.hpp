@@ -0,0 +1,453 @@
+/*
+* CPU lightmap baker with a bounding volume hierarchy for ray queries
+*
+* Copyright (C) 2026 by agent
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+#include <cstddef>
+#include <cfloat>
+#include <cmath>
+#include <algorithm>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include "threadpool.hpp"
+
+namespace vks
+{
+	namespace lightmap
+	{
+		/*
+			Bounding volume hierarchy over an indexed triangle list
+			Nodes are split at the median of their triangle centroids along the longest axis, leaves hold up to maxLeafTriangles triangles
+		*/
+		class BVH {
+		public:
+			struct Hit {
+				uint32_t triangle;
+				float t;
+				// Barycentric coordinates of the hit point for the second and third vertex of the triangle
+				float u, v;
+			};
+
+		private:
+			struct Node {
+				glm::vec3 min;
+				// Index of the first child (inner nodes, the second child follows it) or the first triangle (leaves)
+				uint32_t first;
+				glm::vec3 max;
+				uint32_t count;
+			};
+			static const uint32_t maxLeafTriangles = 4;
+			const std::vector<glm::vec3>& positions;
+			const std::vector<uint32_t>& indices;
+			std::vector<Node> nodes;
+			std::vector<uint32_t> triangles;
+
+			void build(uint32_t nodeIndex, uint32_t first, uint32_t count, const std::vector<glm::vec3>& centroids)
+			{
+				glm::vec3 min(FLT_MAX), max(-FLT_MAX);
+				glm::vec3 centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+				for (uint32_t i = first; i < first + count; i++) {
+					const uint32_t t = triangles[i];
+					for (size_t c = 0; c < 3; c++) {
+						min = glm::min(min, positions[indices[t * 3 + c]]);
+						max = glm::max(max, positions[indices[t * 3 + c]]);
+					}
+					centroidMin = glm::min(centroidMin, centroids[t]);
+					centroidMax = glm::max(centroidMax, centroids[t]);
+				}
+				nodes[nodeIndex].min = min;
+				nodes[nodeIndex].max = max;
+				glm::vec3 extent = centroidMax - centroidMin;
+				int axis = (extent.x > extent.y) ? ((extent.x > extent.z) ? 0 : 2) : ((extent.y > extent.z) ? 1 : 2);
+				if ((count <= maxLeafTriangles) || (extent[axis] <= 0.0f)) {
+					nodes[nodeIndex].first = first;
+					nodes[nodeIndex].count = count;
+					return;
+				}
+				const uint32_t half = count / 2;
+				std::nth_element(triangles.begin() + first, triangles.begin() + first + half, triangles.begin() + first + count, [&](uint32_t a, uint32_t b) {
+					return centroids[a][axis] < centroids[b][axis];
+				});
+				const uint32_t left = static_cast<uint32_t>(nodes.size());
+				nodes.push_back({});
+				nodes.push_back({});
+				nodes[nodeIndex].first = left;
+				nodes[nodeIndex].count = 0;
+				build(left, first, half, centroids);
+				build(left + 1, first + half, count - half, centroids);
+			}
+
+			static bool intersectBox(const Node& node, const glm::vec3& origin, const glm::vec3& inverseDirection, float tMax)
+			{
+				glm::vec3 t0 = (node.min - origin) * inverseDirection;
+				glm::vec3 t1 = (node.max - origin) * inverseDirection;
+				glm::vec3 tNear = glm::min(t0, t1);
+				glm::vec3 tFar = glm::max(t0, t1);
+				float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+				float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+				return enter <= exit;
+			}
+
+			// Möller-Trumbore ray triangle intersection
+			bool intersectTriangle(uint32_t triangle, const glm::vec3& origin, const glm::vec3& direction, float tMax, Hit& hit) const
+			{
+				const glm::vec3& p0 = positions[indices[triangle * 3]];
+				glm::vec3 e1 = positions[indices[triangle * 3 + 1]] - p0;
+				glm::vec3 e2 = positions[indices[triangle * 3 + 2]] - p0;
+				glm::vec3 p = glm::cross(direction, e2);
+				float det = glm::dot(e1, p);
+				if (std::abs(det) < 1e-12f) {
+					return false;
+				}
+				float inverseDet = 1.0f / det;
+				glm::vec3 s = origin - p0;
+				float u = glm::dot(s, p) * inverseDet;
+				if ((u < 0.0f) || (u > 1.0f)) {
+					return false;
+				}
+				glm::vec3 q = glm::cross(s, e1);
+				float v = glm::dot(direction, q) * inverseDet;
+				if ((v < 0.0f) || (u + v > 1.0f)) {
+					return false;
+				}
+				float t = glm::dot(e2, q) * inverseDet;
+				if ((t <= 0.0f) || (t >= tMax)) {
+					return false;
+				}
+				hit = { triangle, t, u, v };
+				return true;
+			}
+
+			template<bool anyHit>
+			bool traverse(const glm::vec3& origin, const glm::vec3& direction, float tMax, Hit& hit) const
+			{
+				if (nodes.empty()) {
+					return false;
+				}
+				const glm::vec3 inverseDirection = 1.0f / direction;
+				bool found = false;
+				uint32_t stack[64];
+				uint32_t stackSize = 0;
+				stack[stackSize++] = 0;
+				while (stackSize > 0) {
+					const Node& node = nodes[stack[--stackSize]];
+					if (!intersectBox(node, origin, inverseDirection, tMax)) {
+						continue;
+					}
+					if (node.count > 0) {
+						for (uint32_t i = node.first; i < node.first + node.count; i++) {
+							if (intersectTriangle(triangles[i], origin, direction, tMax, hit)) {
+								if (anyHit) {
+									return true;
+								}
+								tMax = hit.t;
+								found = true;
+							}
+						}
+					} else {
+						stack[stackSize++] = node.first;
+						stack[stackSize++] = node.first + 1;
+					}
+				}
+				return found;
+			}
+
+		public:
+			/** @brief Builds the hierarchy, positions and indices are referenced and must outlive the BVH */
+			BVH(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices) : positions(positions), indices(indices)
+			{
+				const uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+				if (triangleCount == 0) {
+					return;
+				}
+				std::vector<glm::vec3> centroids(triangleCount);
+				triangles.resize(triangleCount);
+				for (uint32_t t = 0; t < triangleCount; t++) {
+					centroids[t] = (positions[indices[t * 3]] + positions[indices[t * 3 + 1]] + positions[indices[t * 3 + 2]]) / 3.0f;
+					triangles[t] = t;
+				}
+				nodes.reserve(triangleCount * 2);
+				nodes.push_back({});
+				build(0, 0, triangleCount, centroids);
+			}
+
+			/** @brief Returns the closest hit along the ray in (0, tMax) */
+			bool intersect(const glm::vec3& origin, const glm::vec3& direction, float tMax, Hit& hit) const
+			{
+				return traverse<false>(origin, direction, tMax, hit);
+			}
+
+			/** @brief Returns true if anything is hit along the ray in (0, tMax) */
+			bool occluded(const glm::vec3& origin, const glm::vec3& direction, float tMax) const
+			{
+				Hit hit;
+				return traverse<true>(origin, direction, tMax, hit);
+			}
+		};
+
+		/*
+			Scene description for baking, all attributes are per vertex and lightmap coordinates are in [0, 1]
+		*/
+		struct BakeInput {
+			std::vector<glm::vec3> positions;
+			std::vector<glm::vec3> normals;
+			std::vector<glm::vec3> albedo;
+			std::vector<glm::vec2> lightmapUV;
+			std::vector<uint32_t> indices;
+		};
+
+		/*
+			Lighting and quality settings for baking
+			The scene is lit by a directional light and a uniform sky, skyIrradiance is the irradiance the sky contributes to an unoccluded surface
+		*/
+		struct BakeSettings {
+			glm::vec3 lightDirection = glm::vec3(-0.5f, -1.0f, -0.3f);
+			glm::vec3 lightColor = glm::vec3(1.0f);
+			glm::vec3 skyIrradiance = glm::vec3(0.2f, 0.25f, 0.3f);
+			uint32_t samples = 64;
+			// Number of diffuse bounces, 0 only bakes direct light and at least one is required for sky light
+			uint32_t bounces = 2;
+			// Offset along the normal for secondary rays, relative to the scene size
+			float rayOffset = 1e-4f;
+			// Number of texel rings that are filled around the charts so filtering doesn't pull in unbaked texels
+			uint32_t dilation = 2;
+		};
+
+		/*
+			Monte Carlo path tracer that bakes irradiance (direct and indirect diffuse lighting) into lightmap texels
+			Each texel is rasterized from the triangle covering its center, rows of texels are traced in parallel on a thread pool
+			Random numbers are seeded per texel, so the result doesn't depend on the number of threads
+		*/
+		class Baker {
+		private:
+			const BakeInput& input;
+			const BakeSettings& settings;
+			BVH bvh;
+			float rayOffset;
+
+			static uint32_t hash(uint32_t x)
+			{
+				x ^= x >> 16;
+				x *= 0x7feb352du;
+				x ^= x >> 15;
+				x *= 0x846ca68bu;
+				x ^= x >> 16;
+				return x;
+			}
+
+			static float random(uint32_t& state)
+			{
+				state = state * 747796405u + 2891336453u;
+				return static_cast<float>(hash(state) >> 8) / 16777216.0f;
+			}
+
+			// Cosine weighted direction in the hemisphere around n
+			static glm::vec3 sampleHemisphere(const glm::vec3& n, uint32_t& state)
+			{
+				const float r1 = random(state);
+				const float r2 = random(state);
+				const float phi = 2.0f * 3.14159265358979f * r1;
+				const float r = std::sqrt(r2);
+				glm::vec3 tangent = (std::abs(n.x) > 0.9f) ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+				tangent = glm::normalize(glm::cross(tangent, n));
+				glm::vec3 bitangent = glm::cross(n, tangent);
+				return glm::normalize(tangent * (r * std::cos(phi)) + bitangent * (r * std::sin(phi)) + n * std::sqrt(std::max(0.0f, 1.0f - r2)));
+			}
+
+			glm::vec3 direct(const glm::vec3& position, const glm::vec3& normal) const
+			{
+				const glm::vec3 toLight = -glm::normalize(settings.lightDirection);
+				const float nDotL = glm::dot(normal, toLight);
+				if ((nDotL <= 0.0f) || bvh.occluded(position + normal * rayOffset, toLight, FLT_MAX)) {
+					return glm::vec3(0.0f);
+				}
+				return settings.lightColor * nDotL;
+			}
+
+			// One sample of the irradiance arriving from the hemisphere around normal, including bounces
+			glm::vec3 indirect(const glm::vec3& position, const glm::vec3& normal, uint32_t bounce, uint32_t& state) const
+			{
+				const glm::vec3 direction = sampleHemisphere(normal, state);
+				BVH::Hit hit;
+				if (!bvh.intersect(position + normal * rayOffset, direction, FLT_MAX, hit)) {
+					return settings.skyIrradiance;
+				}
+				const uint32_t* triangle = &input.indices[hit.triangle * 3];
+				const float w = 1.0f - hit.u - hit.v;
+				glm::vec3 hitPosition = position + normal * rayOffset + direction * hit.t;
+				glm::vec3 hitNormal = glm::normalize(input.normals[triangle[0]] * w + input.normals[triangle[1]] * hit.u + input.normals[triangle[2]] * hit.v);
+				// Surfaces are treated as two sided
+				if (glm::dot(hitNormal, direction) > 0.0f) {
+					hitNormal = -hitNormal;
+				}
+				glm::vec3 albedo = input.albedo[triangle[0]] * w + input.albedo[triangle[1]] * hit.u + input.albedo[triangle[2]] * hit.v;
+				glm::vec3 irradiance = direct(hitPosition, hitNormal);
+				if (bounce + 1 < settings.bounces) {
+					irradiance += indirect(hitPosition, hitNormal, bounce + 1, state);
+				}
+				// Radiance leaving a diffuse surface is albedo / pi * irradiance, the cosine weighted pdf cancels the pi
+				return albedo * irradiance;
+			}
+
+		public:
+			Baker(const BakeInput& input, const BakeSettings& settings) : input(input), settings(settings), bvh(input.positions, input.indices)
+			{
+				glm::vec3 min(FLT_MAX), max(-FLT_MAX);
+				for (const glm::vec3& p : input.positions) {
+					min = glm::min(min, p);
+					max = glm::max(max, p);
+				}
+				rayOffset = input.positions.empty() ? settings.rayOffset : settings.rayOffset * std::max(glm::length(max - min), 1e-3f);
+			}
+
+			/**
+			* Bakes the lightmap
+			*
+			* @return width * height texels with the irradiance in rgb and the coverage (1 for texels covered by a triangle or filled by dilation) in alpha
+			*/
+			std::vector<glm::vec4> bake(uint32_t width, uint32_t height) const
+			{
+				// Rasterize all triangles in lightmap space, texels store the triangle covering their center and its barycentric coordinates
+				std::vector<BVH::Hit> texels(static_cast<size_t>(width) * height, BVH::Hit{ UINT32_MAX, 0.0f, 0.0f, 0.0f });
+				const glm::vec2 size(static_cast<float>(width), static_cast<float>(height));
+				for (uint32_t t = 0; t < input.indices.size() / 3; t++) {
+					glm::vec2 uv0 = input.lightmapUV[input.indices[t * 3]] * size;
+					glm::vec2 uv1 = input.lightmapUV[input.indices[t * 3 + 1]] * size;
+					glm::vec2 uv2 = input.lightmapUV[input.indices[t * 3 + 2]] * size;
+					const float area = (uv1.x - uv0.x) * (uv2.y - uv0.y) - (uv2.x - uv0.x) * (uv1.y - uv0.y);
+					if (std::abs(area) < 1e-12f) {
+						continue;
+					}
+					glm::vec2 min = glm::min(uv0, glm::min(uv1, uv2));
+					glm::vec2 max = glm::max(uv0, glm::max(uv1, uv2));
+					const uint32_t x0 = static_cast<uint32_t>(std::max(std::floor(min.x), 0.0f));
+					const uint32_t y0 = static_cast<uint32_t>(std::max(std::floor(min.y), 0.0f));
+					const uint32_t x1 = static_cast<uint32_t>(std::min(std::ceil(max.x), size.x));
+					const uint32_t y1 = static_cast<uint32_t>(std::min(std::ceil(max.y), size.y));
+					for (uint32_t y = y0; y < y1; y++) {
+						for (uint32_t x = x0; x < x1; x++) {
+							const glm::vec2 p(x + 0.5f, y + 0.5f);
+							const float u = ((p.x - uv0.x) * (uv2.y - uv0.y) - (uv2.x - uv0.x) * (p.y - uv0.y)) / area;
+							const float v = ((uv1.x - uv0.x) * (p.y - uv0.y) - (p.x - uv0.x) * (uv1.y - uv0.y)) / area;
+							if ((u >= 0.0f) && (v >= 0.0f) && (u + v <= 1.0f)) {
+								texels[static_cast<size_t>(y) * width + x] = { t, 0.0f, u, v };
+							}
+						}
+					}
+				}
+
+				std::vector<glm::vec4> result(texels.size(), glm::vec4(0.0f));
+				const uint32_t threadCount = std::max(std::min(std::thread::hardware_concurrency(), height), 1u);
+				vks::ThreadPool threadPool;
+				threadPool.setThreadCount(threadCount);
+				std::atomic<uint32_t> nextRow{ 0 };
+				for (uint32_t i = 0; i < threadCount; i++) {
+					threadPool.threads[i]->addJob([&] {
+						uint32_t y;
+						while ((y = nextRow++) < height) {
+							for (uint32_t x = 0; x < width; x++) {
+								const size_t texel = static_cast<size_t>(y) * width + x;
+								const BVH::Hit& sample = texels[texel];
+								if (sample.triangle == UINT32_MAX) {
+									continue;
+								}
+								const uint32_t* triangle = &input.indices[sample.triangle * 3];
+								const float w = 1.0f - sample.u - sample.v;
+								glm::vec3 position = input.positions[triangle[0]] * w + input.positions[triangle[1]] * sample.u + input.positions[triangle[2]] * sample.v;
+								glm::vec3 normal = input.normals[triangle[0]] * w + input.normals[triangle[1]] * sample.u + input.normals[triangle[2]] * sample.v;
+								if (glm::dot(normal, normal) < 1e-12f) {
+									normal = glm::cross(input.positions[triangle[1]] - input.positions[triangle[0]], input.positions[triangle[2]] - input.positions[triangle[0]]);
+								}
+								normal = glm::normalize(normal);
+								uint32_t state = hash(static_cast<uint32_t>(texel) * 9781u + 1u);
+								glm::vec3 irradiance(0.0f);
+								if (settings.bounces > 0) {
+									for (uint32_t s = 0; s < settings.samples; s++) {
+										irradiance += indirect(position, normal, 0, state);
+									}
+									irradiance /= static_cast<float>(std::max(settings.samples, 1u));
+								}
+								irradiance += direct(position, normal);
+								result[texel] = glm::vec4(irradiance, 1.0f);
+							}
+						}
+					});
+				}
+				threadPool.wait();
+
+				// Fill empty texels next to covered ones with the average of their covered neighbours
+				for (uint32_t ring = 0; ring < settings.dilation; ring++) {
+					std::vector<glm::vec4> dilated(result);
+					for (uint32_t y = 0; y < height; y++) {
+						for (uint32_t x = 0; x < width; x++) {
+							if (result[static_cast<size_t>(y) * width + x].w > 0.0f) {
+								continue;
+							}
+							glm::vec4 sum(0.0f);
+							for (int dy = -1; dy <= 1; dy++) {
+								for (int dx = -1; dx <= 1; dx++) {
+									const int nx = static_cast<int>(x) + dx;
+									const int ny = static_cast<int>(y) + dy;
+									if ((nx >= 0) && (ny >= 0) && (nx < static_cast<int>(width)) && (ny < static_cast<int>(height))) {
+										const glm::vec4& neighbour = result[static_cast<size_t>(ny) * width + nx];
+										if (neighbour.w > 0.0f) {
+											sum += glm::vec4(glm::vec3(neighbour), 1.0f);
+										}
+									}
+								}
+							}
+							if (sum.w > 0.0f) {
+								dilated[static_cast<size_t>(y) * width + x] = glm::vec4(glm::vec3(sum) / sum.w, 1.0f);
+							}
+						}
+					}
+					result.swap(dilated);
+				}
+
+				return result;
+			}
+		};
+
+		/**
+		* Writes texels to a KTX (version 1) file with a single RGBA16F (VK_FORMAT_R16G16B16A16_SFLOAT) mip level
+		* The file can be loaded with vks::Texture2D::loadFromFile
+		*/
+		inline bool writeKTX(const std::string& filename, const std::vector<glm::vec4>& texels, uint32_t width, uint32_t height)
+		{
+			std::ofstream file(filename, std::ios::binary);
+			if (!file.is_open()) {
+				return false;
+			}
+			const uint8_t identifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+			// endianness, glType (GL_HALF_FLOAT), glTypeSize, glFormat (GL_RGBA), glInternalFormat (GL_RGBA16F), glBaseInternalFormat (GL_RGBA)
+			// pixelWidth, pixelHeight, pixelDepth, numberOfArrayElements, numberOfFaces, numberOfMipmapLevels, bytesOfKeyValueData
+			const uint32_t header[13] = { 0x04030201, 0x140B, 2, 0x1908, 0x881A, 0x1908, width, height, 0, 0, 1, 1, 0 };
+			file.write(reinterpret_cast<const char*>(identifier), sizeof(identifier));
+			file.write(reinterpret_cast<const char*>(header), sizeof(header));
+			// Rows of 8 byte texels are always 4 byte aligned, so no row padding is required
+			std::vector<uint32_t> data(texels.size() * 2);
+			for (size_t i = 0; i < texels.size(); i++) {
+				data[i * 2] = glm::packHalf2x16(glm::vec2(texels[i].x, texels[i].y));
+				data[i * 2 + 1] = glm::packHalf2x16(glm::vec2(texels[i].z, texels[i].w));
+			}
+			const uint32_t imageSize = static_cast<uint32_t>(data.size() * sizeof(uint32_t));
+			file.write(reinterpret_cast<const char*>(&imageSize), sizeof(imageSize));
+			file.write(reinterpret_cast<const char*>(data.data()), imageSize);
+			return file.good();
+		}
+	}
+}
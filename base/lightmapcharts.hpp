@@ -0,0 +1,190 @@
+/*
+* Lightmap chart building for indexed triangle lists
+*
+* Copyright (C) 2026 by agent
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+namespace vks
+{
+	namespace lightmap
+	{
+		/** @brief Returns the dominant axis (0 = x, 1 = y, 2 = z) of a normal, triangles are projected along this axis */
+		inline int dominantAxis(const glm::vec3& normal)
+		{
+			glm::vec3 n = glm::abs(normal);
+			if ((n.x > n.y) && (n.x > n.z)) {
+				return 0;
+			}
+			if ((n.y > n.x) && (n.y > n.z)) {
+				return 1;
+			}
+			return 2;
+		}
+
+		/*
+			Union-find with path halving and union by size
+		*/
+		class DisjointSet {
+		private:
+			std::vector<uint32_t> parent;
+			std::vector<uint32_t> size;
+		public:
+			explicit DisjointSet(size_t count) : parent(count), size(count, 1)
+			{
+				for (size_t i = 0; i < count; i++) {
+					parent[i] = static_cast<uint32_t>(i);
+				}
+			}
+
+			uint32_t find(uint32_t i)
+			{
+				while (parent[i] != i) {
+					parent[i] = parent[parent[i]];
+					i = parent[i];
+				}
+				return i;
+			}
+
+			void unite(uint32_t a, uint32_t b)
+			{
+				a = find(a);
+				b = find(b);
+				if (a == b) {
+					return;
+				}
+				if (size[a] < size[b]) {
+					std::swap(a, b);
+				}
+				parent[b] = a;
+				size[a] += size[b];
+			}
+		};
+
+		/*
+			Charts of a triangle list
+			A chart is a set of triangles connected by edges that share the same dominant normal axis, so it can be projected onto a single plane
+			Vertices used by more than one chart are split, so every chart can get its own lightmap coordinates
+		*/
+		struct Charts {
+			uint32_t chartCount = 0;
+			// Chart and dominant axis of each triangle
+			std::vector<uint32_t> triangleChart;
+			std::vector<int> chartAxis;
+			// Triangle list referencing the original vertices followed by the split vertices
+			std::vector<uint32_t> indices;
+			// Source vertex of each split vertex, split vertex i has the index vertexCount + i
+			std::vector<uint32_t> splitVertices;
+		};
+
+		/**
+		* Groups the triangles of an indexed triangle list into charts in linear time
+		* Connectivity is based on vertex positions, so triangles on either side of a texture or normal seam can still form a single chart
+		* Charts are numbered in the order of their first triangle, so the result is stable across runs and platforms
+		*
+		* @param indices Triangle list with indices in the range [0, vertexCount)
+		* @param position Returns the position of a vertex
+		*/
+		template<typename PositionFunc>
+		inline Charts buildCharts(const uint32_t* indices, size_t indexCount, size_t vertexCount, PositionFunc position)
+		{
+			Charts charts;
+			const size_t triangleCount = indexCount / 3;
+
+			// Weld vertices by position for connectivity
+			struct PositionHash {
+				size_t operator()(const glm::vec3& p) const
+				{
+					uint32_t bits[3];
+					memcpy(bits, &p, sizeof(bits));
+					return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+				}
+			};
+			std::vector<uint32_t> weld(vertexCount);
+			{
+				std::unordered_map<glm::vec3, uint32_t, PositionHash> firstVertex;
+				firstVertex.reserve(vertexCount);
+				for (size_t v = 0; v < vertexCount; v++) {
+					weld[v] = firstVertex.emplace(glm::vec3(position(static_cast<uint32_t>(v))), static_cast<uint32_t>(v)).first->second;
+				}
+			}
+
+			std::vector<int> triangleAxis(triangleCount);
+			for (size_t t = 0; t < triangleCount; t++) {
+				glm::vec3 p0(position(indices[t * 3]));
+				glm::vec3 p1(position(indices[t * 3 + 1]));
+				glm::vec3 p2(position(indices[t * 3 + 2]));
+				triangleAxis[t] = dominantAxis(glm::cross(p1 - p0, p2 - p0));
+			}
+
+			// Triangles sharing an edge with the same axis are merged, each edge is looked up once per triangle
+			// There is one edge map per axis, so only compatible triangles meet
+			DisjointSet sets(triangleCount);
+			std::unordered_map<uint64_t, uint32_t> edgeTriangle[3];
+			for (size_t t = 0; t < triangleCount; t++) {
+				for (size_t e = 0; e < 3; e++) {
+					uint64_t a = weld[indices[t * 3 + e]];
+					uint64_t b = weld[indices[t * 3 + (e + 1) % 3]];
+					if (a == b) {
+						continue;
+					}
+					// Both windings of an edge map to the same key
+					uint64_t key = (std::min(a, b) << 32) | std::max(a, b);
+					auto it = edgeTriangle[triangleAxis[t]].emplace(key, static_cast<uint32_t>(t));
+					if (!it.second) {
+						sets.unite(it.first->second, static_cast<uint32_t>(t));
+					}
+				}
+			}
+
+			std::vector<uint32_t> rootChart(triangleCount, UINT32_MAX);
+			charts.triangleChart.resize(triangleCount);
+			for (size_t t = 0; t < triangleCount; t++) {
+				uint32_t root = sets.find(static_cast<uint32_t>(t));
+				if (rootChart[root] == UINT32_MAX) {
+					rootChart[root] = charts.chartCount++;
+					charts.chartAxis.push_back(triangleAxis[t]);
+				}
+				charts.triangleChart[t] = rootChart[root];
+			}
+
+			// The first chart using a vertex keeps it, all other charts get a copy
+			std::vector<uint32_t> vertexChart(vertexCount, UINT32_MAX);
+			std::unordered_map<uint64_t, uint32_t> splits;
+			charts.indices.resize(triangleCount * 3);
+			for (size_t t = 0; t < triangleCount; t++) {
+				const uint32_t chart = charts.triangleChart[t];
+				for (size_t c = 0; c < 3; c++) {
+					uint32_t v = indices[t * 3 + c];
+					if (vertexChart[v] == UINT32_MAX) {
+						vertexChart[v] = chart;
+					} else if (vertexChart[v] != chart) {
+						auto it = splits.emplace((static_cast<uint64_t>(v) << 32) | chart, static_cast<uint32_t>(vertexCount + charts.splitVertices.size()));
+						if (it.second) {
+							charts.splitVertices.push_back(v);
+						}
+						v = it.first->second;
+					}
+					charts.indices[t * 3 + c] = v;
+				}
+			}
+
+			return charts;
+		}
+	}
+}
@@ -0,0 +1,126 @@
+/*
+* Read-only memory mapped file
+*
+* Copyright (C) 2026 by agent
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace vks
+{
+	/*
+	* Maps a whole file into the address space of the process
+	* Pages are only read from disk when they're accessed and can be dropped by the os at any time, so large files can be read in place without being copied to the heap
+	*/
+	class MappedFile
+	{
+	private:
+		const unsigned char* ptr = nullptr;
+		size_t length = 0;
+#if defined(_WIN32)
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = nullptr;
+#endif
+	public:
+		MappedFile() = default;
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		~MappedFile()
+		{
+			close();
+		}
+
+		/** @brief Maps the given file, returns false if the file could not be opened or mapped */
+		bool open(const std::string& filename)
+		{
+			close();
+#if defined(_WIN32)
+			file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+			if (file == INVALID_HANDLE_VALUE) {
+				return false;
+			}
+			LARGE_INTEGER fileSize;
+			if (!GetFileSizeEx(file, &fileSize) || (fileSize.QuadPart == 0)) {
+				close();
+				return false;
+			}
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (!mapping) {
+				close();
+				return false;
+			}
+			ptr = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			if (!ptr) {
+				close();
+				return false;
+			}
+			length = static_cast<size_t>(fileSize.QuadPart);
+#else
+			int fd = ::open(filename.c_str(), O_RDONLY);
+			if (fd < 0) {
+				return false;
+			}
+			struct stat fileStat;
+			if ((fstat(fd, &fileStat) != 0) || (fileStat.st_size == 0)) {
+				::close(fd);
+				return false;
+			}
+			void* data = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+			// The mapping stays valid after the descriptor has been closed
+			::close(fd);
+			if (data == MAP_FAILED) {
+				return false;
+			}
+			ptr = static_cast<const unsigned char*>(data);
+			length = static_cast<size_t>(fileStat.st_size);
+#endif
+			return true;
+		}
+
+		/** @brief Releases the mapping, pointers into the file become invalid */
+		void close()
+		{
+#if defined(_WIN32)
+			if (ptr) {
+				UnmapViewOfFile(ptr);
+			}
+			if (mapping) {
+				CloseHandle(mapping);
+				mapping = nullptr;
+			}
+			if (file != INVALID_HANDLE_VALUE) {
+				CloseHandle(file);
+				file = INVALID_HANDLE_VALUE;
+			}
+#else
+			if (ptr) {
+				munmap(const_cast<unsigned char*>(ptr), length);
+			}
+#endif
+			ptr = nullptr;
+			length = 0;
+		}
+
+		const unsigned char* data() const { return ptr; }
+		size_t size() const { return length; }
+		bool isOpen() const { return ptr != nullptr; }
+	};
+}
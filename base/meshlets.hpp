@@ -0,0 +1,194 @@
+/*
+* Meshlet generation for indexed triangle lists with per-meshlet culling data
+*
+* Copyright (C) 2026 by agent
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+namespace vks
+{
+	namespace meshlets
+	{
+		// Limits that fit the output of a single mesh shader workgroup on all current implementations
+		const uint32_t maxVertices = 64;
+		const uint32_t maxTriangles = 124;
+
+		/*
+			A meshlet references ranges in the flat vertex and triangle arrays of a MeshletData object
+			Vertices are indices into the model's vertex buffer, triangles are three local (8 bit) indices into the meshlet's vertices
+		*/
+		struct Meshlet {
+			uint32_t vertexOffset;
+			uint32_t triangleOffset;
+			uint32_t vertexCount;
+			uint32_t triangleCount;
+		};
+
+		/*
+			Culling data for a meshlet
+			sphere: Bounding sphere center (xyz) and radius (w)
+			cone: Normal cone axis (xyz) and cutoff (w), a cutoff of 1 means the meshlet can't be backface culled
+		*/
+		struct MeshletBounds {
+			glm::vec4 sphere;
+			glm::vec4 cone;
+		};
+
+		struct MeshletData {
+			std::vector<Meshlet> meshlets;
+			std::vector<MeshletBounds> bounds;
+			std::vector<uint32_t> vertices;
+			std::vector<uint8_t> triangles;
+
+			/** @brief Appends the meshlets of another object, offsets are adjusted accordingly */
+			void append(const MeshletData& other)
+			{
+				const uint32_t vertexOffset = static_cast<uint32_t>(vertices.size());
+				const uint32_t triangleOffset = static_cast<uint32_t>(triangles.size() / 3);
+				for (Meshlet meshlet : other.meshlets) {
+					meshlet.vertexOffset += vertexOffset;
+					meshlet.triangleOffset += triangleOffset;
+					meshlets.push_back(meshlet);
+				}
+				bounds.insert(bounds.end(), other.bounds.begin(), other.bounds.end());
+				vertices.insert(vertices.end(), other.vertices.begin(), other.vertices.end());
+				triangles.insert(triangles.end(), other.triangles.begin(), other.triangles.end());
+			}
+		};
+
+		/**
+		* Calculates the bounding sphere and normal cone of a meshlet
+		*
+		* @param position Returns the position of a vertex referenced by the meshlet
+		*/
+		template<typename PositionFunc>
+		inline MeshletBounds calculateBounds(const MeshletData& data, const Meshlet& meshlet, PositionFunc position)
+		{
+			MeshletBounds bounds{};
+
+			// Sphere around the center of the bounding box
+			glm::vec3 min(position(data.vertices[meshlet.vertexOffset]));
+			glm::vec3 max(min);
+			for (uint32_t i = 1; i < meshlet.vertexCount; i++) {
+				glm::vec3 p(position(data.vertices[meshlet.vertexOffset + i]));
+				min = glm::min(min, p);
+				max = glm::max(max, p);
+			}
+			glm::vec3 center = (min + max) * 0.5f;
+			float radius = 0.0f;
+			for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+				radius = std::max(radius, glm::length(glm::vec3(position(data.vertices[meshlet.vertexOffset + i])) - center));
+			}
+			bounds.sphere = glm::vec4(center, radius);
+
+			// Cone containing all (non degenerate) triangle normals
+			std::vector<glm::vec3> normals;
+			normals.reserve(meshlet.triangleCount);
+			glm::vec3 axis(0.0f);
+			for (uint32_t t = 0; t < meshlet.triangleCount; t++) {
+				const uint8_t* triangle = &data.triangles[(meshlet.triangleOffset + t) * 3];
+				glm::vec3 p0(position(data.vertices[meshlet.vertexOffset + triangle[0]]));
+				glm::vec3 p1(position(data.vertices[meshlet.vertexOffset + triangle[1]]));
+				glm::vec3 p2(position(data.vertices[meshlet.vertexOffset + triangle[2]]));
+				glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+				float area = glm::length(n);
+				if (area > 0.0f) {
+					normals.push_back(n / area);
+					axis += n / area;
+				}
+			}
+			float axisLength = glm::length(axis);
+			if (normals.empty() || (axisLength == 0.0f)) {
+				bounds.cone = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+				return bounds;
+			}
+			axis /= axisLength;
+			float minDot = 1.0f;
+			for (const glm::vec3& n : normals) {
+				minDot = std::min(minDot, glm::dot(n, axis));
+			}
+			// The cone spans a hemisphere or more, so there is no direction from which all triangles are back facing
+			if (minDot <= 0.0f) {
+				bounds.cone = glm::vec4(axis, 1.0f);
+				return bounds;
+			}
+			bounds.cone = glm::vec4(axis, std::sqrt(1.0f - minDot * minDot));
+			return bounds;
+		}
+
+		/**
+		* Splits an indexed triangle list into meshlets of at most maxVertices vertices and maxTriangles triangles
+		* Triangles are consumed in index order, so the input should already be optimized for vertex locality (see vertexcache.hpp)
+		* The result only depends on the input, so it is stable across runs and platforms
+		*
+		* @param indices Triangle list with indices in the range [firstVertex, firstVertex + vertexCount)
+		* @param position Returns the position for an index from the list
+		*/
+		template<typename PositionFunc>
+		inline MeshletData build(const uint32_t* indices, size_t indexCount, uint32_t firstVertex, uint32_t vertexCount, PositionFunc position)
+		{
+			MeshletData data;
+			// Local index of each vertex in the current meshlet, 0xff if it's not part of it
+			std::vector<uint8_t> localIndex(vertexCount, 0xff);
+			Meshlet meshlet{ 0, 0, 0, 0 };
+
+			auto finish = [&]() {
+				if (meshlet.triangleCount == 0) {
+					return;
+				}
+				for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+					localIndex[data.vertices[meshlet.vertexOffset + i] - firstVertex] = 0xff;
+				}
+				data.meshlets.push_back(meshlet);
+				data.bounds.push_back(calculateBounds(data, meshlet, position));
+				meshlet = { static_cast<uint32_t>(data.vertices.size()), static_cast<uint32_t>(data.triangles.size() / 3), 0, 0 };
+			};
+
+			for (size_t i = 0; i + 2 < indexCount; i += 3) {
+				uint32_t newVertices = 0;
+				for (size_t c = 0; c < 3; c++) {
+					if (localIndex[indices[i + c] - firstVertex] == 0xff) {
+						newVertices++;
+					}
+				}
+				if ((meshlet.vertexCount + newVertices > maxVertices) || (meshlet.triangleCount + 1 > maxTriangles)) {
+					finish();
+				}
+				for (size_t c = 0; c < 3; c++) {
+					uint8_t& local = localIndex[indices[i + c] - firstVertex];
+					if (local == 0xff) {
+						local = static_cast<uint8_t>(meshlet.vertexCount++);
+						data.vertices.push_back(indices[i + c]);
+					}
+					data.triangles.push_back(local);
+				}
+				meshlet.triangleCount++;
+			}
+			finish();
+
+			return data;
+		}
+
+		/** @brief Returns true if all triangles of the meshlet are back facing when seen from the given position */
+		inline bool isBackfacing(const MeshletBounds& bounds, const glm::vec3& viewPosition)
+		{
+			glm::vec3 center(bounds.sphere);
+			glm::vec3 axis(bounds.cone);
+			glm::vec3 direction = center - viewPosition;
+			return glm::dot(direction, axis) >= bounds.cone.w * glm::length(direction) + bounds.sphere.w;
+		}
+	}
+}
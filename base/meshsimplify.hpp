@@ -0,0 +1,271 @@
+/*
+* Quadric error metric based mesh simplification for indexed triangle lists
+*
+* Copyright (C) 2026 by agent
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <tuple>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+namespace vks
+{
+	namespace meshsimplify
+	{
+		/*
+			Symmetric 4x4 matrix accumulating the squared distances to a set of planes (Garland and Heckbert, "Surface Simplification Using Quadric Error Metrics")
+		*/
+		struct Quadric {
+			double a2 = 0.0, ab = 0.0, ac = 0.0, ad = 0.0;
+			double b2 = 0.0, bc = 0.0, bd = 0.0;
+			double c2 = 0.0, cd = 0.0;
+			double d2 = 0.0;
+
+			/** @brief Creates the quadric for the plane with the given (normalized) normal running through point p */
+			static Quadric fromPlane(const glm::vec3& n, const glm::vec3& p)
+			{
+				Quadric q;
+				double a = n.x, b = n.y, c = n.z;
+				double d = -(a * p.x + b * p.y + c * p.z);
+				q.a2 = a * a; q.ab = a * b; q.ac = a * c; q.ad = a * d;
+				q.b2 = b * b; q.bc = b * c; q.bd = b * d;
+				q.c2 = c * c; q.cd = c * d;
+				q.d2 = d * d;
+				return q;
+			}
+
+			void add(const Quadric& q)
+			{
+				a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+				b2 += q.b2; bc += q.bc; bd += q.bd;
+				c2 += q.c2; cd += q.cd;
+				d2 += q.d2;
+			}
+
+			/** @brief Returns the sum of the squared distances of p to all planes of the quadric */
+			double error(const glm::vec3& p) const
+			{
+				double x = p.x, y = p.y, z = p.z;
+				double e = a2 * x * x + 2.0 * ab * x * y + 2.0 * ac * x * z + 2.0 * ad * x
+					+ b2 * y * y + 2.0 * bc * y * z + 2.0 * bd * y
+					+ c2 * z * z + 2.0 * cd * z
+					+ d2;
+				return std::max(e, 0.0);
+			}
+		};
+
+		/**
+		* Reduces the number of triangles of an indexed triangle list by collapsing edges in order of their quadric error
+		* Vertices are only moved onto one of their neighbours, so the simplified list can share the vertex buffer of the original
+		* Vertices on open borders and on attribute seams (vertices sharing their position with other vertices) are never moved, so there are no cracks
+		* The result only depends on the input, so it is stable across runs and platforms
+		*
+		* @param indices Triangle list with indices in the range [0, vertexCount), replaced by the simplified list
+		* @param targetIndexCount Simplification stops once the list has this many indices or no further edge can be collapsed
+		* @param position Returns the position of a vertex
+		* @return Object space error of the simplified list, an estimate for the largest distance to the original surface
+		*/
+		template<typename PositionFunc>
+		inline float simplify(std::vector<uint32_t>& indices, size_t vertexCount, size_t targetIndexCount, PositionFunc position)
+		{
+			const size_t triangleCount = indices.size() / 3;
+			if (triangleCount * 3 <= targetIndexCount) {
+				return 0.0f;
+			}
+
+			std::vector<glm::vec3> positions(vertexCount);
+			for (size_t v = 0; v < vertexCount; v++) {
+				positions[v] = glm::vec3(position(static_cast<uint32_t>(v)));
+			}
+
+			// Vertices sharing a position are welded for topology, vertices with more than one wedge are attribute seams
+			std::vector<uint32_t> weld(vertexCount);
+			std::vector<uint32_t> wedgeCount(vertexCount, 0);
+			{
+				struct PositionHash {
+					size_t operator()(const glm::vec3& p) const
+					{
+						uint32_t bits[3];
+						memcpy(bits, &p, sizeof(bits));
+						return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+					}
+				};
+				std::unordered_map<glm::vec3, uint32_t, PositionHash> firstVertex;
+				for (size_t v = 0; v < vertexCount; v++) {
+					auto it = firstVertex.emplace(positions[v], static_cast<uint32_t>(v)).first;
+					weld[v] = it->second;
+				}
+				for (size_t v = 0; v < vertexCount; v++) {
+					wedgeCount[weld[v]]++;
+				}
+			}
+
+			std::vector<bool> locked(vertexCount, false);
+			for (size_t v = 0; v < vertexCount; v++) {
+				locked[v] = wedgeCount[weld[v]] > 1;
+			}
+			// Edges that are only used by a single triangle are on an open border
+			{
+				std::unordered_map<uint64_t, uint32_t> edgeUse;
+				auto edgeKey = [&](uint32_t a, uint32_t b) {
+					uint64_t wa = weld[a], wb = weld[b];
+					return (std::min(wa, wb) << 32) | std::max(wa, wb);
+				};
+				for (size_t t = 0; t < triangleCount; t++) {
+					for (size_t e = 0; e < 3; e++) {
+						edgeUse[edgeKey(indices[t * 3 + e], indices[t * 3 + (e + 1) % 3])]++;
+					}
+				}
+				for (size_t t = 0; t < triangleCount; t++) {
+					for (size_t e = 0; e < 3; e++) {
+						uint32_t a = indices[t * 3 + e];
+						uint32_t b = indices[t * 3 + (e + 1) % 3];
+						if (edgeUse[edgeKey(a, b)] == 1) {
+							locked[a] = true;
+							locked[b] = true;
+						}
+					}
+				}
+			}
+
+			std::vector<uint32_t> triangles(indices.begin(), indices.begin() + triangleCount * 3);
+			std::vector<bool> triangleAlive(triangleCount, true);
+			std::vector<std::vector<uint32_t>> vertexTriangles(vertexCount);
+			std::vector<Quadric> quadrics(vertexCount);
+			for (size_t t = 0; t < triangleCount; t++) {
+				const glm::vec3& p0 = positions[triangles[t * 3]];
+				glm::vec3 n = glm::cross(positions[triangles[t * 3 + 1]] - p0, positions[triangles[t * 3 + 2]] - p0);
+				float length = glm::length(n);
+				Quadric q = (length > 0.0f) ? Quadric::fromPlane(n / length, p0) : Quadric();
+				for (size_t c = 0; c < 3; c++) {
+					quadrics[triangles[t * 3 + c]].add(q);
+					vertexTriangles[triangles[t * 3 + c]].push_back(static_cast<uint32_t>(t));
+				}
+			}
+
+			// Candidate collapses of vertex a onto vertex b, the version invalidates candidates once the quadric of a has changed
+			typedef std::tuple<double, uint32_t, uint32_t, uint32_t> Candidate;
+			std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> candidates;
+			std::vector<uint32_t> version(vertexCount, 0);
+			std::vector<bool> removed(vertexCount, false);
+			auto pushCandidates = [&](uint32_t a) {
+				if (locked[a] || removed[a]) {
+					return;
+				}
+				for (uint32_t t : vertexTriangles[a]) {
+					if (!triangleAlive[t]) {
+						continue;
+					}
+					for (size_t c = 0; c < 3; c++) {
+						uint32_t b = triangles[t * 3 + c];
+						if (b != a) {
+							candidates.push(Candidate(quadrics[a].error(positions[b]), a, b, version[a]));
+						}
+					}
+				}
+			};
+			for (size_t v = 0; v < vertexCount; v++) {
+				pushCandidates(static_cast<uint32_t>(v));
+			}
+
+			size_t aliveTriangles = triangleCount;
+			double maxError = 0.0;
+			while (!candidates.empty() && (aliveTriangles * 3 > targetIndexCount)) {
+				double cost;
+				uint32_t a, b, candidateVersion;
+				std::tie(cost, a, b, candidateVersion) = candidates.top();
+				candidates.pop();
+				if (removed[a] || removed[b] || (candidateVersion != version[a])) {
+					continue;
+				}
+
+				// The edge must still exist and the collapse must not flip any of the remaining triangles
+				bool connected = false;
+				bool flips = false;
+				for (uint32_t t : vertexTriangles[a]) {
+					if (!triangleAlive[t]) {
+						continue;
+					}
+					const uint32_t* tri = &triangles[t * 3];
+					if ((tri[0] == b) || (tri[1] == b) || (tri[2] == b)) {
+						connected = true;
+						continue;
+					}
+					glm::vec3 p[3], q[3];
+					for (size_t c = 0; c < 3; c++) {
+						p[c] = positions[tri[c]];
+						q[c] = (tri[c] == a) ? positions[b] : p[c];
+					}
+					glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+					glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+					if (glm::dot(before, after) <= 0.0f) {
+						flips = true;
+						break;
+					}
+				}
+				if (!connected || flips) {
+					continue;
+				}
+
+				for (uint32_t t : vertexTriangles[a]) {
+					if (!triangleAlive[t]) {
+						continue;
+					}
+					uint32_t* tri = &triangles[t * 3];
+					if ((tri[0] == b) || (tri[1] == b) || (tri[2] == b)) {
+						triangleAlive[t] = false;
+						aliveTriangles--;
+						continue;
+					}
+					for (size_t c = 0; c < 3; c++) {
+						if (tri[c] == a) {
+							tri[c] = b;
+						}
+					}
+					vertexTriangles[b].push_back(t);
+				}
+				vertexTriangles[a].clear();
+				removed[a] = true;
+				quadrics[b].add(quadrics[a]);
+				maxError = std::max(maxError, cost);
+
+				// Costs of collapsing b and of collapsing its neighbours onto b have changed
+				version[b]++;
+				pushCandidates(b);
+				for (uint32_t t : vertexTriangles[b]) {
+					if (!triangleAlive[t]) {
+						continue;
+					}
+					for (size_t c = 0; c < 3; c++) {
+						uint32_t n = triangles[t * 3 + c];
+						if ((n != b) && !locked[n] && !removed[n]) {
+							candidates.push(Candidate(quadrics[n].error(positions[b]), n, b, version[n]));
+						}
+					}
+				}
+			}
+
+			indices.clear();
+			for (size_t t = 0; t < triangleCount; t++) {
+				if (triangleAlive[t]) {
+					indices.insert(indices.end(), triangles.begin() + t * 3, triangles.begin() + t * 3 + 3);
+				}
+			}
+			return static_cast<float>(std::sqrt(maxError));
+		}
+	}
+}
@@ -0,0 +1,207 @@
+/*
+* Skyline rectangle packer for texture atlases
+*
+* Copyright (C) 2026 by agent
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+
+namespace vks
+{
+	namespace rectpack
+	{
+		/*
+			Rectangle to be packed, width and height are the requested size
+			x and y are the position in the atlas after packing, if rotated is set the rectangle has been placed with width and height swapped
+		*/
+		struct Rect {
+			uint32_t width;
+			uint32_t height;
+			uint32_t x = 0;
+			uint32_t y = 0;
+			bool rotated = false;
+		};
+
+		/*
+			Bottom-left skyline packer (Jylänki, "A Thousand Ways to Pack the Bin")
+			The skyline stores the top edge of the packed area as a list of horizontal segments, new rectangles are placed on the segment that keeps them lowest
+		*/
+		class SkylinePacker {
+		private:
+			struct Segment {
+				uint32_t x;
+				uint32_t y;
+				uint32_t width;
+			};
+			uint32_t width;
+			uint32_t height;
+			std::vector<Segment> skyline;
+
+			// Returns the height at which a rectangle of the given size can be placed on top of segment index, or false if it doesn't fit
+			bool fits(size_t index, uint32_t rectWidth, uint32_t rectHeight, uint32_t& y) const
+			{
+				uint32_t x = skyline[index].x;
+				if (x + rectWidth > width) {
+					return false;
+				}
+				y = 0;
+				uint32_t remaining = rectWidth;
+				for (size_t i = index; remaining > 0; i++) {
+					if (i >= skyline.size()) {
+						return false;
+					}
+					y = std::max(y, skyline[i].y);
+					if (y + rectHeight > height) {
+						return false;
+					}
+					remaining -= std::min(remaining, skyline[i].width);
+				}
+				return true;
+			}
+
+			void addSegment(size_t index, uint32_t x, uint32_t y, uint32_t rectWidth)
+			{
+				skyline.insert(skyline.begin() + index, { x, y, rectWidth });
+				// Shrink or remove the segments now covered by the new one
+				for (size_t i = index + 1; i < skyline.size();) {
+					const uint32_t end = skyline[i - 1].x + skyline[i - 1].width;
+					if (skyline[i].x >= end) {
+						break;
+					}
+					const uint32_t shrink = end - skyline[i].x;
+					if (skyline[i].width <= shrink) {
+						skyline.erase(skyline.begin() + i);
+						continue;
+					}
+					skyline[i].x += shrink;
+					skyline[i].width -= shrink;
+					break;
+				}
+				// Merge neighbours at the same height
+				for (size_t i = 0; i + 1 < skyline.size();) {
+					if (skyline[i].y == skyline[i + 1].y) {
+						skyline[i].width += skyline[i + 1].width;
+						skyline.erase(skyline.begin() + i + 1);
+					} else {
+						i++;
+					}
+				}
+			}
+
+		public:
+			SkylinePacker(uint32_t width, uint32_t height) : width(width), height(height)
+			{
+				skyline.push_back({ 0, 0, width });
+			}
+
+			/** @brief Places the rectangle in the atlas, returns false if there is no space left for it */
+			bool insert(Rect& rect, bool allowRotation)
+			{
+				size_t bestIndex = SIZE_MAX;
+				uint32_t bestTop = UINT32_MAX;
+				uint32_t bestSegmentWidth = UINT32_MAX;
+				uint32_t bestY = 0;
+				bool bestRotated = false;
+				for (size_t i = 0; i < skyline.size(); i++) {
+					for (int rotation = 0; rotation < (allowRotation ? 2 : 1); rotation++) {
+						const uint32_t rectWidth = rotation ? rect.height : rect.width;
+						const uint32_t rectHeight = rotation ? rect.width : rect.height;
+						uint32_t y;
+						if (!fits(i, rectWidth, rectHeight, y)) {
+							continue;
+						}
+						// Lowest top edge first, then the narrowest segment to leave wide segments for large rectangles
+						if ((y + rectHeight < bestTop) || ((y + rectHeight == bestTop) && (skyline[i].width < bestSegmentWidth))) {
+							bestIndex = i;
+							bestTop = y + rectHeight;
+							bestSegmentWidth = skyline[i].width;
+							bestY = y;
+							bestRotated = (rotation == 1);
+						}
+					}
+				}
+				if (bestIndex == SIZE_MAX) {
+					return false;
+				}
+				rect.x = skyline[bestIndex].x;
+				rect.y = bestY;
+				rect.rotated = bestRotated;
+				addSegment(bestIndex, rect.x, bestTop, bestRotated ? rect.height : rect.width);
+				return true;
+			}
+		};
+
+		/**
+		* Packs all rectangles into the smallest power of two atlas that fits them
+		* Atlas sizes are tried in order of increasing area with a side ratio of at most 2:1, rectangles are inserted from largest to smallest
+		*
+		* @param rects Rectangles to pack, positions are written to them
+		* @param maxSize Maximum width and height of the atlas
+		* @param allowRotation Allow rectangles to be rotated by 90 degrees
+		* @return False if the rectangles don't fit into an atlas of maxSize * maxSize
+		*/
+		inline bool packAtlas(std::vector<Rect>& rects, uint32_t maxSize, bool allowRotation, uint32_t& atlasWidth, uint32_t& atlasHeight)
+		{
+			uint64_t area = 0;
+			// Smallest possible atlas height and width, wider atlases are tried first so rotated rectangles only need to fit the height with their shorter side
+			uint32_t minHeight = 1;
+			uint32_t minWidth = 1;
+			for (const Rect& rect : rects) {
+				area += static_cast<uint64_t>(rect.width) * rect.height;
+				minHeight = std::max(minHeight, allowRotation ? std::min(rect.width, rect.height) : rect.height);
+				minWidth = std::max(minWidth, allowRotation ? std::max(rect.width, rect.height) : rect.width);
+			}
+
+			std::vector<size_t> order(rects.size());
+			std::iota(order.begin(), order.end(), 0);
+			std::stable_sort(order.begin(), order.end(), [&rects](size_t a, size_t b) {
+				const uint32_t sideA = std::max(rects[a].width, rects[a].height);
+				const uint32_t sideB = std::max(rects[b].width, rects[b].height);
+				if (sideA != sideB) {
+					return sideA > sideB;
+				}
+				return static_cast<uint64_t>(rects[a].width) * rects[a].height > static_cast<uint64_t>(rects[b].width) * rects[b].height;
+			});
+
+			struct Size {
+				uint32_t width;
+				uint32_t height;
+			};
+			std::vector<Size> sizes;
+			for (uint32_t h = 1; h <= maxSize; h *= 2) {
+				for (uint32_t w = h; (w <= maxSize) && (w <= h * 2); w *= 2) {
+					if ((static_cast<uint64_t>(w) * h >= area) && (h >= minHeight) && (w >= minWidth)) {
+						sizes.push_back({ w, h });
+					}
+				}
+			}
+			std::stable_sort(sizes.begin(), sizes.end(), [](const Size& a, const Size& b) { return static_cast<uint64_t>(a.width) * a.height < static_cast<uint64_t>(b.width) * b.height; });
+
+			for (const Size& size : sizes) {
+				SkylinePacker packer(size.width, size.height);
+				bool packed = true;
+				for (size_t index : order) {
+					if (!packer.insert(rects[index], allowRotation)) {
+						packed = false;
+						break;
+					}
+				}
+				if (packed) {
+					atlasWidth = size.width;
+					atlasHeight = size.height;
+					return true;
+				}
+			}
+			return false;
+		}
+	}
+}
@@ -0,0 +1,182 @@
+/*
+* Post-transform vertex cache and vertex fetch optimization for indexed triangle lists
+*
+* Copyright (C) 2026 by agent
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+namespace vks
+{
+	namespace vertexcache
+	{
+		// Number of entries in the simulated FIFO cache, close to what current GPUs effectively reuse
+		const uint32_t defaultCacheSize = 16;
+
+		/**
+		* Returns the average cache miss ratio (transformed vertices per triangle) for a FIFO cache of the given size
+		* 3.0 is the worst case, 0.5 the ideal for a regular grid
+		*
+		* @param indices Triangle list with indices in the range [0, vertexCount)
+		*/
+		inline float calculateACMR(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = defaultCacheSize)
+		{
+			if (indexCount < 3) {
+				return 0.0f;
+			}
+			// A vertex is in the cache if fewer than cacheSize misses happened since it was last loaded
+			std::vector<uint32_t> cacheTime(vertexCount, 0);
+			uint32_t timeStamp = cacheSize + 1;
+			uint32_t misses = 0;
+			for (size_t i = 0; i < indexCount; i++) {
+				uint32_t v = indices[i];
+				if (timeStamp - cacheTime[v] > cacheSize) {
+					cacheTime[v] = timeStamp++;
+					misses++;
+				}
+			}
+			return static_cast<float>(misses) / static_cast<float>(indexCount / 3);
+		}
+
+		/**
+		* Reorders the triangles of an indexed triangle list for post-transform vertex cache locality
+		* Implements Tipsify (Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"), which fans around a vertex and then moves on to the vertex that is most likely still in the cache
+		* The result only depends on the input, so it is stable across runs and platforms
+		*
+		* @param indices Triangle list with indices in the range [0, vertexCount), reordered in place
+		*/
+		inline void optimizeTriangleOrder(uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = defaultCacheSize)
+		{
+			const size_t triangleCount = indexCount / 3;
+			if (triangleCount < 2) {
+				return;
+			}
+
+			// Vertex to triangle adjacency in compressed form
+			std::vector<uint32_t> live(vertexCount, 0);
+			for (size_t i = 0; i < triangleCount * 3; i++) {
+				live[indices[i]]++;
+			}
+			std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+			for (size_t v = 0; v < vertexCount; v++) {
+				adjacencyOffsets[v + 1] = adjacencyOffsets[v] + live[v];
+			}
+			std::vector<uint32_t> adjacency(triangleCount * 3);
+			std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+			for (size_t t = 0; t < triangleCount; t++) {
+				for (size_t c = 0; c < 3; c++) {
+					adjacency[fill[indices[t * 3 + c]]++] = static_cast<uint32_t>(t);
+				}
+			}
+
+			std::vector<uint32_t> cacheTime(vertexCount, 0);
+			std::vector<bool> emitted(triangleCount, false);
+			std::vector<uint32_t> deadEnd;
+			std::vector<uint32_t> candidates;
+			std::vector<uint32_t> result;
+			result.reserve(triangleCount * 3);
+			uint32_t timeStamp = cacheSize + 1;
+			size_t cursor = 0;
+			int64_t fanVertex = 0;
+
+			while (fanVertex >= 0) {
+				const uint32_t f = static_cast<uint32_t>(fanVertex);
+				candidates.clear();
+				for (uint32_t a = adjacencyOffsets[f]; a < adjacencyOffsets[f + 1]; a++) {
+					const uint32_t t = adjacency[a];
+					if (emitted[t]) {
+						continue;
+					}
+					for (size_t c = 0; c < 3; c++) {
+						const uint32_t v = indices[t * 3 + c];
+						result.push_back(v);
+						deadEnd.push_back(v);
+						candidates.push_back(v);
+						live[v]--;
+						if (timeStamp - cacheTime[v] > cacheSize) {
+							cacheTime[v] = timeStamp++;
+						}
+					}
+					emitted[t] = true;
+				}
+
+				// Prefer the candidate that is still in the cache and won't be evicted while its remaining triangles are emitted
+				fanVertex = -1;
+				int64_t bestPriority = -1;
+				for (uint32_t v : candidates) {
+					if (live[v] == 0) {
+						continue;
+					}
+					int64_t priority = 0;
+					if (timeStamp - cacheTime[v] + 2 * live[v] <= cacheSize) {
+						priority = timeStamp - cacheTime[v];
+					}
+					if (priority > bestPriority) {
+						bestPriority = priority;
+						fanVertex = v;
+					}
+				}
+
+				// Dead end: Continue with a recently used vertex, or the next vertex in input order with triangles left
+				if (fanVertex < 0) {
+					while (!deadEnd.empty()) {
+						const uint32_t v = deadEnd.back();
+						deadEnd.pop_back();
+						if (live[v] > 0) {
+							fanVertex = v;
+							break;
+						}
+					}
+				}
+				while ((fanVertex < 0) && (cursor < vertexCount)) {
+					if (live[cursor] > 0) {
+						fanVertex = static_cast<int64_t>(cursor);
+					}
+					cursor++;
+				}
+			}
+
+			std::copy(result.begin(), result.end(), indices);
+		}
+
+		/**
+		* Reorders vertices in the order they're first referenced by the index buffer, so vertex fetches walk memory linearly
+		* Unreferenced vertices are moved to the end, indices are remapped in place
+		*
+		* @param indices Triangle list with indices in the range [0, vertexCount)
+		* @param vertices Pointer to the first of vertexCount vertices, reordered in place
+		*/
+		template<typename T>
+		inline void optimizeVertexOrder(uint32_t* indices, size_t indexCount, T* vertices, size_t vertexCount)
+		{
+			const uint32_t unused = UINT32_MAX;
+			std::vector<uint32_t> remap(vertexCount, unused);
+			uint32_t next = 0;
+			for (size_t i = 0; i < indexCount; i++) {
+				if (remap[indices[i]] == unused) {
+					remap[indices[i]] = next++;
+				}
+			}
+			for (size_t v = 0; v < vertexCount; v++) {
+				if (remap[v] == unused) {
+					remap[v] = next++;
+				}
+			}
+			std::vector<T> reordered(vertexCount);
+			for (size_t v = 0; v < vertexCount; v++) {
+				reordered[remap[v]] = vertices[v];
+			}
+			std::copy(reordered.begin(), reordered.end(), vertices);
+			for (size_t i = 0; i < indexCount; i++) {
+				indices[i] = remap[indices[i]];
+			}
+		}
+	}
+}
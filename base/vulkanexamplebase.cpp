@@ -23,6 +23,18 @@ extern CAMetalLayer* layer;
 
 std::vector<const char*> VulkanExampleBase::args;
 
+CommandLineParser& VulkanExampleBase::exampleCommandLineOptions()
+{
+	static CommandLineParser options;
+	return options;
+}
+
+bool VulkanExampleBase::addCommandLineOption(const std::string& name, const std::vector<std::string>& commands, bool hasValue, const std::string& help)
+{
+	exampleCommandLineOptions().add(name, commands, hasValue, help);
+	return true;
+}
+
 VkResult VulkanExampleBase::createInstance(bool enableValidation)
 {
 	this->settings.validation = enableValidation;
@@ -209,6 +221,50 @@ void VulkanExampleBase::destroyCommandBuffers()
 	vkFreeCommandBuffers(device, cmdPool, static_cast<uint32_t>(drawCmdBuffers.size()), drawCmdBuffers.data());
 }
 
+void VulkanExampleBase::createFrameResources()
+{
+	framesInFlight = std::max(maxFramesInFlight, 1u);
+	if (settings.framesInFlight > 0) {
+		framesInFlight = std::min(framesInFlight, settings.framesInFlight);
+	}
+	if (framesInFlight == 1) {
+		return;
+	}
+	// Fences start signaled, so the first wait for each frame returns immediately
+	VkFenceCreateInfo fenceCreateInfo = vks::initializers::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
+	VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
+	frames.resize(framesInFlight);
+	for (FrameResources& frame : frames) {
+		VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(cmdPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &frame.commandBuffer));
+		VK_CHECK_RESULT(vkCreateFence(device, &fenceCreateInfo, nullptr, &frame.fence));
+		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &frame.presentComplete));
+		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &frame.renderComplete));
+	}
+	currentFrame = 0;
+}
+
+void VulkanExampleBase::destroyFrameResources()
+{
+	for (FrameResources& frame : frames) {
+		vkFreeCommandBuffers(device, cmdPool, 1, &frame.commandBuffer);
+		vkDestroyFence(device, frame.fence, nullptr);
+		vkDestroySemaphore(device, frame.presentComplete, nullptr);
+		vkDestroySemaphore(device, frame.renderComplete, nullptr);
+	}
+	frames.clear();
+}
+
+uint32_t VulkanExampleBase::getCurrentFrame() const
+{
+	return currentFrame;
+}
+
+VkCommandBuffer VulkanExampleBase::getCurrentCommandBuffer() const
+{
+	return frames.empty() ? drawCmdBuffers[currentBuffer] : frames[currentFrame].commandBuffer;
+}
+
 std::string VulkanExampleBase::getShadersPath() const
 {
 	return getShaderBasePath() + shaderDir + "/";
@@ -228,6 +284,9 @@ void VulkanExampleBase::prepare()
 	setupSwapChain();
 	createCommandBuffers();
 	createSynchronizationPrimitives();
+	createFrameResources();
+	// A few additional slots for command buffers owned by the examples
+	gpuProfiler.prepare(vulkanDevice, queue, static_cast<uint32_t>(drawCmdBuffers.size() + frames.size()) + 4);
 	setupDepthStencil();
 	setupRenderPass();
 	createPipelineCache();
@@ -269,6 +328,17 @@ void VulkanExampleBase::nextFrame()
 		viewUpdated = false;
 	}
 
+	if (recordCameraTrack) {
+		// Stores the state this frame is rendered with, so replaying it renders the same frame
+		vks::CameraTrack::Sample sample;
+		sample.frame = cameraTrackFrame++;
+		sample.timer = timer;
+		sample.frameTime = frameTimer;
+		sample.position = camera.position;
+		sample.rotation = camera.rotation;
+		cameraTrack.add(sample);
+	}
+
 	render();
 	frameCounter++;
 	auto tEnd = std::chrono::high_resolution_clock::now();
@@ -312,6 +382,20 @@ void VulkanExampleBase::nextFrame()
 	updateOverlay();
 }
 
+void VulkanExampleBase::renderBenchmarkFrame()
+{
+	// Benchmark mode doesn't advance the camera and timer, unless a camera track has been loaded that sets them by frame index instead of measured frame time
+	if (!recordCameraTrack && !cameraTrack.empty()) {
+		const vks::CameraTrack::Sample sample = cameraTrack.sample(cameraTrackFrame++);
+		camera.setPosition(sample.position);
+		camera.setRotation(sample.rotation);
+		timer = sample.timer;
+		frameTimer = sample.frameTime;
+		viewUpdated = true;
+	}
+	render();
+}
+
 void VulkanExampleBase::renderLoop()
 {
 // SRS - for non-apple plaforms, handle benchmarking here within VulkanExampleBase::renderLoop()
@@ -328,8 +412,16 @@ void VulkanExampleBase::renderLoop()
 		wl_display_dispatch_pending(display);
 #endif
 
-		benchmark.run([=] { render(); }, vulkanDevice->properties);
+		// GPU timings gathered during warm-up are discarded
+		benchmark.warmupFinished = [=] { gpuProfiler.resetStatistics(); };
+		benchmark.runStarted = [=] { cameraTrackFrame = 0; };
+		benchmark.run([=] { renderBenchmarkFrame(); }, vulkanDevice->properties);
 		vkDeviceWaitIdle(device);
+		for (const vks::GpuProfiler::Pass& pass : gpuProfiler.passes) {
+			if (pass.samples > 0) {
+				benchmark.gpuPassTimes.push_back({ pass.name, pass.average() });
+			}
+		}
 		if (benchmark.filename != "") {
 			benchmark.saveResults();
 		}
@@ -710,6 +802,9 @@ void VulkanExampleBase::updateOverlay()
 	ImGui::TextUnformatted(title.c_str());
 	ImGui::TextUnformatted(deviceProperties.deviceName);
 	ImGui::Text("%.2f ms/frame (%.1d fps)", (1000.0f / lastFPS), lastFPS);
+	for (const vks::GpuProfiler::Pass& pass : gpuProfiler.passes) {
+		ImGui::Text("%s: %.3f ms (GPU)", pass.name.c_str(), pass.ms);
+	}
 
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
 	ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(0.0f, 5.0f * UIOverlay.scale));
@@ -725,8 +820,16 @@ void VulkanExampleBase::updateOverlay()
 	ImGui::PopStyleVar();
 	ImGui::Render();
 
+	if (!frames.empty()) {
+		// The overlay's geometry for the next frame may only be written once that frame's previous use has finished
+		VK_CHECK_RESULT(vkWaitForFences(device, 1, &frames[currentFrame].fence, VK_TRUE, UINT64_MAX));
+		UIOverlay.currentFrame = currentFrame;
+	}
 	if (UIOverlay.update() || UIOverlay.updated) {
-		buildCommandBuffers();
+		// Examples with more than one frame in flight record their command buffers every frame
+		if (frames.empty()) {
+			buildCommandBuffers();
+		}
 		UIOverlay.updated = false;
 	}
 
@@ -751,8 +854,18 @@ void VulkanExampleBase::drawUI(const VkCommandBuffer commandBuffer)
 
 void VulkanExampleBase::prepareFrame()
 {
+	VkSemaphore presentComplete = semaphores.presentComplete;
+	if (!frames.empty()) {
+		// Wait until the GPU has finished the last frame that used the current frame's resources, the fence is signaled again by submitFrame
+		VK_CHECK_RESULT(vkWaitForFences(device, 1, &frames[currentFrame].fence, VK_TRUE, UINT64_MAX));
+		VK_CHECK_RESULT(vkResetFences(device, 1, &frames[currentFrame].fence));
+		gpuProfiler.resolve(frames[currentFrame].commandBuffer);
+		presentComplete = frames[currentFrame].presentComplete;
+		submitInfo.pWaitSemaphores = &frames[currentFrame].presentComplete;
+		submitInfo.pSignalSemaphores = &frames[currentFrame].renderComplete;
+	}
 	// Acquire the next image from the swap chain
-	VkResult result = swapChain.acquireNextImage(semaphores.presentComplete, &currentBuffer);
+	VkResult result = swapChain.acquireNextImage(presentComplete, &currentBuffer);
 	// Recreate the swapchain if it's no longer compatible with the surface (OUT_OF_DATE)
 	// SRS - If no longer optimal (VK_SUBOPTIMAL_KHR), wait until submitFrame() in case number of swapchain images will change on resize
 	if ((result == VK_ERROR_OUT_OF_DATE_KHR) || (result == VK_SUBOPTIMAL_KHR)) {
@@ -768,7 +881,14 @@ void VulkanExampleBase::prepareFrame()
 
 void VulkanExampleBase::submitFrame()
 {
-	VkResult result = swapChain.queuePresent(queue, currentBuffer, semaphores.renderComplete);
+	VkSemaphore renderComplete = semaphores.renderComplete;
+	if (!frames.empty()) {
+		// An empty submission signals the frame's fence once all work submitted so far has finished, so examples don't have to pass the fence to their own submissions
+		VK_CHECK_RESULT(vkQueueSubmit(queue, 0, nullptr, frames[currentFrame].fence));
+		renderComplete = frames[currentFrame].renderComplete;
+		currentFrame = (currentFrame + 1) % framesInFlight;
+	}
+	VkResult result = swapChain.queuePresent(queue, currentBuffer, renderComplete);
 	// Recreate the swapchain if it's no longer compatible with the surface (OUT_OF_DATE) or no longer optimal for presentation (SUBOPTIMAL)
 	if ((result == VK_ERROR_OUT_OF_DATE_KHR) || (result == VK_SUBOPTIMAL_KHR)) {
 		windowResize();
@@ -779,7 +899,10 @@ void VulkanExampleBase::submitFrame()
 	else {
 		VK_CHECK_RESULT(result);
 	}
-	VK_CHECK_RESULT(vkQueueWaitIdle(queue));
+	if (frames.empty()) {
+		VK_CHECK_RESULT(vkQueueWaitIdle(queue));
+		gpuProfiler.resolve(drawCmdBuffers[currentBuffer]);
+	}
 }
 
 VulkanExampleBase::VulkanExampleBase()
@@ -820,6 +943,13 @@ VulkanExampleBase::VulkanExampleBase()
 	commandLineParser.add("benchmarkresultfile", { "-bf", "--benchfilename" }, 1, "Set file name for benchmark results");
 	commandLineParser.add("benchmarkresultframes", { "-bt", "--benchframetimes" }, 0, "Save frame times to benchmark results file");
 	commandLineParser.add("benchmarkframes", { "-bfs", "--benchmarkframes" }, 1, "Only render the given number of frames");
+	commandLineParser.add("benchmarkruns", { "-brs", "--benchruns" }, 1, "Set the number of benchmark runs used for confidence intervals");
+	commandLineParser.add("cameratrack", { "-ct", "--cameratrack" }, 1, "Replay a camera and timer track in benchmark mode");
+	commandLineParser.add("cameratrackrecord", { "-ctr", "--cameratrackrecord" }, 1, "Record the camera and timer of a regular run to a track file");
+	commandLineParser.add("framesinflight", { "-fif", "--framesinflight" }, 1, "Limit the number of frames in flight for examples supporting more than one");
+	for (const auto& option : exampleCommandLineOptions().options) {
+		commandLineParser.options[option.first] = option.second;
+	}
 
 	commandLineParser.parse(args);
 	if (commandLineParser.isSet("help")) {
@@ -854,6 +984,9 @@ VulkanExampleBase::VulkanExampleBase()
 			shaderDir = value;
 		}
 	}
+	if (commandLineParser.isSet("framesinflight")) {
+		settings.framesInFlight = std::max(commandLineParser.getValueAsInt("framesinflight", 1), 1);
+	}
 	if (commandLineParser.isSet("benchmark")) {
 		benchmark.active = true;
 		vks::tools::errorModeSilent = true;
@@ -873,6 +1006,26 @@ VulkanExampleBase::VulkanExampleBase()
 	if (commandLineParser.isSet("benchmarkframes")) {
 		benchmark.outputFrames = commandLineParser.getValueAsInt("benchmarkframes", benchmark.outputFrames);
 	}
+	if (commandLineParser.isSet("benchmarkruns")) {
+		benchmark.runs = std::max(commandLineParser.getValueAsInt("benchmarkruns", benchmark.runs), 1);
+	}
+	if (commandLineParser.isSet("cameratrackrecord") && !benchmark.active) {
+		cameraTrackFile = commandLineParser.getValueAsString("cameratrackrecord", "");
+		recordCameraTrack = true;
+	}
+	if (commandLineParser.isSet("cameratrack") && benchmark.active) {
+		const std::string filename = commandLineParser.getValueAsString("cameratrack", "");
+		if (!cameraTrack.load(filename)) {
+			vks::tools::exitFatal("Could not load camera track \"" + filename + "\"", -1);
+		}
+		// Each run replays the track exactly once, unless a frame limit or a run time has been set explicitly
+		if (!commandLineParser.isSet("benchmarkframes")) {
+			benchmark.outputFrames = static_cast<int>(cameraTrack.frameCount());
+		}
+		if (!commandLineParser.isSet("benchmarkruntime")) {
+			benchmark.duration = std::numeric_limits<uint32_t>::max();
+		}
+	}
 
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
 	// Vulkan library is loaded dynamically on Android
@@ -924,7 +1077,17 @@ VulkanExampleBase::~VulkanExampleBase()
 
 	vkDestroyPipelineCache(device, pipelineCache, nullptr);
 
+	destroyFrameResources();
 	vkDestroyCommandPool(device, cmdPool, nullptr);
+	gpuProfiler.destroy();
+
+	if (recordCameraTrack && !cameraTrack.empty()) {
+		if (cameraTrack.save(cameraTrackFile)) {
+			std::cout << "Recorded " << cameraTrack.frameCount() << " frames to camera track \"" << cameraTrackFile << "\"\n";
+		} else {
+			std::cerr << "Could not write camera track \"" << cameraTrackFile << "\"\n";
+		}
+	}
 
 	vkDestroySemaphore(device, semaphores.presentComplete, nullptr);
 	vkDestroySemaphore(device, semaphores.renderComplete, nullptr);
@@ -1935,7 +2098,8 @@ void VulkanExampleBase::displayLinkOutputCb()
 {
 #if defined(VK_EXAMPLE_XCODE_GENERATED)
 	if (benchmark.active) {
-		benchmark.run([=] { render(); }, vulkanDevice->properties);
+		benchmark.runStarted = [=] { cameraTrackFrame = 0; };
+		benchmark.run([=] { renderBenchmarkFrame(); }, vulkanDevice->properties);
 		if (benchmark.filename != "") {
 			benchmark.saveResults();
 		}
@@ -3197,6 +3361,9 @@ void VulkanExampleBase::windowResize()
 
 	// Command buffers need to be recreated as they may store
 	// references to the recreated frame buffer
+	for (VkCommandBuffer commandBuffer : drawCmdBuffers) {
+		gpuProfiler.releaseCommandBuffer(commandBuffer);
+	}
 	destroyCommandBuffers();
 	createCommandBuffers();
 	buildCommandBuffers();
@@ -72,6 +72,8 @@
 #include "VulkanInitializers.hpp"
 #include "camera.hpp"
 #include "benchmark.hpp"
+#include "gpuprofiler.hpp"
+#include "cameratrack.hpp"
 
 class VulkanExampleBase
 {
@@ -90,7 +92,15 @@ private:
 	void setupSwapChain();
 	void createCommandBuffers();
 	void destroyCommandBuffers();
+	void createFrameResources();
+	void destroyFrameResources();
+	void renderBenchmarkFrame();
 	std::string shaderDir = "glsl";
+	// Camera track replayed in benchmark mode, or recorded during a regular run if cameraTrackFile is set
+	vks::CameraTrack cameraTrack;
+	uint32_t cameraTrackFrame = 0;
+	bool recordCameraTrack = false;
+	std::string cameraTrackFile;
 protected:
 	// Returns the path to the root of the glsl or hlsl shader directory.
 	std::string getShadersPath() const;
@@ -153,7 +163,27 @@ protected:
 		VkSemaphore renderComplete;
 	} semaphores;
 	std::vector<VkFence> waitFences;
+	/**
+	* @brief Maximum number of frames the CPU may record and submit ahead of the GPU (set in the derived constructor)
+	* Examples raising this must record their command buffers every frame into getCurrentCommandBuffer() and keep one copy of all resources written by the CPU per frame (see getCurrentFrame)
+	*/
+	uint32_t maxFramesInFlight = 1;
+	// Number of frames in flight in use, maxFramesInFlight or less if limited by the --framesinflight argument (valid after prepare)
+	uint32_t framesInFlight = 1;
+	// Per-frame resources, only used if more than one frame is in flight
+	struct FrameResources {
+		VkCommandBuffer commandBuffer{ VK_NULL_HANDLE };
+		// Signaled once all work submitted to the queue for this frame has finished
+		VkFence fence{ VK_NULL_HANDLE };
+		VkSemaphore presentComplete{ VK_NULL_HANDLE };
+		VkSemaphore renderComplete{ VK_NULL_HANDLE };
+	};
+	std::vector<FrameResources> frames;
+	// Index of the frame currently being recorded, in the range [0, framesInFlight)
+	uint32_t currentFrame = 0;
 	bool requiresStencil{ false };
+	// Options added with addCommandLineOption, function local so registration from static initializers doesn't depend on initialization order
+	static CommandLineParser& exampleCommandLineOptions();
 public:
 	bool prepared = false;
 	bool resized = false;
@@ -169,6 +199,9 @@ public:
 
 	vks::Benchmark benchmark;
 
+	/** @brief GPU timings of named passes, examples call beginFrame once per command buffer and mark passes with begin/end (or vks::GpuProfilerScope) while recording */
+	vks::GpuProfiler gpuProfiler;
+
 	/** @brief Encapsulated physical and logical vulkan device */
 	vks::VulkanDevice *vulkanDevice;
 
@@ -182,6 +215,8 @@ public:
 		bool vsync = false;
 		/** @brief Enable UI overlay */
 		bool overlay = true;
+		/** @brief Limits the number of frames in flight for examples supporting more than one, zero uses the example's maximum */
+		uint32_t framesInFlight = 0;
 	} settings;
 
 	/** @brief State of gamepad input (only used on Android) */
@@ -203,6 +238,11 @@ public:
 	VkClearColorValue defaultClearColor = { { 0.025f, 0.025f, 0.025f, 1.0f } };
 
 	static std::vector<const char*> args;
+	/**
+	* Registers an example specific command line option, so it's parsed and listed in the help along with the options of the base class
+	* Has to be called before the example is created, e.g. from the initializer of a static variable in the example's source file
+	*/
+	static bool addCommandLineOption(const std::string& name, const std::vector<std::string>& commands, bool hasValue, const std::string& help);
 
 	// Defines a frame rate independent timer value clamped from -1.0...1.0
 	// For use in animations, rotations, etc.
@@ -399,10 +439,14 @@ public:
 	/** @brief Adds the drawing commands for the ImGui overlay to the given command buffer */
 	void drawUI(const VkCommandBuffer commandBuffer);
 
-	/** Prepare the next frame for workload submission by acquiring the next swap chain image */
+	/** Prepare the next frame for workload submission by acquiring the next swap chain image, with more than one frame in flight this first waits until the current frame's resources are no longer in use */
 	void prepareFrame();
-	/** @brief Presents the current image to the swap chain */
+	/** @brief Presents the current image to the swap chain, waits for the queue to become idle unless more than one frame is in flight */
 	void submitFrame();
+	/** @brief Index of the frame currently being recorded, use this to select per-frame resources like uniform buffers */
+	uint32_t getCurrentFrame() const;
+	/** @brief Command buffer to record the current frame into if more than one frame is in flight */
+	VkCommandBuffer getCurrentCommandBuffer() const;
 	/** @brief (Virtual) Default image acquire + submission and command buffer submission function */
 	virtual void renderFrame();
 
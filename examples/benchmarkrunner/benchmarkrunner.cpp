@@ -0,0 +1,296 @@
+/*
+* Vulkan Example - Command line tool for benchmarking a set of examples in one go
+*
+* Runs each example in benchmark mode as a separate process, collects the JSON results written by vks::Benchmark into a single report
+* and optionally compares that report against a stored baseline, so performance regressions can be caught e.g. on CI machines
+* Examples seed their random generators with a fixed value and don't update camera or timers in benchmark mode, so every run renders the same frames
+* On machines without a GPU, build the examples with USE_HEADLESS and point the Vulkan loader to a software implementation (e.g. VK_ICD_FILENAMES for lavapipe)
+*
+* Copyright (C) 2026 by agent
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#if defined(_WIN32)
+#pragma comment(linker, "/subsystem:console")
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+#include "json.hpp"
+#include "CommandLineParser.hpp"
+
+CommandLineParser commandLineParser;
+
+class BenchmarkRunner
+{
+private:
+	static std::string quote(const std::string& value)
+	{
+		return "\"" + value + "\"";
+	}
+
+	// Looks up json[object][key] without inserting or throwing, reports written by older versions may lack some of the values
+	static bool findNumber(const nlohmann::json& json, const std::string& object, const std::string& key, double& value)
+	{
+		if (!json.is_object()) {
+			return false;
+		}
+		auto parent = json.find(object);
+		if ((parent == json.end()) || !parent->is_object()) {
+			return false;
+		}
+		auto entry = parent->find(key);
+		if ((entry == parent->end()) || !entry->is_number()) {
+			return false;
+		}
+		value = entry->get<double>();
+		return true;
+	}
+
+	static bool isOk(const nlohmann::json& result)
+	{
+		return result.is_object() && (result.value("status", "") == "ok");
+	}
+
+	static size_t runCount(const nlohmann::json& result)
+	{
+		auto runs = result.find("runs");
+		return ((runs != result.end()) && runs->is_array()) ? runs->size() : 0;
+	}
+
+public:
+	static bool loadJson(const std::string& filename, nlohmann::json& json)
+	{
+		std::ifstream file(filename);
+		if (!file.is_open()) {
+			return false;
+		}
+		json = nlohmann::json::parse(file, nullptr, false);
+		return !json.is_discarded();
+	}
+
+	std::string binDir;
+	std::string resultPrefix;
+	// Optional directory with camera tracks named after the examples (e.g. bloom.track)
+	std::string cameraTrackDir;
+	std::vector<std::string> arguments;
+	// Relative increase of the mean and trimmed mean frame time, and of the p99 frame time, that counts as a regression
+	double threshold = 0.05;
+	double tailThreshold = 0.10;
+
+	/** @brief Runs a single example in benchmark mode and returns its results, the status is "failed" if the example didn't write any */
+	nlohmann::json runExample(const std::string& example)
+	{
+		const std::string csvFile = resultPrefix + example + ".csv";
+		const std::string jsonFile = resultPrefix + example + ".json";
+		std::remove(jsonFile.c_str());
+#if defined(_WIN32)
+		std::string executable = binDir + example + ".exe";
+		// cmd.exe strips the outer quotes of the whole command line
+		std::string command = "\"" + quote(executable);
+#else
+		std::string executable = binDir + example;
+		std::string command = quote(executable);
+#endif
+		command += " -b -bf " + quote(csvFile);
+		for (const std::string& argument : arguments) {
+			command += " " + argument;
+		}
+		if (!cameraTrackDir.empty()) {
+			const std::string cameraTrack = cameraTrackDir + example + ".track";
+			if (std::ifstream(cameraTrack).good()) {
+				command += " -ct " + quote(cameraTrack);
+			}
+		}
+#if defined(_WIN32)
+		command += "\"";
+#endif
+		std::cout << "Running " << example << "\n";
+		const int exitCode = std::system(command.c_str());
+
+		nlohmann::json result;
+		if ((exitCode != 0) || !loadJson(jsonFile, result)) {
+			std::cout << example << " failed (exit code " << exitCode << ")\n";
+			result = nlohmann::json::object();
+			result["status"] = "failed";
+			result["exitCode"] = exitCode;
+			return result;
+		}
+		result["status"] = "ok";
+		return result;
+	}
+
+	/** @brief Runs all examples and combines their results into one report */
+	nlohmann::json run(const std::vector<std::string>& examples)
+	{
+		nlohmann::json report;
+		report["examples"] = nlohmann::json::object();
+		for (const std::string& example : examples) {
+			nlohmann::json result = runExample(example);
+			if ((report.count("device") == 0) && (result.count("device") > 0)) {
+				report["device"] = result["device"];
+				report["driverVersion"] = result["driverVersion"];
+			}
+			report["examples"][example] = result;
+		}
+		return report;
+	}
+
+	/**
+	* Compares a report against a baseline report
+	* A metric regresses if it's slower than the baseline by more than the threshold, and if both reports contain confidence intervals from repeated runs, if these intervals don't overlap
+	*
+	* @return Number of failed examples and regressions
+	*/
+	uint32_t compare(nlohmann::json& report, const nlohmann::json& baseline)
+	{
+		uint32_t failures = 0;
+		const std::vector<std::pair<std::string, double>> metrics = {
+			{ "mean", threshold },
+			{ "trimmedMean", threshold },
+			{ "p99", tailThreshold },
+		};
+		std::cout << std::fixed << std::setprecision(3);
+		for (auto& entry : report["examples"].items()) {
+			const std::string& example = entry.key();
+			nlohmann::json& result = entry.value();
+			if (!isOk(result)) {
+				failures++;
+				continue;
+			}
+			auto examples = baseline.is_object() ? baseline.find("examples") : baseline.end();
+			if ((examples == baseline.end()) || !examples->is_object() || (examples->count(example) == 0) || !isOk(examples->at(example))) {
+				std::cout << example << ": no baseline\n";
+				continue;
+			}
+			const nlohmann::json& reference = examples->at(example);
+			double lower = 0.0, upper = 0.0;
+			const bool intervals = (runCount(result) > 1) && (runCount(reference) > 1) && findNumber(result, "confidenceInterval", "lower", lower) && findNumber(reference, "confidenceInterval", "upper", upper);
+			const bool separated = !intervals || (lower > upper);
+			nlohmann::json comparison = nlohmann::json::object();
+			bool regressed = false;
+			for (const auto& metric : metrics) {
+				double current = 0.0, previous = 0.0;
+				if (!findNumber(result, "frameTime", metric.first, current) || !findNumber(reference, "frameTime", metric.first, previous)) {
+					std::cout << example << ": " << metric.first << " no baseline\n";
+					continue;
+				}
+				const double change = (previous > 0.0) ? (current - previous) / previous : 0.0;
+				const bool metricRegressed = (change > metric.second) && separated;
+				comparison[metric.first] = { { "baseline", previous }, { "current", current }, { "change", change }, { "regression", metricRegressed } };
+				std::cout << example << ": " << metric.first << " " << previous << " ms -> " << current << " ms (" << (change >= 0.0 ? "+" : "") << change * 100.0 << "%)" << (metricRegressed ? " REGRESSION" : "") << "\n";
+				regressed = regressed || metricRegressed;
+			}
+			result["comparison"] = comparison;
+			if (regressed) {
+				failures++;
+			}
+		}
+		return failures;
+	}
+};
+
+int main(int argc, char* argv[]) {
+	commandLineParser.add("help", { "--help" }, 0, "Show help");
+	commandLineParser.add("examples", { "-e", "--examples" }, 1, "Comma separated list of examples to run (defaults to a set of examples that run on software implementations)");
+	commandLineParser.add("bindir", { "-bd", "--bindir" }, 1, "Directory containing the example executables (defaults to the directory of this tool)");
+	commandLineParser.add("output", { "-o", "--output" }, 1, "Combined report to write (defaults to benchmark_report.json)");
+	commandLineParser.add("baseline", { "--baseline" }, 1, "Report to compare the results against");
+	commandLineParser.add("threshold", { "--threshold" }, 1, "Allowed increase of the mean frame time in percent (defaults to 5)");
+	commandLineParser.add("tailthreshold", { "--tailthreshold" }, 1, "Allowed increase of the p99 frame time in percent (defaults to 10)");
+	commandLineParser.add("benchmarkwarmup", { "-bw", "--benchwarmup" }, 1, "Warmup time per example in seconds");
+	commandLineParser.add("benchmarkruntime", { "-br", "--benchruntime" }, 1, "Duration of each run in seconds");
+	commandLineParser.add("benchmarkruns", { "-brs", "--benchruns" }, 1, "Number of runs per example");
+	commandLineParser.add("benchmarkframes", { "-bfs", "--benchmarkframes" }, 1, "Only render the given number of frames per run");
+	commandLineParser.add("cameratracks", { "-ct", "--cameratracks" }, 1, "Directory with camera tracks named after the examples (<example>.track) replayed during the benchmark");
+	commandLineParser.add("gpu", { "-g", "--gpu" }, 1, "Index of the GPU passed to the examples");
+	commandLineParser.add("shaders", { "-s", "--shaders" }, 1, "Shader type passed to the examples (glsl or hlsl)");
+	commandLineParser.parse(argc, argv);
+	if (commandLineParser.isSet("help")) {
+		commandLineParser.printHelp();
+		return 0;
+	}
+
+	std::vector<std::string> examples = { "triangle", "pipelines", "texture", "instancing", "gltfscenerendering", "bloom", "deferred", "computeparticles" };
+	if (commandLineParser.isSet("examples")) {
+		examples.clear();
+		std::stringstream list(commandLineParser.getValueAsString("examples", ""));
+		std::string example;
+		while (std::getline(list, example, ',')) {
+			if (!example.empty()) {
+				examples.push_back(example);
+			}
+		}
+	}
+
+	BenchmarkRunner runner;
+	const std::string self(argv[0]);
+	const size_t separator = self.find_last_of("/\\");
+	runner.binDir = (separator != std::string::npos) ? self.substr(0, separator + 1) : "./";
+	if (commandLineParser.isSet("bindir")) {
+		runner.binDir = commandLineParser.getValueAsString("bindir", runner.binDir);
+		if ((runner.binDir.back() != '/') && (runner.binDir.back() != '\\')) {
+			runner.binDir += "/";
+		}
+	}
+	if (commandLineParser.isSet("cameratracks")) {
+		runner.cameraTrackDir = commandLineParser.getValueAsString("cameratracks", "");
+		if ((runner.cameraTrackDir.back() != '/') && (runner.cameraTrackDir.back() != '\\')) {
+			runner.cameraTrackDir += "/";
+		}
+	}
+	const std::string output = commandLineParser.getValueAsString("output", "benchmark_report.json");
+	// Results of the single examples are written next to the report
+	runner.resultPrefix = output.substr(0, output.find_last_of('.')) + "_";
+	runner.threshold = std::stod(commandLineParser.getValueAsString("threshold", "5")) / 100.0;
+	runner.tailThreshold = std::stod(commandLineParser.getValueAsString("tailthreshold", "10")) / 100.0;
+
+	// Options forwarded to every example
+	const std::vector<std::pair<std::string, std::string>> forwardedOptions = {
+		{ "benchmarkwarmup", "-bw" },
+		{ "benchmarkruntime", "-br" },
+		{ "benchmarkruns", "-brs" },
+		{ "benchmarkframes", "-bfs" },
+		{ "gpu", "-g" },
+		{ "shaders", "-s" },
+	};
+	for (const auto& option : forwardedOptions) {
+		if (commandLineParser.isSet(option.first)) {
+			runner.arguments.push_back(option.second);
+			runner.arguments.push_back(commandLineParser.getValueAsString(option.first, ""));
+		}
+	}
+
+	nlohmann::json report = runner.run(examples);
+
+	uint32_t failures = 0;
+	if (commandLineParser.isSet("baseline")) {
+		const std::string baselineFile = commandLineParser.getValueAsString("baseline", "");
+		nlohmann::json baseline;
+		if (!BenchmarkRunner::loadJson(baselineFile, baseline) || !baseline.is_object()) {
+			std::cerr << "Could not load baseline \"" << baselineFile << "\"\n";
+			return -1;
+		}
+		failures = runner.compare(report, baseline);
+	} else {
+		for (auto& entry : report["examples"].items()) {
+			failures += (entry.value()["status"] != "ok") ? 1 : 0;
+		}
+	}
+
+	std::ofstream file(output);
+	file << std::setw(4) << report << "\n";
+	std::cout << "Wrote report for " << examples.size() << " examples to \"" << output << "\", " << failures << " failures or regressions\n";
+	return (failures == 0) ? 0 : 1;
+}
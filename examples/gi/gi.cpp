@@ -15,6 +15,10 @@
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
 
+// Optionally bake the lightmap for the chart layout on the CPU, e.g. to compare it against the compute shader
+// Registered before the example is created, so the option is listed in the help (examples/lightmapbaker bakes without a GPU)
+static const bool bakeLightmapOption = VulkanExampleBase::addCommandLineOption("bakelightmap", { "-bl", "--bakelightmap" }, 1, "Build lightmap UVs and bake an irradiance lightmap on the CPU to the given KTX file");
+
 class VulkanExample : public VulkanExampleBase
 {
 public:
@@ -720,6 +724,10 @@ public:
 	{
 		vkglTF::memoryPropertyFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
 		//vkglTF::isCalcLMUV = true;//BUILD LIGHTMAP UV
+		if (commandLineParser.isSet("bakelightmap")) {
+			vkglTF::isCalcLMUV = true;
+			model.lightmapSettings.bakeFile = commandLineParser.getValueAsString("bakelightmap", "lightmap.ktx");
+		}
 		const uint32_t glTFLoadingFlags = vkglTF::FileLoadingFlags::PreTransformVertices | vkglTF::FileLoadingFlags::PreMultiplyVertexColors | vkglTF::FileLoadingFlags::FlipY;
 		model.loadFromFile(getAssetPath() + "models/deer2.gltf", vulkanDevice, queue, glTFLoadingFlags);
 	}
@@ -0,0 +1,202 @@
+/*
+* Vulkan Example - Command line tool for cooking glTF models into GPU ready binary files
+*
+* Loads a glTF model once with the regular loader (including all requested pre-processing) and writes the result to a file
+* that can be loaded with vkglTF::Model::loadFromCooked, which only has to map the file and upload its contents
+* Loading and uploading needs a Vulkan device, so this tool (including the animation validation) can't run on machines without a Vulkan implementation
+* On machines without a GPU, point the Vulkan loader to a software implementation (e.g. VK_ICD_FILENAMES for lavapipe)
+*
+* Copyright (C) 2026 by agent
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#if defined(_WIN32)
+#pragma comment(linker, "/subsystem:console")
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <vector>
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+#if (defined(VK_USE_PLATFORM_MACOS_MVK) || defined(VK_USE_PLATFORM_METAL_EXT))
+#define VK_ENABLE_BETA_EXTENSIONS
+#endif
+#include <vulkan/vulkan.h>
+#include "VulkanTools.h"
+#include "VulkanDevice.h"
+#include "VulkanglTFModel.h"
+#include "CommandLineParser.hpp"
+
+CommandLineParser commandLineParser;
+
+class GltfCooker
+{
+public:
+	VkInstance instance{ VK_NULL_HANDLE };
+	vks::VulkanDevice* vulkanDevice{ nullptr };
+	VkQueue queue{ VK_NULL_HANDLE };
+
+	GltfCooker()
+	{
+		VkApplicationInfo appInfo = {};
+		appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+		appInfo.pApplicationName = "Vulkan glTF cooker";
+		appInfo.pEngineName = "VulkanExample";
+		appInfo.apiVersion = VK_API_VERSION_1_0;
+
+		// The loader only uploads data, so no surface extensions are required
+		VkInstanceCreateInfo instanceCreateInfo = {};
+		instanceCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+		instanceCreateInfo.pApplicationInfo = &appInfo;
+		std::vector<const char*> instanceExtensions = {};
+#if (defined(VK_USE_PLATFORM_MACOS_MVK) || defined(VK_USE_PLATFORM_METAL_EXT)) && defined(VK_KHR_portability_enumeration)
+		instanceExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+		instanceExtensions.push_back(VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME);
+		instanceCreateInfo.flags = VK_INSTANCE_CREATE_ENUMERATE_PORTABILITY_BIT_KHR;
+#endif
+		instanceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(instanceExtensions.size());
+		instanceCreateInfo.ppEnabledExtensionNames = instanceExtensions.data();
+		VK_CHECK_RESULT(vkCreateInstance(&instanceCreateInfo, nullptr, &instance));
+
+		// Physical device (always use first)
+		uint32_t deviceCount = 0;
+		VK_CHECK_RESULT(vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr));
+		if (deviceCount == 0) {
+			vks::tools::exitFatal("No device with Vulkan support found", -1);
+		}
+		std::vector<VkPhysicalDevice> physicalDevices(deviceCount);
+		VK_CHECK_RESULT(vkEnumeratePhysicalDevices(instance, &deviceCount, physicalDevices.data()));
+
+		vulkanDevice = new vks::VulkanDevice(physicalDevices[0]);
+		VkPhysicalDeviceFeatures enabledFeatures{};
+		VK_CHECK_RESULT(vulkanDevice->createLogicalDevice(enabledFeatures, {}, nullptr, false, VK_QUEUE_GRAPHICS_BIT));
+		vkGetDeviceQueue(vulkanDevice->logicalDevice, vulkanDevice->queueFamilyIndices.graphics, 0, &queue);
+		std::cout << "GPU: " << vulkanDevice->properties.deviceName << "\n";
+	}
+
+	~GltfCooker()
+	{
+		delete vulkanDevice;
+		vkDestroyInstance(instance, nullptr);
+	}
+
+	/** @brief Loads the glTF file with the given flags and writes the cooked model to output */
+	void cook(const std::string& input, const std::string& output, uint32_t fileLoadingFlags, float scale)
+	{
+		auto tStart = std::chrono::high_resolution_clock::now();
+		{
+			vkglTF::Model model;
+			model.cookFile = output;
+			model.loadFromFile(input, vulkanDevice, queue, fileLoadingFlags, scale);
+		}
+		auto tCook = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+		std::cout << "Cooked \"" << input << "\" to \"" << output << "\" in " << tCook << " ms\n";
+
+		// Load the result once, so broken files are noticed here instead of in the application
+		tStart = std::chrono::high_resolution_clock::now();
+		{
+			vkglTF::Model model;
+			model.loadFromCooked(output, vulkanDevice, queue);
+		}
+		auto tLoad = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+		std::cout << "Loaded cooked model in " << tLoad << " ms\n";
+	}
+
+	/**
+	* Animates a number of instances of the cooked model with the multi-threaded animation system and checks the resulting joint palettes against a CPU reference
+	* The model is loaded once and shared by all instances, each instance evaluates its animation into its own pose, no commands are submitted to the GPU
+	*
+	* @return False if any palette differs from the reference
+	*/
+	bool validateAnimation(const std::string& cookedFile, uint32_t instanceCount, uint32_t frameCount)
+	{
+		vkglTF::Model model;
+		model.loadFromCooked(cookedFile, vulkanDevice, queue);
+		if ((instanceCount == 0) || model.animations.empty()) {
+			std::cout << "Model has no animations, skipping animation validation\n";
+			return true;
+		}
+
+		vkglTF::AnimationSystem animationSystem;
+		std::vector<vkglTF::AnimationPose> poses(instanceCount);
+		std::vector<vkglTF::AnimationSystem::Instance> instances;
+		for (uint32_t i = 0; i < instanceCount; i++) {
+			instances.push_back({ &model, i % static_cast<uint32_t>(model.animations.size()), 0.0f, &poses[i] });
+		}
+		float updateTime = 0.0f;
+		float maxError = 0.0f;
+		for (uint32_t frame = 0; frame < frameCount; frame++) {
+			// Spread the instances over the animations' durations, so every frame evaluates different keyframes
+			for (uint32_t i = 0; i < instanceCount; i++) {
+				const vkglTF::Animation& animation = model.animations[instances[i].animation];
+				const float duration = std::max(animation.end - animation.start, 0.0f);
+				instances[i].time = animation.start + std::fmod((frame + i * 0.37f) / 60.0f, duration > 0.0f ? duration : 1.0f);
+			}
+			animationSystem.update(instances);
+			updateTime += animationSystem.statistics.updateTime;
+			for (const auto& pose : poses) {
+				maxError = std::max(maxError, vkglTF::AnimationSystem::validate(model, pose));
+			}
+		}
+		std::cout << "Animated " << instanceCount << " instances (" << animationSystem.statistics.joints << " joints) for " << frameCount << " frames, " << updateTime / frameCount << " ms per frame, max palette error " << maxError << "\n";
+		return maxError < 1e-3f;
+	}
+};
+
+int main(int argc, char* argv[]) {
+	commandLineParser.add("help", { "--help" }, 0, "Show help");
+	commandLineParser.add("input", { "-i", "--input" }, 1, "glTF file to cook");
+	commandLineParser.add("output", { "-o", "--output" }, 1, "Cooked file to write (defaults to the input file with an added .cooked extension)");
+	commandLineParser.add("scale", { "--scale" }, 1, "Global scale passed to the loader");
+	commandLineParser.add("pretransform", { "--pretransform" }, 0, "Pre-transform vertices by the node hierarchy");
+	commandLineParser.add("premultiplycolors", { "--premultiplycolors" }, 0, "Pre-multiply vertex colors with the material base color");
+	commandLineParser.add("flipy", { "--flipy" }, 0, "Flip the y axis of vertex positions and normals");
+	commandLineParser.add("noimages", { "--noimages" }, 0, "Don't load images");
+	commandLineParser.add("optimizevertexcache", { "--optimizevertexcache" }, 0, "Optimize primitives for the post-transform vertex cache");
+	commandLineParser.add("meshlets", { "--meshlets" }, 0, "Generate meshlets");
+	commandLineParser.add("lods", { "--lods" }, 0, "Generate levels of detail");
+	commandLineParser.add("animationinstances", { "--animationinstances" }, 1, "Validate the joint palettes of this many animated instances sharing the cooked model (needs a Vulkan device like cooking itself)");
+	commandLineParser.parse(argc, argv);
+	// Errors are reported on the console instead of message boxes
+	vks::tools::errorModeSilent = true;
+	if (commandLineParser.isSet("help") || !commandLineParser.isSet("input")) {
+		commandLineParser.printHelp();
+		return commandLineParser.isSet("help") ? 0 : -1;
+	}
+
+	const std::string input = commandLineParser.getValueAsString("input", "");
+	const std::string output = commandLineParser.getValueAsString("output", input + ".cooked");
+	const float scale = std::stof(commandLineParser.getValueAsString("scale", "1.0"));
+
+	uint32_t fileLoadingFlags = vkglTF::FileLoadingFlags::None;
+	const std::vector<std::pair<std::string, uint32_t>> flagOptions = {
+		{ "pretransform", vkglTF::FileLoadingFlags::PreTransformVertices },
+		{ "premultiplycolors", vkglTF::FileLoadingFlags::PreMultiplyVertexColors },
+		{ "flipy", vkglTF::FileLoadingFlags::FlipY },
+		{ "noimages", vkglTF::FileLoadingFlags::DontLoadImages },
+		{ "optimizevertexcache", vkglTF::FileLoadingFlags::OptimizeVertexCache },
+		{ "meshlets", vkglTF::FileLoadingFlags::GenerateMeshlets },
+		{ "lods", vkglTF::FileLoadingFlags::GenerateLODs },
+	};
+	for (const auto& option : flagOptions) {
+		if (commandLineParser.isSet(option.first)) {
+			fileLoadingFlags |= option.second;
+		}
+	}
+
+	GltfCooker* cooker = new GltfCooker();
+	cooker->cook(input, output, fileLoadingFlags, scale);
+	bool valid = true;
+	if (commandLineParser.isSet("animationinstances")) {
+		valid = cooker->validateAnimation(output, static_cast<uint32_t>(std::max(commandLineParser.getValueAsInt("animationinstances", 1), 1)), 120);
+	}
+	delete(cooker);
+	return valid ? 0 : -1;
+}
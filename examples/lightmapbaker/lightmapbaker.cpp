@@ -0,0 +1,92 @@
+/*
+* Vulkan Example - Command line tool for baking glTF lightmaps on the CPU
+*
+* Generates the lightmap coordinates of a glTF model with the same chart and atlas layout the loader creates at runtime and bakes
+* an irradiance lightmap for them with the multi-threaded CPU path tracer, the result is written to a KTX file
+* No Vulkan device is created, so this can run on build machines without a GPU
+*
+* Copyright (C) 2026 by agent
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#if defined(_WIN32)
+#pragma comment(linker, "/subsystem:console")
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <algorithm>
+
+#include "VulkanTools.h"
+#include "VulkanglTFModel.h"
+#include "CommandLineParser.hpp"
+
+CommandLineParser commandLineParser;
+
+int main(int argc, char* argv[]) {
+	commandLineParser.add("help", { "--help" }, 0, "Show help");
+	commandLineParser.add("input", { "-i", "--input" }, 1, "glTF file to bake the lightmap for");
+	commandLineParser.add("output", { "-o", "--output" }, 1, "KTX file to write (defaults to the input file with an added .lightmap.ktx extension)");
+	commandLineParser.add("scale", { "--scale" }, 1, "Global scale passed to the loader");
+	commandLineParser.add("pretransform", { "--pretransform" }, 0, "Pre-transform vertices by the node hierarchy");
+	commandLineParser.add("premultiplycolors", { "--premultiplycolors" }, 0, "Pre-multiply vertex colors with the material base color");
+	commandLineParser.add("flipy", { "--flipy" }, 0, "Flip the y axis of vertex positions and normals");
+	commandLineParser.add("optimizevertexcache", { "--optimizevertexcache" }, 0, "Optimize primitives for the post-transform vertex cache");
+	commandLineParser.add("texelsperunit", { "--texelsperunit" }, 1, "Requested lightmap texel density in texels per unit");
+	commandLineParser.add("padding", { "--padding" }, 1, "Number of texels kept free around each chart");
+	commandLineParser.add("maxsize", { "--maxsize" }, 1, "Maximum width and height of the lightmap atlas");
+	commandLineParser.add("samples", { "--samples" }, 1, "Number of samples per texel");
+	commandLineParser.add("bounces", { "--bounces" }, 1, "Number of diffuse bounces");
+	commandLineParser.add("cache", { "--cache" }, 0, "Reuse and update the lightmap chart cache next to the input file");
+	commandLineParser.parse(argc, argv);
+	// Errors are reported on the console instead of message boxes
+	vks::tools::errorModeSilent = true;
+	if (commandLineParser.isSet("help") || !commandLineParser.isSet("input")) {
+		commandLineParser.printHelp();
+		return commandLineParser.isSet("help") ? 0 : -1;
+	}
+
+	const std::string input = commandLineParser.getValueAsString("input", "");
+	const float scale = std::stof(commandLineParser.getValueAsString("scale", "1.0"));
+
+	// These have to match the flags the model is loaded with at runtime, otherwise the lightmap coordinates differ
+	uint32_t fileLoadingFlags = vkglTF::FileLoadingFlags::None;
+	const std::vector<std::pair<std::string, uint32_t>> flagOptions = {
+		{ "pretransform", vkglTF::FileLoadingFlags::PreTransformVertices },
+		{ "premultiplycolors", vkglTF::FileLoadingFlags::PreMultiplyVertexColors },
+		{ "flipy", vkglTF::FileLoadingFlags::FlipY },
+		{ "optimizevertexcache", vkglTF::FileLoadingFlags::OptimizeVertexCache },
+	};
+	for (const auto& option : flagOptions) {
+		if (commandLineParser.isSet(option.first)) {
+			fileLoadingFlags |= option.second;
+		}
+	}
+
+	vkglTF::Model model;
+	vkglTF::Model::LightmapSettings& settings = model.lightmapSettings;
+	settings.bakeFile = commandLineParser.getValueAsString("output", input + ".lightmap.ktx");
+	settings.cache = commandLineParser.isSet("cache");
+	if (commandLineParser.isSet("texelsperunit")) {
+		settings.texelsPerUnit = std::stof(commandLineParser.getValueAsString("texelsperunit", ""));
+	}
+	if (commandLineParser.isSet("padding")) {
+		settings.padding = static_cast<uint32_t>(std::max(commandLineParser.getValueAsInt("padding", 0), 0));
+	}
+	if (commandLineParser.isSet("maxsize")) {
+		settings.maxSize = static_cast<uint32_t>(std::max(commandLineParser.getValueAsInt("maxsize", 0), 1));
+	}
+	if (commandLineParser.isSet("samples")) {
+		settings.bake.samples = static_cast<uint32_t>(std::max(commandLineParser.getValueAsInt("samples", 0), 1));
+	}
+	if (commandLineParser.isSet("bounces")) {
+		settings.bake.bounces = static_cast<uint32_t>(std::max(commandLineParser.getValueAsInt("bounces", 0), 0));
+	}
+
+	return model.bakeLightmapFromFile(input, fileLoadingFlags, scale) ? 0 : -1;
+}
@@ -15,6 +15,9 @@
 
 	A further optimization could be done using a geometry shader to do a single-pass render for the depth map
 	cascades instead of multiple passes (geometry shaders are not supported on all target devices).
+
+	The animated character is skinned once per frame by the glTF model's compute pre-pass, so all cascade passes
+	and the scene pass draw the same pre-skinned vertices with the static mesh pipelines.
 */
 
 #include "vulkanexamplebase.h"
@@ -46,8 +49,12 @@ public:
 	struct Models {
 		vkglTF::Model terrain;
 		vkglTF::Model tree;
+		vkglTF::Model character;
 	} models;
 
+	glm::vec3 characterPosition = glm::vec3(0.75f, 0.0f, -0.5f);
+	float animationTime = 0.0f;
+
 	struct uniformBuffers {
 		vks::Buffer VS;
 		vks::Buffer FS;
@@ -203,6 +210,12 @@ public:
 			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
 			models.tree.draw(commandBuffer, vkglTF::RenderFlags::BindImages, pipelineLayout);
 		}
+
+		// Animated character, the vertices have been skinned by the compute pre-pass
+		pushConstBlock.position = glm::vec4(characterPosition, 0.0f);
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstBlock), &pushConstBlock);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+		models.character.draw(commandBuffer, vkglTF::RenderFlags::BindImages, pipelineLayout);
 	}
 
 	/*
@@ -351,6 +364,12 @@ public:
 
 			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
+			/*
+				Skin the character once for all passes of this frame
+				The dispatches read the joint matrices when they execute, so the pre-recorded command buffers pick up the animation updates done in render()
+			*/
+			models.character.recordComputeSkinning(drawCmdBuffers[i]);
+
 			/*
 				Generate depth map cascades
 
@@ -446,6 +465,19 @@ public:
 		uint32_t glTFLoadingFlags = vkglTF::FileLoadingFlags::PreTransformVertices | vkglTF::FileLoadingFlags::FlipY;
 		models.terrain.loadFromFile(getAssetPath() + "models/terrain_gridlines.gltf", vulkanDevice, queue, glTFLoadingFlags);
 		models.tree.loadFromFile(getAssetPath() + "models/oaktree.gltf", vulkanDevice, queue, glTFLoadingFlags);
+		// The character is skinned at runtime, so its vertices can't be pre-transformed or flipped by the loader
+		models.character.loadFromFile(getAssetPath() + "models/CesiumMan/glTF/CesiumMan.gltf", vulkanDevice, queue, vkglTF::FileLoadingFlags::None);
+		// Flip and scale the (not animated) root nodes instead to match the other models
+		for (auto node : models.character.nodes) {
+			node->matrix = glm::scale(glm::mat4(1.0f), glm::vec3(0.5f, -0.5f, 0.5f)) * node->matrix;
+			node->dirty = true;
+		}
+		models.character.updateNodeMatrices();
+		for (auto node : models.character.nodes) {
+			node->update();
+		}
+		// Only a single frame is in flight, so the skinning pre-pass can read the node buffer that updateAnimation writes to
+		models.character.prepareComputeSkinning(loadShader(getShadersPath() + "base/skinning.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT), queue, pipelineCache);
 	}
 
 	void setupLayoutsAndDescriptors()
@@ -779,6 +811,15 @@ public:
 		if (!prepared)
 			return;
 		draw();
+		if (!paused) {
+			// submitFrame waits for the queue to become idle with a single frame in flight, so the node buffer isn't read by the GPU anymore
+			const vkglTF::Animation& animation = models.character.animations[0];
+			animationTime += frameTimer;
+			if (animationTime > animation.end) {
+				animationTime -= animation.end;
+			}
+			models.character.updateAnimation(0, animationTime);
+		}
 		if (!paused || camera.updated) {
 			updateLight();
 			updateCascades();
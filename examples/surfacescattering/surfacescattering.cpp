@@ -848,6 +848,8 @@ public:
 		renderPassBeginInfo.pClearValues = clearValues.data();
 
 		VK_CHECK_RESULT(vkBeginCommandBuffer(offScreenCmdBuffer, &cmdBufInfo));
+		gpuProfiler.beginFrame(offScreenCmdBuffer);
+		uint32_t scope = gpuProfiler.begin(offScreenCmdBuffer, "G-Buffer");
 
 		vkCmdBeginRenderPass(offScreenCmdBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
@@ -869,6 +871,7 @@ public:
 		vkCmdDrawIndexed(offScreenCmdBuffer, models.model.indices.count, 3, 0, 0, 0);
 
 		vkCmdEndRenderPass(offScreenCmdBuffer);
+		gpuProfiler.end(offScreenCmdBuffer, scope);
 
 		VK_CHECK_RESULT(vkEndCommandBuffer(offScreenCmdBuffer));
 	}
@@ -901,6 +904,8 @@ public:
 		renderPassBeginInfo.pClearValues = clearValues.data();
 
 		VK_CHECK_RESULT(vkBeginCommandBuffer(shadingCmdBuffer, &cmdBufInfo));
+		gpuProfiler.beginFrame(shadingCmdBuffer);
+		uint32_t scope = gpuProfiler.begin(shadingCmdBuffer, "Lighting");
 
 		vkCmdBeginRenderPass(shadingCmdBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
@@ -915,6 +920,7 @@ public:
 		vkCmdDraw(shadingCmdBuffer, 3, 1, 0, 0);
 
 		vkCmdEndRenderPass(shadingCmdBuffer);
+		gpuProfiler.end(shadingCmdBuffer, scope);
 
 		VK_CHECK_RESULT(vkEndCommandBuffer(shadingCmdBuffer));
 	}
@@ -1039,6 +1045,7 @@ public:
 			{
 
 				VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
+				gpuProfiler.beginFrame(drawCmdBuffers[i]);
 
 				VkViewport viewport = vks::initializers::viewport((float)offScreenFrameBuf.width, (float)offScreenFrameBuf.height, 0.0f, 1.0f);
 				vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
@@ -1069,6 +1076,7 @@ public:
 
 				if (burleySSS)
 				{
+					vks::GpuProfilerScope profilerScope(gpuProfiler, drawCmdBuffers[i], "Scattering");
 					//blurBurley
 					renderPassBeginInfo.renderPass = offScreenFrameBuf.renderPass3;
 					renderPassBeginInfo.framebuffer = offScreenFrameBuf.frameBuffer3;
@@ -1080,6 +1088,7 @@ public:
 				}
 				else
 				{
+					vks::GpuProfilerScope profilerScope(gpuProfiler, drawCmdBuffers[i], "Scattering");
 					//blurX
 					renderPassBeginInfo.renderPass = offScreenFrameBuf.renderPass3;
 					renderPassBeginInfo.framebuffer = offScreenFrameBuf.frameBuffer3;
@@ -1108,6 +1117,7 @@ public:
 				vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
 				scissor = vks::initializers::rect2D(width, height, 0, 0);
 				vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
+				uint32_t scope = gpuProfiler.begin(drawCmdBuffers[i], "Composition");
 				vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.composition2, 0, nullptr);
 				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.composition2);
@@ -1120,6 +1130,7 @@ public:
 				drawUI(drawCmdBuffers[i]);
 
 				vkCmdEndRenderPass(drawCmdBuffers[i]);
+				gpuProfiler.end(drawCmdBuffers[i], scope);
 
 				VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
 			}
@@ -1834,6 +1845,10 @@ public:
 			VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
 
 			VulkanExampleBase::submitFrame();
+
+			// submitFrame waits for the queue to become idle, so the timings of the offscreen command buffers are available
+			gpuProfiler.resolve(offScreenCmdBuffer);
+			gpuProfiler.resolve(shadingCmdBuffer);
 		}
 	}
 
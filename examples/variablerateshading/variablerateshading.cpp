@@ -8,6 +8,10 @@
 
 #include "variablerateshading.h"
 
+// Optionally stream the scene's textures, so rendering starts before all images have been decoded
+// Registered before the example is created, so the option is listed in the help
+static const bool streamTexturesOption = VulkanExampleBase::addCommandLineOption("streamtextures", { "-st", "--streamtextures" }, 0, "Stream textures in the background based on their screen coverage");
+
 VulkanExample::VulkanExample() : VulkanExampleBase()
 {
 	title = "Variable rate shading";
@@ -21,6 +25,9 @@ VulkanExample::VulkanExample() : VulkanExampleBase()
 	enabledInstanceExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
 	enabledDeviceExtensions.push_back(VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME);
 	enabledDeviceExtensions.push_back(VK_KHR_FRAGMENT_SHADING_RATE_EXTENSION_NAME);
+	// Command buffers are recorded every frame, so the CPU can work on the next frame while the GPU renders the previous ones
+	maxFramesInFlight = 2;
+	streamTextures = commandLineParser.isSet("streamtextures");
 }
 
 VulkanExample::~VulkanExample()
@@ -29,10 +36,14 @@ VulkanExample::~VulkanExample()
 	vkDestroyPipeline(device, pipelines.opaque, nullptr);
 	vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 	vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+	drawLists.opaque.destroy();
+	drawLists.masked.destroy();
 	vkDestroyImageView(device, shadingRateImage.view, nullptr);
 	vkDestroyImage(device, shadingRateImage.image, nullptr);
 	vkFreeMemory(device, shadingRateImage.memory, nullptr);
-	shaderData.buffer.destroy();
+	for (auto& buffer : shaderData.buffers) {
+		buffer.destroy();
+	}
 }
 
 void VulkanExample::getEnabledFeatures()
@@ -213,7 +224,8 @@ void VulkanExample::setupRenderPass()
 	VK_CHECK_RESULT(vkCreateRenderPass2KHR(device, &renderPassCI, nullptr, &renderPass));
 }
 
-void VulkanExample::buildCommandBuffers()
+// Records the current frame into the given command buffer
+void VulkanExample::buildCommandBuffer(VkCommandBuffer commandBuffer)
 {
 	// As this is an extension, we need to manually load the extension pointers
 	if (!vkCmdSetFragmentShadingRateKHR) {
@@ -239,62 +251,67 @@ void VulkanExample::buildCommandBuffers()
 	const VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
 	const VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
 
-	for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
+	renderPassBeginInfo.framebuffer = frameBuffers[currentBuffer];
+	VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &cmdBufInfo));
+	vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[getCurrentFrame()], 0, nullptr);
+
+	// Set the fragment shading rate state for the current pipeline
+	VkExtent2D fragmentSize = { 1, 1 };
+	VkFragmentShadingRateCombinerOpKHR combinerOps[2];
+	// The combiners determine how the different shading rate values for the pipeline, primitives and attachment are combined
+	// combinerOps[0] drawcall and primitives 
+	// combinerOps[1] fragment
+	if (enableShadingRate)
 	{
-		renderPassBeginInfo.framebuffer = frameBuffers[i];
-		VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
-		vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-		vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-		vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
-		vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
-
-		// Set the fragment shading rate state for the current pipeline
-		VkExtent2D fragmentSize = { 1, 1 };
-		VkFragmentShadingRateCombinerOpKHR combinerOps[2];
-		// The combiners determine how the different shading rate values for the pipeline, primitives and attachment are combined
-		// combinerOps[0] drawcall and primitives 
-		// combinerOps[1] fragment
-		if (enableShadingRate)
-		{
-			// If shading rate from attachment is enabled, we set the combiner, so that the values from the attachment are used
-			// Combiner for pipeline (A) and primitive (B) - Not used in this sample
-			combinerOps[0] = VK_FRAGMENT_SHADING_RATE_COMBINER_OP_KEEP_KHR;
-			// Combiner for pipeline (A) and attachment (B), replace the pipeline default value (fragment_size) with the fragment sizes stored in the attachment
-			combinerOps[1] = VK_FRAGMENT_SHADING_RATE_COMBINER_OP_REPLACE_KHR;
-		}
-		else
-		{
-			// If shading rate from attachment is disabled, we keep the value set via the dynamic state
-			combinerOps[0] = VK_FRAGMENT_SHADING_RATE_COMBINER_OP_KEEP_KHR;
-			combinerOps[1] = VK_FRAGMENT_SHADING_RATE_COMBINER_OP_KEEP_KHR;
-		}
-		vkCmdSetFragmentShadingRateKHR(drawCmdBuffers[i], &fragmentSize, combinerOps);
+		// If shading rate from attachment is enabled, we set the combiner, so that the values from the attachment are used
+		// Combiner for pipeline (A) and primitive (B) - Not used in this sample
+		combinerOps[0] = VK_FRAGMENT_SHADING_RATE_COMBINER_OP_KEEP_KHR;
+		// Combiner for pipeline (A) and attachment (B), replace the pipeline default value (fragment_size) with the fragment sizes stored in the attachment
+		combinerOps[1] = VK_FRAGMENT_SHADING_RATE_COMBINER_OP_REPLACE_KHR;
+	}
+	else
+	{
+		// If shading rate from attachment is disabled, we keep the value set via the dynamic state
+		combinerOps[0] = VK_FRAGMENT_SHADING_RATE_COMBINER_OP_KEEP_KHR;
+		combinerOps[1] = VK_FRAGMENT_SHADING_RATE_COMBINER_OP_KEEP_KHR;
+	}
+	vkCmdSetFragmentShadingRateKHR(commandBuffer, &fragmentSize, combinerOps);
 
-		// Render the scene
-		vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.opaque);
-		scene.draw(drawCmdBuffers[i], vkglTF::RenderFlags::BindImages | vkglTF::RenderFlags::RenderOpaqueNodes, pipelineLayout);
-		vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.masked);
-		scene.draw(drawCmdBuffers[i], vkglTF::RenderFlags::BindImages | vkglTF::RenderFlags::RenderAlphaMaskedNodes, pipelineLayout);
+	// Render the scene
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.opaque);
+	scene.draw(commandBuffer, drawLists.opaque, pipelineLayout, 1, 2, getCurrentFrame());
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.masked);
+	scene.draw(commandBuffer, drawLists.masked, pipelineLayout, 1, 2, getCurrentFrame());
 
-		drawUI(drawCmdBuffers[i]);
-		vkCmdEndRenderPass(drawCmdBuffers[i]);
-		VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
-	}
+	drawUI(commandBuffer);
+	vkCmdEndRenderPass(commandBuffer);
+	VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
 }
 
 void VulkanExample::loadAssets()
 {
 	vkglTF::descriptorBindingFlags = vkglTF::DescriptorBindingFlags::ImageBaseColor | vkglTF::DescriptorBindingFlags::ImageNormalMap;
-	scene.loadFromFile(getAssetPath() + "models/sponza/sponza.gltf", vulkanDevice, queue, vkglTF::FileLoadingFlags::PreTransformVertices);
+	// Vertices are not pre-transformed, as that would give every node its own copy of the mesh and prevent merging nodes into instanced draws
+	uint32_t glTFLoadingFlags = vkglTF::FileLoadingFlags::None;
+	if (streamTextures) {
+		glTFLoadingFlags |= vkglTF::FileLoadingFlags::StreamTextures;
+	}
+	scene.loadFromFile(getAssetPath() + "models/sponza/sponza.gltf", vulkanDevice, queue, glTFLoadingFlags);
+	// The node matrices are stored per frame in flight, the vertex shader fetches them with the instance index
+	scene.buildDrawList(drawLists.opaque, vkglTF::RenderFlags::BindImages | vkglTF::RenderFlags::RenderOpaqueNodes, false, framesInFlight);
+	scene.buildDrawList(drawLists.masked, vkglTF::RenderFlags::BindImages | vkglTF::RenderFlags::RenderAlphaMaskedNodes, false, framesInFlight);
 }
 
 void VulkanExample::setupDescriptors()
 {
 	// Pool
 	const std::vector<VkDescriptorPoolSize> poolSizes = {
-		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1),
+		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, framesInFlight),
 	};
-	VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 1);
+	VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, framesInFlight);
 	VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
 
 	// Descriptor set layout
@@ -305,20 +322,25 @@ void VulkanExample::setupDescriptors()
 	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &descriptorSetLayout));
 
 	// Pipeline layout
+	// Set 0 = scene uniforms, set 1 = material images, set 2 = instance matrices of the draw lists
 	const std::vector<VkDescriptorSetLayout> setLayouts = {
 		descriptorSetLayout,
 		vkglTF::descriptorSetLayoutImage,
+		vkglTF::descriptorSetLayoutInstances,
 	};
-	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(setLayouts.data(), 2);
+	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(setLayouts.data(), static_cast<uint32_t>(setLayouts.size()));
 	VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout));
 
-	// Descriptor set
-	VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
-	VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet));
-	std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
-		vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &shaderData.buffer.descriptor),
-	};
-	vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+	// Descriptor sets, one per frame in flight
+	descriptorSets.resize(framesInFlight);
+	for (uint32_t i = 0; i < framesInFlight; i++) {
+		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSets[i]));
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+			vks::initializers::writeDescriptorSet(descriptorSets[i], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &shaderData.buffers[i].descriptor),
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+	}
 }
 
 // [POI]
@@ -562,22 +584,28 @@ void VulkanExample::preparePipelines()
 
 void VulkanExample::prepareUniformBuffers()
 {
-	VK_CHECK_RESULT(vulkanDevice->createBuffer(
-		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		&shaderData.buffer,
-		sizeof(shaderData.values)));
-	VK_CHECK_RESULT(shaderData.buffer.map());
-	updateUniformBuffers();
+	shaderData.buffers.resize(framesInFlight);
+	for (auto& buffer : shaderData.buffers) {
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&buffer,
+			sizeof(shaderData.values)));
+		VK_CHECK_RESULT(buffer.map());
+	}
 }
 
+// Only the current frame's uniform buffer may be written, the others can still be in use by the GPU
 void VulkanExample::updateUniformBuffers()
 {
 	shaderData.values.projection = camera.matrices.perspective;
 	shaderData.values.view = camera.matrices.view;
 	shaderData.values.viewPos = camera.viewPos;
 	shaderData.values.colorShadingRate = colorShadingRate;
-	memcpy(shaderData.buffer.mapped, &shaderData.values, sizeof(shaderData.values));
+	memcpy(shaderData.buffers[getCurrentFrame()].mapped, &shaderData.values, sizeof(shaderData.values));
+	// The nodes of this scene are static, but the current frame's instance matrices are updated like the uniforms so animated nodes would work the same way
+	scene.updateDrawList(drawLists.opaque, getCurrentFrame());
+	scene.updateDrawList(drawLists.masked, getCurrentFrame());
 }
 
 void VulkanExample::prepare()
@@ -587,25 +615,34 @@ void VulkanExample::prepare()
 	prepareUniformBuffers();
 	setupDescriptors();
 	preparePipelines();
-	buildCommandBuffers();
 	prepared = true;
 }
 
 void VulkanExample::render()
 {
-	renderFrame();
-	if (camera.updated) {
-		updateUniformBuffers();
+	// Streaming may update material descriptor sets (and return true if it did), which is fine here as the command buffer is recorded anew every frame
+	if (streamTextures) {
+		scene.updateTextureStreaming(camera.matrices.perspective, camera.matrices.view, height, queue);
 	}
+	prepareFrame();
+	updateUniformBuffers();
+	VkCommandBuffer commandBuffer = getCurrentCommandBuffer();
+	buildCommandBuffer(commandBuffer);
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+	VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+	submitFrame();
 }
 
 void VulkanExample::OnUpdateUIOverlay(vks::UIOverlay* overlay)
 {
-	if (overlay->checkBox("Enable shading rate", &enableShadingRate)) {
-		buildCommandBuffers();
-	}
-	if (overlay->checkBox("Color shading rates", &colorShadingRate)) {
-		updateUniformBuffers();
+	// Command buffers and uniform buffers are updated every frame, so changed settings apply to the next frame
+	overlay->checkBox("Enable shading rate", &enableShadingRate);
+	overlay->checkBox("Color shading rates", &colorShadingRate);
+	if (streamTextures && overlay->header("Texture streaming")) {
+		overlay->text("Resident: %d / %d", scene.textureStreamingStatistics.residentTextures, scene.textureStreamingStatistics.streamedTextures);
+		overlay->text("Memory: %.1f MB", static_cast<float>(scene.textureStreamingStatistics.memoryUsed) / (1024.0f * 1024.0f));
+		overlay->text("Evictions: %d", scene.textureStreamingStatistics.evictions);
 	}
 }
 
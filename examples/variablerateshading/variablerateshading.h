@@ -13,6 +13,11 @@ class VulkanExample : public VulkanExampleBase
 {
 public:
 	vkglTF::Model scene;
+	// Opaque and masked nodes are drawn from draw lists, so nodes sharing a mesh are merged into instanced draws
+	struct DrawLists {
+		vkglTF::DrawList opaque;
+		vkglTF::DrawList masked;
+	} drawLists;
 
 	struct ShadingRateImage {
 		VkImage image{ VK_NULL_HANDLE };
@@ -22,9 +27,11 @@ public:
 
 	bool enableShadingRate = true;
 	bool colorShadingRate = false;
+	bool streamTextures = false;
 
+	// Uniform buffers and descriptor sets are written by the CPU every frame, so there is one per frame in flight
 	struct ShaderData {
-		vks::Buffer buffer;
+		std::vector<vks::Buffer> buffers;
 		struct Values {
 			glm::mat4 projection;
 			glm::mat4 view;
@@ -41,7 +48,7 @@ public:
 	} pipelines;
 
 	VkPipelineLayout pipelineLayout;
-	VkDescriptorSet descriptorSet;
+	std::vector<VkDescriptorSet> descriptorSets;
 	VkDescriptorSetLayout descriptorSetLayout;
 
 	VkPhysicalDeviceFragmentShadingRatePropertiesKHR physicalDeviceShadingRateImageProperties{};
@@ -55,7 +62,7 @@ public:
 	~VulkanExample();
 	virtual void getEnabledFeatures() override;
 	void handleResize();
-	void buildCommandBuffers() override;
+	void buildCommandBuffer(VkCommandBuffer commandBuffer);
 	void loadAssets();
 	void prepareShadingRateImage();
 	void setupDescriptors();
@@ -16,6 +16,12 @@ layout (set = 0, binding = 0) uniform UBOScene
 	int colorShadingRates;
 } uboScene;
 
+// Node matrices of the model's draw list, indexed by the instance (draws start at the first instance of their batch)
+layout (set = 2, binding = 0) readonly buffer Instances
+{
+	mat4 matrices[];
+} instances;
+
 layout (location = 0) out vec3 outNormal;
 layout (location = 1) out vec3 outColor;
 layout (location = 2) out vec2 outUV;
@@ -25,14 +31,16 @@ layout (location = 5) out vec4 outTangent;
 
 void main() 
 {
+	mat4 model = uboScene.model * instances.matrices[gl_InstanceIndex];
+
 	outNormal = inNormal;
 	outColor = inColor;
 	outUV = inUV;
 	outTangent = inTangent;
-	gl_Position = uboScene.projection * uboScene.view * uboScene.model * vec4(inPos.xyz, 1.0);
+	gl_Position = uboScene.projection * uboScene.view * model * vec4(inPos.xyz, 1.0);
 	
-	outNormal = mat3(uboScene.model) * inNormal;
-	vec4 pos = uboScene.model * vec4(inPos, 1.0);
+	outNormal = mat3(model) * inNormal;
+	vec4 pos = model * vec4(inPos, 1.0);
 	outLightVec = uboScene.lightPos.xyz - pos.xyz;
 	outViewVec = uboScene.viewPos.xyz - pos.xyz;
 }
\ No newline at end of file
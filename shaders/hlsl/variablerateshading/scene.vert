@@ -20,6 +20,9 @@ struct UBO
 };
 cbuffer ubo : register(b0) { UBO ubo; };
 
+// Node matrices of the model's draw list, indexed by the instance (draws start at the first instance of their batch)
+StructuredBuffer<float4x4> instances : register(t0, space2);
+
 struct VSOutput
 {
 	float4 Pos : SV_POSITION;
@@ -31,7 +34,7 @@ struct VSOutput
 [[vk::location(5)]] float4 Tangent : TEXCOORD3;
 };
 
-VSOutput main(VSInput input)
+VSOutput main(VSInput input, uint InstanceIndex : SV_InstanceID)
 {
 	VSOutput output = (VSOutput)0;
 	output.Normal = input.Normal;
@@ -39,12 +42,13 @@ VSOutput main(VSInput input)
 	output.UV = input.UV;
 	output.Tangent = input.Tangent;
 
-	float4x4 modelView = mul(ubo.view, ubo.model);
+	float4x4 model = mul(ubo.model, instances[InstanceIndex]);
+	float4x4 modelView = mul(ubo.view, model);
 
 	output.Pos = mul(ubo.projection, mul(modelView, float4(input.Pos.xyz, 1.0)));
 
-	output.Normal = mul((float3x3)ubo.model, input.Normal);
-	float4 pos = mul(ubo.model, float4(input.Pos, 1.0));
+	output.Normal = mul((float3x3)model, input.Normal);
+	float4 pos = mul(model, float4(input.Pos, 1.0));
 	output.LightVec = ubo.lightPos.xyz - pos.xyz;
 	output.ViewVec = ubo.viewPos.xyz - pos.xyz;
 	return output;